@@ -95,3 +95,61 @@ unsigned int parfu_what_is_path(string pathname,
   }
   return PARFU_WHAT_IS_PATH_IGNORED_TYPE;
 }
+
+// Same as parfu_what_is_path() above, but the entry is looked up by
+// name relative to an already-open directory (dir_fd) with fstatat()
+// and readlinkat(), so the caller doesn't need to build the full path.
+// This is what the spider uses.  If entry_stat is not NULL the full
+// stat() result is copied out so the caller can keep the metadata
+// and never has to stat this entry again.  
+unsigned int parfu_what_is_path_at(int dir_fd,
+				   const char *entry_name,
+				   string &target_text,
+				   long int *size,
+				   struct stat *entry_stat,
+				   bool follow_symlinks){
+  struct stat filestruct;
+  int returnval;
+  int buffer_length;
+  char *target_name_buffer;
+
+  if((returnval=fstatat(dir_fd,entry_name,&filestruct,
+			follow_symlinks ? 0 : AT_SYMLINK_NOFOLLOW))){
+    if(errno == ENOENT){
+      cerr << "parfu_what_is_path_at:\n";
+      cerr << "ERROR: file >" << entry_name << "< does not exist!\n";
+      return PARFU_WHAT_IS_PATH_DOES_NOT_EXIST;
+    }
+    fprintf(stderr,"parfu_what_is_path_at:\n");
+    fprintf(stderr,"  fstatat returned %d with path >%s<!!!\n",returnval,entry_name);
+    return PARFU_WHAT_IS_PATH_ERROR;
+  }
+  if(entry_stat != NULL){
+    *entry_stat = filestruct;
+  }
+  if(S_ISLNK(filestruct.st_mode)){
+    // harvest the symlink target so that we can pass it back
+    buffer_length=(filestruct.st_size)+1;
+    target_name_buffer = new char[buffer_length];
+    returnval=readlinkat(dir_fd,entry_name,target_name_buffer,buffer_length);
+    if(returnval != (buffer_length-1) ){
+      fprintf(stderr,"parfu_what_is_path_at:\n");
+      fprintf(stderr,"  error in length of target return!!\n");
+      delete[] target_name_buffer;
+      return PARFU_WHAT_IS_PATH_ERROR;
+    }
+    target_text = string(target_name_buffer,returnval);
+    delete[] target_name_buffer;
+    return PARFU_WHAT_IS_PATH_SYMLINK;
+  } // if(S_ISLNK...
+  if(S_ISDIR(filestruct.st_mode)){
+    return PARFU_WHAT_IS_PATH_DIR;
+  }
+  if(S_ISREG(filestruct.st_mode)){
+    if(size != NULL){
+      *size = filestruct.st_size;
+    }
+    return PARFU_WHAT_IS_PATH_REGFILE;
+  }
+  return PARFU_WHAT_IS_PATH_IGNORED_TYPE;
+}
@@ -29,4 +29,11 @@ unsigned int parfu_what_is_path(string pathname,
 				long int *size,
 				bool follow_symlinks);
 
+unsigned int parfu_what_is_path_at(int dir_fd,
+				   const char *entry_name,
+				   string &target_text,
+				   long int *size,
+				   struct stat *entry_stat,
+				   bool follow_symlinks);
+
 
@@ -0,0 +1,621 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  University of Illinois/NCSA Open Source License
+//  http://otm.illinois.edu/disclose-protect/illinois-open-source-license
+//
+//  Parfu is copyright (c) 2017-2022,
+//  by The Trustees of the University of Illinois.
+//  All rights reserved.
+//
+//  Parfu was developed by:
+//  The University of Illinois
+//  The National Center For Supercomputing Applications (NCSA)
+//  Blue Waters Science and Engineering Applications Support Team (SEAS)
+//  Craig P Steffen <csteffen@ncsa.illinois.edu>
+//  Roland Haas <rhaas@illinois.edu>
+//
+//  https://github.com/ncsa/parfu_archive_tool
+//  http://www.ncsa.illinois.edu/People/csteffen/parfu/
+//
+//  For full licnse text see the LICENSE file provided with the source
+//  distribution.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "parfu_main.hh"
+
+#include <thread>
+#include <fnmatch.h>
+
+////////////////
+//
+// The archive catalog.
+//
+// A 0.6 archive starts with a tar member named PARFU_CATALOG_ENTRY_NAME
+// whose contents are the catalog described in
+// parfu_2022_catalog_format.txt: a short header, then one line per
+// entry giving where the entry's tar header starts in the archive.
+// Because it's an ordinary tar member, plain tar just extracts it as a
+// file; parfu reads it to find any member without walking the archive.
+//
+// The order of operations on rank 0 in create mode is:
+//   catalog_region_size()    (sizes the catalog with dummy locations)
+//   set_offsets(<that size>) (data area starts right after the catalog)
+//   catalog_region()         (the real catalog, same size)
+
+// the catalog lines for entries first_entry up to (not including)
+// last_entry, into *out_string.  Entries that don't have a location
+// yet get zeros, which are the same width as a real location.
+static void parfu_catalog_lines(Parfu_target_collection *collection,
+				unsigned long first_entry,
+				unsigned long last_entry,
+				string *out_string){
+  Parfu_storage_reference *my_ref;
+  unsigned long location;
+  for(unsigned long ndx=first_entry; ndx<last_entry; ndx++){
+    my_ref = collection->entry(ndx);
+    location = 0UL;
+    if(my_ref->slices.size() &&
+       my_ref->slices.front().offset_in_container() !=
+       ((unsigned long)PARFU_OFFSET_INVALID)){
+      location = my_ref->slices.front().offset_in_container();
+    }
+    out_string->append(my_ref->storage_ptr->generate_archive_catalog_line(location));
+  }
+}
+
+// The catalog header for a catalog whose lines add up to body_size
+// bytes.  It's four fixed-width lines, so we know its size up front
+// and can include it in the total.
+string parfu_catalog_header(unsigned long body_size,
+			    unsigned long total_entries){
+  string header;
+  char number_string[PARFU_CATALOG_HEADER_DIGITS+2];
+
+  snprintf(number_string,sizeof(number_string),"%0*lu\n",
+	   PARFU_CATALOG_HEADER_DIGITS,body_size+4*(PARFU_CATALOG_HEADER_DIGITS+1));
+  header.append(number_string);
+  header.append(PARFU_CATALOG_VERSION_STRING);
+  header += PARFU_LINE_SEPARATOR_CHARACTER;
+  // only one archive file for now
+  header.append("000 of 001");
+  header += PARFU_LINE_SEPARATOR_CHARACTER;
+  snprintf(number_string,sizeof(number_string),"%0*lu\n",
+	   PARFU_CATALOG_HEADER_DIGITS,total_entries);
+  header.append(number_string);
+  return header;
+}
+
+string Parfu_target_collection::archive_catalog(unsigned n_threads){
+  vector <string> chunk_lines;
+  vector <thread> catalog_threads;
+  unsigned long total_entries = n_entries();
+  unsigned long chunk_size;
+  unsigned long catalog_size;
+  string header;
+  string out_string;
+
+  if(n_threads < 1){
+    n_threads = thread::hardware_concurrency();
+    if(n_threads < 1){
+      n_threads = 1;
+    }
+  }
+  // not worth a thread for fewer than a few thousand lines
+  if(total_entries < 4096UL*n_threads){
+    n_threads = (total_entries / 4096UL) + 1;
+  }
+  chunk_size = (total_entries + n_threads - 1) / n_threads;
+  chunk_lines.resize(n_threads);
+  for(unsigned i=0; i<n_threads; i++){
+    unsigned long first_entry = min(total_entries, i*chunk_size);
+    unsigned long last_entry = min(total_entries, (i+1)*chunk_size);
+    catalog_threads.push_back(thread(parfu_catalog_lines,this,
+				     first_entry,last_entry,
+				     &(chunk_lines.at(i))));
+  }
+  catalog_size = 0UL;
+  for(unsigned i=0; i<n_threads; i++){
+    catalog_threads.at(i).join();
+    catalog_size += chunk_lines.at(i).size();
+  }
+
+  header = parfu_catalog_header(catalog_size,total_entries);
+  catalog_size += header.size();
+  out_string.reserve(catalog_size);
+  out_string.append(header);
+  for(unsigned i=0; i<n_threads; i++){
+    out_string.append(chunk_lines.at(i));
+  }
+  return out_string;
+}
+
+unsigned long Parfu_target_collection::catalog_region_size(bool with_index){
+  unsigned long catalog_size = archive_catalog().size();
+  unsigned long region_size;
+  region_size = parfu_next_block_boundary(tarentry::compute_hdr_size(PARFU_CATALOG_ENTRY_NAME,
+								     "",catalog_size) +
+					  catalog_size);
+  if(with_index){
+    unsigned long index_size = archive_index_size();
+    region_size += parfu_next_block_boundary(tarentry::compute_hdr_size(PARFU_INDEX_ENTRY_NAME,
+									"",index_size) +
+					     index_size);
+  }
+  return region_size;
+}
+
+// appends one metadata member (header, contents, padding) to out_string
+void parfu_append_metadata_member(string *out_string,
+				  const char *member_name,
+				  const string &member_contents){
+  struct stat member_statbuf;
+  vector <char> member_header;
+
+  memset(&member_statbuf,0,sizeof(member_statbuf));
+  member_statbuf.st_mode = S_IFREG | 0444;
+  member_statbuf.st_uid = getuid();
+  member_statbuf.st_gid = getgid();
+  member_statbuf.st_mtime = time(nullptr);
+  member_statbuf.st_size = member_contents.size();
+  member_header = tarentry(member_name,0,
+			   member_statbuf,"").make_tar_header();
+  out_string->append(member_header.data(),member_header.size());
+  out_string->append(member_contents);
+  out_string->resize(parfu_next_block_boundary(out_string->size()),'\0');
+}
+
+string Parfu_target_collection::catalog_region(bool with_index){
+  string out_string;
+
+  out_string.reserve(catalog_region_size(with_index));
+  parfu_append_metadata_member(&out_string,PARFU_CATALOG_ENTRY_NAME,
+			       archive_catalog());
+  if(with_index){
+    parfu_append_metadata_member(&out_string,PARFU_INDEX_ENTRY_NAME,
+				 archive_index());
+  }
+  return out_string;
+}
+
+Parfu_target_collection::Parfu_target_collection(const string &catalog_text){
+  size_t line_begin=0,line_end;
+  unsigned long n_lines=0;
+  unsigned long header_entries;
+
+  // skip the header; the last header line is the entry count
+  for(int i=0; i<4; i++){
+    if((line_end=catalog_text.find(PARFU_LINE_SEPARATOR_CHARACTER,line_begin))
+       == string::npos){
+      cerr << "Parfu_target_collection: catalog header is truncated!\n";
+      return;
+    }
+    if(i==1 &&
+       catalog_text.substr(line_begin,line_end-line_begin) != PARFU_CATALOG_VERSION_STRING){
+      cerr << "Parfu_target_collection: catalog version is not " << PARFU_CATALOG_VERSION_STRING << "!\n";
+      return;
+    }
+    if(i==3){
+      header_entries = stoul(catalog_text.substr(line_begin,line_end-line_begin));
+    }
+    line_begin = line_end + 1;
+  }
+
+  while((line_end=catalog_text.find(PARFU_LINE_SEPARATOR_CHARACTER,line_begin))
+	!= string::npos){
+    string catalog_line = catalog_text.substr(line_begin,line_end-line_begin);
+    line_begin = line_end + 1;
+    if(add_catalog_line(catalog_line)){
+      n_lines++;
+    }
+  }
+  if(n_lines != header_entries){
+    cerr << "WARNING! catalog header says " << header_entries;
+    cerr << " entries but it has " << n_lines << "!\n";
+  }
+}
+
+bool Parfu_target_collection::add_catalog_line(const string &catalog_line){
+  Parfu_storage_reference my_ref;
+  Parfu_target_file *my_entry;
+  size_t location_begin;
+
+  my_entry = new Parfu_target_file(catalog_line);
+  if(my_entry->entry_type() == PARFU_FILE_TYPE_INVALID){
+    delete my_entry;
+    return false;
+  }
+  location_begin = catalog_line.rfind(PARFU_ENTRY_SEPARATOR_CHARACTER) + 1;
+  my_ref.storage_ptr = my_entry;
+  my_ref.order_size = my_entry->file_size;
+  my_ref.slices.push_back(Parfu_file_slice(my_entry->header_size(),
+					   my_entry->file_size,
+					   0L,
+					   stoul(catalog_line.substr(location_begin))));
+  if(my_entry->entry_type() == PARFU_FILE_TYPE_DIRECTORY){
+    my_ref.order_size = PARFU_FILE_SIZE_DIR;
+    directories.push_back(my_ref);
+  }
+  else{
+    files.push_back(my_ref);
+  }
+  return true;
+}
+
+// Whether an archive path is picked out by any of the patterns.  A
+// pattern with no glob characters in it is a path prefix: it picks
+// out that path and, if it's a directory, everything under it.  A
+// pattern with glob characters is matched with fnmatch() against the
+// path and each of the directories above it, so "run_0*" picks out
+// the whole of every matching top-level directory.
+bool parfu_path_selected(const string &path, const vector <string> &patterns){
+  for(unsigned i=0; i<patterns.size(); i++){
+    string pattern = patterns.at(i);
+    bool is_glob;
+    size_t slash_position;
+    while(pattern.size() > 1 && pattern.back() == '/'){
+      pattern.pop_back();
+    }
+    is_glob = (pattern.find_first_of("*?[") != string::npos);
+    if(!is_glob){
+      if(path.compare(0,pattern.size(),pattern) == 0 &&
+	 (path.size() == pattern.size() || path.at(pattern.size()) == '/')){
+	return true;
+      }
+      continue;
+    }
+    if(!fnmatch(pattern.c_str(),path.c_str(),0)){
+      return true;
+    }
+    slash_position = 0;
+    while((slash_position=path.find('/',slash_position)) != string::npos){
+      if(!fnmatch(pattern.c_str(),path.substr(0,slash_position).c_str(),0)){
+	return true;
+      }
+      slash_position++;
+    }
+  }
+  return false;
+}
+
+// A hard link or duplicate can be selected without the entry it
+// refers to.  Then the first one selected stands in for that entry:
+// the entry is kept, moved to the link's path, and supplies the
+// data.  A hard link is just another name for it, so the link goes;
+// a duplicate stays, with no target, to put back its own metadata.
+// Later links to the same entry refer to the stand-in instead.  A
+// hard link to a duplicate pulls the duplicate in the same way, and
+// that in turn pulls in its original if need be.
+unsigned long Parfu_target_collection::select_entries(const vector <string> &patterns){
+  vector <Parfu_storage_reference> kept;
+  for(unsigned long ndx=0; ndx<directories.size(); ndx++){
+    if(parfu_path_selected(directories.at(ndx).storage_ptr->relative_path,patterns)){
+      kept.push_back(directories.at(ndx));
+    }
+    else{
+      delete directories.at(ndx).storage_ptr;
+    }
+  }
+  directories.swap(kept);
+
+  vector <bool> keep(files.size());
+  map <string,unsigned long> file_by_path;
+  map <string,string> stand_in;
+  vector <unsigned long> links;
+  for(unsigned long ndx=0; ndx<files.size(); ndx++){
+    Parfu_storage_entry *entry = files.at(ndx).storage_ptr;
+    keep.at(ndx) = parfu_path_selected(entry->relative_path,patterns);
+    file_by_path[entry->relative_path] = ndx;
+    if(keep.at(ndx) &&
+       (entry->entry_type() == PARFU_FILE_TYPE_HARDLINK ||
+	entry->entry_type() == PARFU_FILE_TYPE_DUPLICATE)){
+      links.push_back(ndx);
+    }
+  }
+  for(unsigned long i=0; i<links.size(); i++){
+    Parfu_storage_entry *link = files.at(links.at(i)).storage_ptr;
+    map <string,string>::iterator moved = stand_in.find(link->symlink_target);
+    if(moved != stand_in.end()){
+      link->symlink_target = moved->second;
+      continue;
+    }
+    map <string,unsigned long>::iterator target = file_by_path.find(link->symlink_target);
+    if(target == file_by_path.end() || keep.at(target->second)){
+      continue;
+    }
+    Parfu_storage_entry *original = files.at(target->second).storage_ptr;
+    stand_in[link->symlink_target] = link->relative_path;
+    original->relative_path = link->relative_path;
+    keep.at(target->second) = true;
+    if(link->entry_type() == PARFU_FILE_TYPE_HARDLINK){
+      keep.at(links.at(i)) = false;
+      if(original->entry_type() == PARFU_FILE_TYPE_DUPLICATE){
+	links.push_back(target->second);
+      }
+    }
+    else{
+      link->symlink_target.clear();
+    }
+  }
+  // still in archive order, which create_transfer_orders() needs
+  kept.clear();
+  for(unsigned long ndx=0; ndx<files.size(); ndx++){
+    if(keep.at(ndx)){
+      kept.push_back(files.at(ndx));
+    }
+    else{
+      delete files.at(ndx).storage_ptr;
+    }
+  }
+  files.swap(kept);
+  return n_entries();
+}
+
+// Pull the catalog text out of the front of an existing archive.  This
+// is a plain POSIX read, so any one rank can do it.  Returns an empty
+// string if the archive doesn't start with a catalog.
+string parfu_read_archive_catalog(string archive_file_name){
+  char header_block[BLOCKSIZE];
+  char size_field[13];
+  unsigned long catalog_size;
+  unsigned long header_size;
+  string catalog_text;
+  int archive_fd;
+
+  if((archive_fd=open(archive_file_name.c_str(),O_RDONLY))<0){
+    cerr << "parfu_read_archive_catalog: could not open " << archive_file_name;
+    cerr << ": " << strerror(errno) << "\n";
+    return string("");
+  }
+  // The catalog name is short, so its tar header is a single plain
+  // ustar block: name at byte 0, octal size at byte 124.
+  if(pread(archive_fd,header_block,BLOCKSIZE,0) != BLOCKSIZE ||
+     strncmp(header_block,PARFU_CATALOG_ENTRY_NAME,100)){
+    cerr << "parfu_read_archive_catalog: " << archive_file_name;
+    cerr << " does not start with a parfu catalog.\n";
+    close(archive_fd);
+    return string("");
+  }
+  memcpy(size_field,header_block+124,12);
+  size_field[12]='\0';
+  catalog_size = strtoul(size_field,nullptr,8);
+  header_size = tarentry::compute_hdr_size(PARFU_CATALOG_ENTRY_NAME,"",catalog_size);
+  catalog_text.resize(catalog_size);
+  if(pread(archive_fd,&(catalog_text[0]),catalog_size,header_size) !=
+     ((ssize_t)catalog_size)){
+    cerr << "parfu_read_archive_catalog: short read of catalog in ";
+    cerr << archive_file_name << "\n";
+    catalog_text.clear();
+  }
+  close(archive_fd);
+  return catalog_text;
+}
+
+// one file's slice checksums put together
+typedef struct{
+  uint64_t data_location;
+  uint64_t covered;
+  uint32_t checksum;
+  // OR of the slices' PARFU_SLICE_* flags
+  uint32_t flags;
+  // the slices start at 0 and follow on from each other
+  bool complete;
+}parfu_combined_checksum_t;
+
+// Sort the slices so each file's are together and in order, then
+// combine them.  Empty slices only carry flags.
+static vector <parfu_combined_checksum_t> parfu_combine_slice_checksums(vector <parfu_slice_checksum_t> *slices){
+  vector <parfu_combined_checksum_t> combined;
+  unsigned long slice_ndx=0;
+
+  sort(slices->begin(),slices->end(),
+       [](const parfu_slice_checksum_t &a, const parfu_slice_checksum_t &b){
+	 if(a.data_location != b.data_location){
+	   return a.data_location < b.data_location;
+	 }
+	 return a.offset_in_file < b.offset_in_file;
+       });
+  while(slice_ndx < slices->size()){
+    parfu_combined_checksum_t file_checksum;
+    file_checksum.data_location = slices->at(slice_ndx).data_location;
+    file_checksum.covered = 0;
+    file_checksum.checksum = 0;
+    file_checksum.flags = 0;
+    file_checksum.complete = true;
+    for(; slice_ndx < slices->size() &&
+	  slices->at(slice_ndx).data_location == file_checksum.data_location; slice_ndx++){
+      file_checksum.flags |= slices->at(slice_ndx).flags;
+      if(!(slices->at(slice_ndx).length)){
+	continue;
+      }
+      if(slices->at(slice_ndx).offset_in_file != file_checksum.covered){
+	file_checksum.complete = false;
+      }
+      file_checksum.checksum = parfu_crc32c_combine(file_checksum.checksum,
+						    slices->at(slice_ndx).checksum,
+						    slices->at(slice_ndx).length);
+      file_checksum.covered += slices->at(slice_ndx).length;
+    }
+    combined.push_back(file_checksum);
+  }
+  return combined;
+}
+
+unsigned long Parfu_target_collection::set_checksums(vector <parfu_slice_checksum_t> *slices,
+						     unsigned long *n_unreadable){
+  map <unsigned long, Parfu_storage_entry*> data_locations;
+  vector <parfu_combined_checksum_t> combined;
+  unsigned long n_set=0;
+
+  *n_unreadable = 0;
+  for(unsigned long ndx=0; ndx<files.size(); ndx++){
+    Parfu_storage_entry *my_entry = files.at(ndx).storage_ptr;
+    if(my_entry->entry_type() != PARFU_FILE_TYPE_REGULAR ||
+       files.at(ndx).slices.empty()){
+      continue;
+    }
+    if(!(my_entry->file_size)){
+      // nothing moved, so no slices; this is the CRC of nothing
+      my_entry->set_checksum(0);
+      n_set++;
+      continue;
+    }
+    data_locations[files.at(ndx).slices.front().offset_in_container() +
+		   my_entry->header_size()] = my_entry;
+  }
+  combined = parfu_combine_slice_checksums(slices);
+  for(unsigned long ndx=0; ndx<combined.size(); ndx++){
+    auto entry_iter = data_locations.find(combined.at(ndx).data_location);
+    if(entry_iter == data_locations.end()){
+      cerr << "set_checksums: no file has its data at " << combined.at(ndx).data_location << "!\n";
+      continue;
+    }
+    if(combined.at(ndx).flags & PARFU_SLICE_SOURCE_UNREADABLE){
+      cerr << "Could not read all of " << entry_iter->second->get_relative_path();
+      cerr << "; it's in the archive with zeros in place of what's missing.\n";
+      (*n_unreadable)++;
+      continue;
+    }
+    if(!combined.at(ndx).complete ||
+       combined.at(ndx).covered != ((uint64_t)(entry_iter->second->file_size))){
+      cerr << "set_checksums: slices of " << entry_iter->second->get_relative_path();
+      cerr << " don't cover the file; leaving it without a checksum.\n";
+      continue;
+    }
+    entry_iter->second->set_checksum(combined.at(ndx).checksum);
+    n_set++;
+  }
+  return n_set;
+}
+
+static string parfu_checksum_hex(uint32_t checksum){
+  char hex_digits[PARFU_CATALOG_CHECKSUM_DIGITS+1];
+  snprintf(hex_digits,sizeof(hex_digits),"%0*x",
+	   PARFU_CATALOG_CHECKSUM_DIGITS,checksum);
+  return string(hex_digits);
+}
+
+unsigned long Parfu_target_collection::verify_checksums(vector <parfu_slice_checksum_t> *slices){
+  map <unsigned long, Parfu_storage_entry*> data_locations;
+  set <unsigned long> seen_locations;
+  // for hard links and duplicates: the regular files by path, and
+  // what each link refers to (which can be another link)
+  map <string, Parfu_storage_entry*> regular_files;
+  map <string, string> link_targets;
+  vector <parfu_combined_checksum_t> combined;
+  unsigned long n_bad=0;
+  unsigned long n_against_catalog=0;
+
+  for(unsigned long ndx=0; ndx<n_entries(); ndx++){
+    Parfu_storage_reference *my_ref = entry(ndx);
+    Parfu_storage_entry *my_entry = my_ref->storage_ptr;
+    if(my_entry->entry_type() == PARFU_FILE_TYPE_REGULAR){
+      regular_files[my_entry->relative_path] = my_entry;
+    }
+    else if((my_entry->entry_type() == PARFU_FILE_TYPE_HARDLINK ||
+	     my_entry->entry_type() == PARFU_FILE_TYPE_DUPLICATE) &&
+	    my_entry->symlink_target.size()){
+      link_targets[my_entry->relative_path] = my_entry->symlink_target;
+    }
+    if(my_ref->slices.empty()){
+      continue;
+    }
+    data_locations[my_ref->slices.front().offset_in_container() +
+		   my_entry->header_size()] = my_entry;
+  }
+  combined = parfu_combine_slice_checksums(slices);
+  for(unsigned long ndx=0; ndx<combined.size(); ndx++){
+    parfu_combined_checksum_t *file_checksum = &(combined.at(ndx));
+    vector <string> problems;
+    auto entry_iter = data_locations.find(file_checksum->data_location);
+    if(entry_iter == data_locations.end()){
+      cerr << "verify_checksums: no member has its data at " << file_checksum->data_location << "!\n";
+      n_bad++;
+      continue;
+    }
+    Parfu_storage_entry *my_entry = entry_iter->second;
+    seen_locations.insert(file_checksum->data_location);
+    if(file_checksum->flags & PARFU_SLICE_BAD_HEADER){
+      problems.push_back("damaged tar header");
+    }
+    if(file_checksum->flags & PARFU_SLICE_SOURCE_UNREADABLE){
+      problems.push_back("could not read the source file");
+    }
+    if(file_checksum->flags & PARFU_SLICE_DIFFERS_FROM_SOURCE){
+      problems.push_back("differs from the source file");
+    }
+    if(my_entry->entry_type() == PARFU_FILE_TYPE_REGULAR){
+      if(!file_checksum->complete ||
+	 file_checksum->covered != ((uint64_t)(my_entry->file_size))){
+	problems.push_back("only "+to_string(file_checksum->covered)+" of "+
+			   to_string(my_entry->file_size)+" bytes were checked");
+      }
+      else if(my_entry->has_checksum()){
+	n_against_catalog++;
+	if(file_checksum->checksum != my_entry->checksum()){
+	  problems.push_back("CRC32C is "+parfu_checksum_hex(file_checksum->checksum)+
+			     ", catalog says "+parfu_checksum_hex(my_entry->checksum()));
+	}
+      }
+    }
+    else if((my_entry->entry_type() == PARFU_FILE_TYPE_HARDLINK ||
+	     my_entry->entry_type() == PARFU_FILE_TYPE_DUPLICATE) &&
+	    !(file_checksum->flags & PARFU_SLICE_SOURCE_UNREADABLE)){
+      // a hard link or duplicate: its source file against the data
+      // of the regular file it comes down to
+      Parfu_storage_entry *original = nullptr;
+      string original_path = my_entry->symlink_target;
+      for(unsigned long hops=0; hops<=link_targets.size(); hops++){
+	auto regular_iter = regular_files.find(original_path);
+	if(regular_iter != regular_files.end()){
+	  original = regular_iter->second;
+	  break;
+	}
+	auto link_iter = link_targets.find(original_path);
+	if(link_iter == link_targets.end()){
+	  break;
+	}
+	original_path = link_iter->second;
+      }
+      if(original == nullptr){
+	problems.push_back("catalog has no file "+my_entry->symlink_target+" to compare with");
+      }
+      else if(file_checksum->covered != ((uint64_t)(original->file_size))){
+	problems.push_back("source file is "+to_string(file_checksum->covered)+
+			   " bytes, "+original->get_relative_path()+" is "+
+			   to_string(original->file_size));
+      }
+      else if(original->has_checksum()){
+	n_against_catalog++;
+	if(file_checksum->checksum != original->checksum()){
+	  problems.push_back("source file CRC32C is "+
+			     parfu_checksum_hex(file_checksum->checksum)+", catalog says "+
+			     parfu_checksum_hex(original->checksum())+" for "+
+			     original->get_relative_path());
+	}
+      }
+    }
+    if(problems.size()){
+      cout << "MISMATCH " << my_entry->get_relative_path() << ":";
+      for(unsigned i=0; i<problems.size(); i++){
+	cout << (i ? "; " : " ") << problems.at(i);
+      }
+      cout << "\n";
+      n_bad++;
+    }
+  }
+  // files with data that nobody reported on at all
+  for(auto location_iter = data_locations.begin();
+      location_iter != data_locations.end(); location_iter++){
+    if(location_iter->second->entry_type() == PARFU_FILE_TYPE_REGULAR &&
+       location_iter->second->file_size &&
+       !seen_locations.count(location_iter->first)){
+      cout << "MISMATCH " << location_iter->second->get_relative_path();
+      cout << ": never checked\n";
+      n_bad++;
+    }
+  }
+  cout << "checked " << seen_locations.size() << " files, ";
+  cout << n_against_catalog << " against the catalog CRC32C.\n";
+  return n_bad;
+}
@@ -0,0 +1,355 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  University of Illinois/NCSA Open Source License
+//  http://otm.illinois.edu/disclose-protect/illinois-open-source-license
+//
+//  Parfu is copyright (c) 2017-2022,
+//  by The Trustees of the University of Illinois.
+//  All rights reserved.
+//
+//  Parfu was developed by:
+//  The University of Illinois
+//  The National Center For Supercomputing Applications (NCSA)
+//  Blue Waters Science and Engineering Applications Support Team (SEAS)
+//  Craig P Steffen <csteffen@ncsa.illinois.edu>
+//  Roland Haas <rhaas@illinois.edu>
+//
+//  https://github.com/ncsa/parfu_archive_tool
+//  http://www.ncsa.illinois.edu/People/csteffen/parfu/
+//
+//  For full licnse text see the LICENSE file provided with the source
+//  distribution.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "parfu_main.hh"
+
+// see parfu_archive_index.hh for the layout
+
+uint64_t parfu_index_hash(const char *path, size_t path_length){
+  uint64_t hash = 14695981039346656037ULL;
+  for(size_t i=0; i<path_length; i++){
+    hash ^= (unsigned char)(path[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static uint64_t parfu_index_n_slots(uint64_t n_entries){
+  uint64_t n_slots = 16;
+  while(n_slots < 2*n_entries){
+    n_slots *= 2;
+  }
+  return n_slots;
+}
+
+static uint64_t parfu_round_up_8(uint64_t size){
+  return (size + 7) & ~((uint64_t)7);
+}
+
+// Size of the index data, which only depends on the paths, so it can
+// be worked out before any offsets are set.
+unsigned long Parfu_target_collection::archive_index_size(void){
+  uint64_t paths_size = 0;
+  for(unsigned long ndx=0; ndx<n_entries(); ndx++){
+    paths_size += entry(ndx)->storage_ptr->relative_path.size() +
+      entry(ndx)->storage_ptr->symlink_target.size();
+  }
+  return sizeof(parfu_index_header_t) +
+    n_entries()*sizeof(parfu_index_entry_t) +
+    parfu_index_n_slots(n_entries())*sizeof(uint64_t) +
+    parfu_round_up_8(paths_size);
+}
+
+// The index data itself.  Only valid after set_offsets().
+string Parfu_target_collection::archive_index(void){
+  string out_string;
+  vector <string> entry_paths;
+  vector <unsigned long> sorted_entries;
+  parfu_index_header_t *header;
+  parfu_index_entry_t *index_entry;
+  uint64_t *slots;
+  char *paths;
+  uint64_t path_position=0;
+
+  entry_paths.reserve(n_entries());
+  sorted_entries.reserve(n_entries());
+  for(unsigned long ndx=0; ndx<n_entries(); ndx++){
+    entry_paths.push_back(entry(ndx)->storage_ptr->relative_path);
+    sorted_entries.push_back(ndx);
+  }
+  sort(sorted_entries.begin(),sorted_entries.end(),
+       [&entry_paths](unsigned long a, unsigned long b){
+	 return entry_paths[a] < entry_paths[b];
+       });
+
+  out_string.assign(archive_index_size(),'\0');
+  header = (parfu_index_header_t*)(&(out_string[0]));
+  memcpy(header->magic,PARFU_INDEX_MAGIC,PARFU_INDEX_MAGIC_SIZE);
+  header->n_entries = n_entries();
+  header->n_slots = parfu_index_n_slots(n_entries());
+  header->entries_offset = sizeof(parfu_index_header_t);
+  header->slots_offset = header->entries_offset +
+    header->n_entries*sizeof(parfu_index_entry_t);
+  header->paths_offset = header->slots_offset +
+    header->n_slots*sizeof(uint64_t);
+  header->paths_size = out_string.size() - header->paths_offset;
+  index_entry = (parfu_index_entry_t*)(&(out_string[header->entries_offset]));
+  slots = (uint64_t*)(&(out_string[header->slots_offset]));
+  paths = &(out_string[header->paths_offset]);
+
+  for(unsigned long i=0; i<sorted_entries.size(); i++){
+    Parfu_storage_reference *my_ref = entry(sorted_entries[i]);
+    Parfu_storage_entry *my_entry = my_ref->storage_ptr;
+    const string &my_path = entry_paths[sorted_entries[i]];
+    uint64_t slot;
+
+    index_entry[i].path_offset = path_position;
+    index_entry[i].path_length = my_path.size();
+    memcpy(paths+path_position,my_path.data(),my_path.size());
+    path_position += my_path.size();
+    index_entry[i].target_offset = path_position;
+    index_entry[i].target_length = my_entry->symlink_target.size();
+    memcpy(paths+path_position,my_entry->symlink_target.data(),
+	   my_entry->symlink_target.size());
+    path_position += my_entry->symlink_target.size();
+    index_entry[i].has_checksum = my_entry->has_checksum();
+    index_entry[i].checksum = my_entry->has_checksum() ? my_entry->checksum() : 0;
+    index_entry[i].location = 0;
+    if(my_ref->slices.size() &&
+       my_ref->slices.front().offset_in_container() !=
+       ((unsigned long)PARFU_OFFSET_INVALID)){
+      index_entry[i].location = my_ref->slices.front().offset_in_container();
+    }
+    index_entry[i].header_size = my_entry->header_size();
+    switch(my_entry->entry_type()){
+    case PARFU_FILE_TYPE_REGULAR:
+      index_entry[i].entry_type = PARFU_FILE_TYPE_REGULAR_CHAR;
+      index_entry[i].file_size = my_entry->file_size;
+      break;
+    case PARFU_FILE_TYPE_DIRECTORY:
+      index_entry[i].entry_type = PARFU_FILE_TYPE_DIRECTORY_CHAR;
+      index_entry[i].file_size = 0;
+      break;
+    case PARFU_FILE_TYPE_SYMLINK:
+      index_entry[i].entry_type = PARFU_FILE_TYPE_SYMLINK_CHAR;
+      index_entry[i].file_size = 0;
+      break;
+    case PARFU_FILE_TYPE_HARDLINK:
+      index_entry[i].entry_type = PARFU_FILE_TYPE_HARDLINK_CHAR;
+      index_entry[i].file_size = 0;
+      break;
+    case PARFU_FILE_TYPE_DUPLICATE:
+      index_entry[i].entry_type = PARFU_FILE_TYPE_DUPLICATE_CHAR;
+      index_entry[i].file_size = 0;
+      break;
+    default:
+      index_entry[i].entry_type = PARFU_FILE_TYPE_INVALID_CHAR;
+      index_entry[i].file_size = 0;
+    }
+    slot = parfu_index_hash(my_path.data(),my_path.size()) & (header->n_slots-1);
+    while(slots[slot]){
+      slot = (slot+1) & (header->n_slots-1);
+    }
+    slots[slot] = i+1;
+  }
+  return out_string;
+}
+
+Parfu_archive_index::Parfu_archive_index(string archive_file_name){
+  char header_block[BLOCKSIZE];
+  char size_field[13];
+  unsigned long member_location;
+  unsigned long member_size;
+  unsigned long data_location;
+  long page_size = sysconf(_SC_PAGESIZE);
+  unsigned long map_start;
+  int archive_fd;
+  const parfu_index_header_t *my_header;
+
+  if((archive_fd=open(archive_file_name.c_str(),O_RDONLY))<0){
+    return;
+  }
+  // skip over the catalog member to the one after it
+  member_location = 0;
+  for(int member=0; member<2; member++){
+    if(pread(archive_fd,header_block,BLOCKSIZE,member_location) != BLOCKSIZE ||
+       strncmp(header_block,
+	       member ? PARFU_INDEX_ENTRY_NAME : PARFU_CATALOG_ENTRY_NAME,
+	       100)){
+      close(archive_fd);
+      return;
+    }
+    memcpy(size_field,header_block+124,12);
+    size_field[12]='\0';
+    member_size = strtoul(size_field,nullptr,8);
+    data_location = member_location +
+      tarentry::compute_hdr_size(member ? PARFU_INDEX_ENTRY_NAME : PARFU_CATALOG_ENTRY_NAME,
+				 "",member_size);
+    if(!member){
+      member_location = parfu_next_block_boundary(data_location+member_size);
+    }
+  }
+  if(member_size < sizeof(parfu_index_header_t)){
+    close(archive_fd);
+    return;
+  }
+
+  // mmap() offsets have to be page aligned
+  map_start = data_location - (data_location % page_size);
+  map_length = member_size + (data_location - map_start);
+  map_base = mmap(nullptr,map_length,PROT_READ,MAP_SHARED,archive_fd,map_start);
+  close(archive_fd);
+  if(map_base == MAP_FAILED){
+    cerr << "Parfu_archive_index: mmap of index failed: " << strerror(errno) << "\n";
+    map_base = nullptr;
+    return;
+  }
+  my_header = (const parfu_index_header_t*)(((char*)map_base) + (data_location - map_start));
+  // Every table has to be inside the member (written so nothing can
+  // overflow), and there has to be an empty slot for a lookup to stop at.
+  if(memcmp(my_header->magic,PARFU_INDEX_MAGIC,PARFU_INDEX_MAGIC_SIZE) ||
+     my_header->n_slots == 0 ||
+     my_header->n_slots & (my_header->n_slots-1) ||
+     my_header->n_slots <= my_header->n_entries ||
+     my_header->entries_offset % 8 || my_header->slots_offset % 8 ||
+     my_header->entries_offset > member_size ||
+     my_header->n_entries > (member_size - my_header->entries_offset)/sizeof(parfu_index_entry_t) ||
+     my_header->slots_offset > member_size ||
+     my_header->n_slots > (member_size - my_header->slots_offset)/sizeof(uint64_t) ||
+     my_header->paths_offset > member_size ||
+     my_header->paths_size > member_size - my_header->paths_offset){
+    cerr << "Parfu_archive_index: index in " << archive_file_name << " is not usable.\n";
+    return;
+  }
+  entries = (const parfu_index_entry_t*)(((const char*)my_header) + my_header->entries_offset);
+  slots = (const uint64_t*)(((const char*)my_header) + my_header->slots_offset);
+  paths = ((const char*)my_header) + my_header->paths_offset;
+  index_header = my_header;
+}
+
+Parfu_archive_index::~Parfu_archive_index(void){
+  if(map_base != nullptr){
+    munmap(map_base,map_length);
+  }
+}
+
+const parfu_index_entry_t *Parfu_archive_index::find(const string &path){
+  uint64_t slot;
+  const parfu_index_entry_t *candidate;
+
+  if(!is_valid()){
+    return nullptr;
+  }
+  slot = parfu_index_hash(path.data(),path.size()) & (index_header->n_slots-1);
+  while(slots[slot]){
+    if(slots[slot] > index_header->n_entries){
+      return nullptr;
+    }
+    candidate = entries + (slots[slot]-1);
+    if(candidate->path_length == path.size() &&
+       string_in_bounds(candidate->path_offset,candidate->path_length) &&
+       !memcmp(paths+candidate->path_offset,path.data(),path.size())){
+      return candidate;
+    }
+    slot = (slot+1) & (index_header->n_slots-1);
+  }
+  return nullptr;
+}
+
+unsigned long Parfu_archive_index::lower_bound(const string &path){
+  unsigned long low=0,high=n_entries(),middle;
+
+  while(low < high){
+    middle = low + (high-low)/2;
+    if(this->path(entry(middle)) < path){
+      low = middle+1;
+    }
+    else{
+      high = middle;
+    }
+  }
+  return low;
+}
+
+string Parfu_archive_index::catalog_line(const parfu_index_entry_t *index_entry){
+  char checksum_string[PARFU_CATALOG_CHECKSUM_DIGITS+1];
+  string out_string;
+
+  out_string.append(path(index_entry));
+  out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  out_string += index_entry->entry_type;
+  out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  out_string.append(target(index_entry));
+  out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  out_string.append(to_string(index_entry->file_size));
+  out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  out_string.append(to_string(index_entry->header_size));
+  out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  if(index_entry->has_checksum){
+    snprintf(checksum_string,sizeof(checksum_string),"%0*x",
+	     PARFU_CATALOG_CHECKSUM_DIGITS,index_entry->checksum);
+    out_string.append(checksum_string);
+  }
+  else{
+    out_string.append(PARFU_CATALOG_CHECKSUM_DIGITS,PARFU_CATALOG_NO_CHECKSUM_CHAR);
+  }
+  out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  out_string.append(to_string(index_entry->location));
+  return out_string;
+}
+
+// A pattern picks out its own path and everything under it (see
+// parfu_path_selected()).  Whatever the hard links and duplicates
+// among those refer to comes along too, for select_entries() to
+// sort out.
+Parfu_target_collection::Parfu_target_collection(Parfu_archive_index *archive_index,
+						 const vector <string> &patterns){
+  set <unsigned long> wanted;
+  vector <unsigned long> links;
+  vector <const parfu_index_entry_t*> found;
+  const parfu_index_entry_t *index_entry;
+
+  for(unsigned i=0; i<patterns.size(); i++){
+    string pattern = patterns.at(i);
+    while(pattern.size() > 1 && pattern.back() == '/'){
+      pattern.pop_back();
+    }
+    if((index_entry=archive_index->find(pattern)) != nullptr){
+      wanted.insert(index_entry - archive_index->entry(0));
+    }
+    pattern += "/";
+    for(unsigned long ndx=archive_index->lower_bound(pattern);
+	ndx < archive_index->n_entries() &&
+	  archive_index->path(archive_index->entry(ndx)).compare(0,pattern.size(),pattern) == 0;
+	ndx++){
+      wanted.insert(ndx);
+    }
+  }
+  for(auto wanted_iter=wanted.begin(); wanted_iter!=wanted.end(); wanted_iter++){
+    links.push_back(*wanted_iter);
+  }
+  for(unsigned long i=0; i<links.size(); i++){
+    index_entry = archive_index->entry(links.at(i));
+    if(index_entry->entry_type != PARFU_FILE_TYPE_HARDLINK_CHAR &&
+       index_entry->entry_type != PARFU_FILE_TYPE_DUPLICATE_CHAR){
+      continue;
+    }
+    if((index_entry=archive_index->find(archive_index->target(index_entry))) != nullptr &&
+       wanted.insert(index_entry - archive_index->entry(0)).second){
+      links.push_back(index_entry - archive_index->entry(0));
+    }
+  }
+  // in archive order, as in the catalog
+  for(auto wanted_iter=wanted.begin(); wanted_iter!=wanted.end(); wanted_iter++){
+    found.push_back(archive_index->entry(*wanted_iter));
+  }
+  sort(found.begin(),found.end(),
+       [](const parfu_index_entry_t *a, const parfu_index_entry_t *b){
+	 return a->location < b->location;
+       });
+  for(unsigned long i=0; i<found.size(); i++){
+    add_catalog_line(archive_index->catalog_line(found.at(i)));
+  }
+  select_entries(patterns);
+}
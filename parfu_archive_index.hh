@@ -0,0 +1,147 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  University of Illinois/NCSA Open Source License
+//  http://otm.illinois.edu/disclose-protect/illinois-open-source-license
+//
+//  Parfu is copyright (c) 2017-2022,
+//  by The Trustees of the University of Illinois.
+//  All rights reserved.
+//
+//  Parfu was developed by:
+//  The University of Illinois
+//  The National Center For Supercomputing Applications (NCSA)
+//  Blue Waters Science and Engineering Applications Support Team (SEAS)
+//  Craig P Steffen <csteffen@ncsa.illinois.edu>
+//  Roland Haas <rhaas@illinois.edu>
+//
+//  https://github.com/ncsa/parfu_archive_tool
+//  http://www.ncsa.illinois.edu/People/csteffen/parfu/
+//
+//  For full licnse text see the LICENSE file provided with the source
+//  distribution.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef PARFU_ARCHIVE_INDEX_HH_
+#define PARFU_ARCHIVE_INDEX_HH_
+
+#include "parfu_main.hh"
+
+////////////////
+//
+// The binary archive index.
+//
+// The ASCII catalog has to be parsed from the top to find anything in
+// it.  The index is the same information laid out so that it can be
+// used straight out of mmap(): a table of entries sorted by path, an
+// open-addressing hash table of path to entry, and the path (and
+// link target) strings themselves.  It's stored as a second tar member
+// (PARFU_INDEX_ENTRY_NAME) right after the catalog, so plain tar just
+// extracts it as a file.  All the numbers are in the byte order of
+// the machine that wrote the archive; a reader that finds the magic
+// doesn't match just doesn't use the index.
+//
+// Layout, all offsets from the start of the index data:
+//   parfu_index_header_t
+//   parfu_index_entry_t[n_entries]   sorted by path (memcmp order)
+//   uint64_t[n_slots]                hash slots; entry number+1, 0=empty
+//   strings, back to back, not NUL terminated: each entry's path,
+//   then its target
+
+#define PARFU_INDEX_ENTRY_NAME          ".parfu_index"
+#define PARFU_INDEX_MAGIC               "PFUIDX02"
+#define PARFU_INDEX_MAGIC_SIZE          (8)
+
+typedef struct{
+  char magic[PARFU_INDEX_MAGIC_SIZE];
+  uint64_t n_entries;
+  // always a power of 2, at least twice n_entries
+  uint64_t n_slots;
+  uint64_t entries_offset;
+  uint64_t slots_offset;
+  uint64_t paths_offset;
+  uint64_t paths_size;
+  uint64_t reserved;
+}parfu_index_header_t;
+
+typedef struct{
+  uint64_t path_offset;   // from paths_offset
+  // where the entry's tar header starts in the archive
+  uint64_t location;
+  uint64_t file_size;
+  // the catalog's TGT: a symlink's target, or the path a hard link
+  // or duplicate refers to.  From paths_offset.
+  uint64_t target_offset;
+  uint32_t path_length;
+  uint32_t target_length;
+  uint32_t header_size;
+  // payload CRC32C, if has_checksum
+  uint32_t checksum;
+  // PARFU_FILE_TYPE_*_CHAR
+  char entry_type;
+  char has_checksum;
+  char padding[6];
+}parfu_index_entry_t;
+
+// the hash used for the slot table (64-bit FNV-1a)
+uint64_t parfu_index_hash(const char *path, size_t path_length);
+
+// Looks things up in the index of an existing archive.  The index is
+// mmap()ed read-only, so a lookup only touches the pages it needs.
+class Parfu_archive_index
+{
+public:
+  Parfu_archive_index(string archive_file_name);
+  ~Parfu_archive_index(void);
+  // false if the archive has no (usable) index
+  bool is_valid(void){
+    return index_header != nullptr;
+  }
+  unsigned long n_entries(void){
+    if(!is_valid()){
+      return 0;
+    }
+    return index_header->n_entries;
+  }
+  // nullptr if the path isn't in the archive
+  const parfu_index_entry_t *find(const string &path);
+  // the number of the first entry in path order whose path isn't
+  // before this one (n_entries() if there's none), so everything
+  // under a directory can be found from "dir/"
+  unsigned long lower_bound(const string &path);
+  // the nth entry in path order
+  const parfu_index_entry_t *entry(unsigned long entry_index){
+    return entries+entry_index;
+  }
+  string path(const parfu_index_entry_t *index_entry){
+    return index_string(index_entry->path_offset,index_entry->path_length);
+  }
+  string target(const parfu_index_entry_t *index_entry){
+    return index_string(index_entry->target_offset,index_entry->target_length);
+  }
+  // the entry as a line of the ASCII catalog, for
+  // Parfu_target_collection
+  string catalog_line(const parfu_index_entry_t *index_entry);
+private:
+  // whether a string the index points to is inside the index; the
+  // entries are only checked as they're used, so opening the index
+  // doesn't touch them all
+  bool string_in_bounds(uint64_t offset, uint64_t length){
+    return offset <= index_header->paths_size &&
+      length <= index_header->paths_size - offset;
+  }
+  string index_string(uint64_t offset, uint64_t length){
+    if(!string_in_bounds(offset,length)){
+      return string("");
+    }
+    return string(paths+offset,length);
+  }
+  void *map_base=nullptr;
+  size_t map_length=0;
+  const parfu_index_header_t *index_header=nullptr;
+  const parfu_index_entry_t *entries=nullptr;
+  const uint64_t *slots=nullptr;
+  const char *paths=nullptr;
+};
+
+#endif // #ifndef PARFU_ARCHIVE_INDEX_HH_
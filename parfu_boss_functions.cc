@@ -24,6 +24,21 @@
 
 #include "parfu_main.hh"
 
+int parfu_broadcast_bytes(void *buffer, unsigned long length){
+  int mpi_return_val=MPI_SUCCESS;
+  unsigned long chunk;
+
+  // an MPI count is an int, and whole plans can be bigger than that
+  for(unsigned long done=0; done<length; done+=chunk){
+    chunk = min(length-done,(unsigned long)INT_MAX);
+    if((mpi_return_val=MPI_Bcast(((char*)buffer)+done,chunk,MPI_CHAR,
+				 0,MPI_COMM_WORLD)) != MPI_SUCCESS){
+      break;
+    }
+  }
+  return mpi_return_val;
+}
+
 // rank 0 sending instruction messages to all other ranks
 int parfu_broadcast_order(string instruction,
 			  string message){
@@ -32,12 +47,10 @@ int parfu_broadcast_order(string instruction,
 
   // instruction is a string with a single letter
   // message is the bulk of the message.
-  int *message_length=nullptr;
+  unsigned long message_length;
   //  char *message_buffer=nullptr;
   int mpi_return_val;
   
-  message_length = new int;
-
   string message_contents = string("");
   message_contents.append(instruction);
   message_contents.append(message);
@@ -45,12 +58,12 @@ int parfu_broadcast_order(string instruction,
   // using C string functions to parse these messages, but we might, and this
   // allows the null to be transmitted and allows this buffer to be safe for
   // those functions (I think) in case we change our mind.  
-  *message_length = message_contents.size()+1;
-  mpi_return_val = MPI_Bcast(message_length,1,MPI_INT,0,MPI_COMM_WORLD);
-  mpi_return_val += MPI_Bcast(((void*)(message_contents.data())),
-			      message_contents.size()+1,
-			      MPI_CHAR,0,MPI_COMM_WORLD);
-  delete message_length;
+  // The length is 64 bits, since the work plans (see "W", "M" and "H"
+  // in parfu_worker_node.cc) for a big tree can pass 2 GiB.
+  message_length = message_contents.size()+1;
+  mpi_return_val = MPI_Bcast(&message_length,1,MPI_UNSIGNED_LONG,0,MPI_COMM_WORLD);
+  mpi_return_val += parfu_broadcast_bytes(((void*)(message_contents.data())),
+					  message_length);
   return mpi_return_val;
 }
 
@@ -86,117 +99,727 @@ int parfu_send_order_to_rank(int dest_rank,
 
 }
 
+// Non-blocking version of parfu_send_order_to_rank().  The message
+// is copied into a new entry on pending_sends, which has to stay
+// there until both of its MPI_Isend()s have completed (see
+// parfu_reap_order_sends()).  
+int parfu_isend_order_to_rank(int dest_rank,
+			      int tag,
+			      string instruction,
+			      string &message,
+			      list <parfu_pending_order_t> *pending_sends){
+  parfu_pending_order_t *pending;
+  int mpi_return_val;
+  
+  pending_sends->emplace_back();
+  pending = &(pending_sends->back());
+  pending->message_contents.reserve(instruction.size()+message.size());
+  pending->message_contents.append(instruction);
+  pending->message_contents.append(message);
+  // +1 for the null, the same as parfu_send_order_to_rank()
+  pending->message_length = pending->message_contents.size()+1;
+  mpi_return_val = MPI_Isend(&(pending->message_length),1,MPI_INT,
+			     dest_rank,tag,MPI_COMM_WORLD,
+			     &(pending->requests[0]));
+  mpi_return_val += MPI_Isend(((void*)(pending->message_contents.data())),
+			      pending->message_length,
+			      MPI_CHAR,dest_rank,tag,MPI_COMM_WORLD,
+			      &(pending->requests[1]));
+  return mpi_return_val;
+}
+
+// drop the order messages that have finished sending.  If wait_for_all
+// is set, block until every one of them has.
+void parfu_reap_order_sends(list <parfu_pending_order_t> *pending_sends,
+			    bool wait_for_all){
+  int sends_done;
+  auto pending = pending_sends->begin();
+  while(pending != pending_sends->end()){
+    if(wait_for_all){
+      MPI_Waitall(2,pending->requests,MPI_STATUSES_IGNORE);
+      sends_done=1;
+    }
+    else{
+      MPI_Testall(2,pending->requests,&sends_done,MPI_STATUSES_IGNORE);
+    }
+    if(sends_done){
+      pending = pending_sends->erase(pending);
+    }
+    else{
+      pending++;
+    }
+  }
+}
+
 #define INT_STRING_BUFFER_SIZE (20)
 
+// Hand out all the order sets, with the given instruction letter
+// ("C" to create, "E" to extract, "V" to verify).  Each worker is kept
+// with up to queue_depth orders outstanding, so that when it finishes
+// one it already has the next one in hand.  Orders go out with
+// MPI_Isend(), each worker has one MPI_Irecv() posted for its next
+// "done" reply, and we sit in MPI_Waitany() on those, topping up
+// whichever worker answered.
+//
+// If boss_pipeline isn't null, rank 0 moves data too.  Whenever no
+// worker has a reply waiting (so they all have full queues) we do
+// the next order ourselves through boss_pipeline, then check on the
+// workers again.  With no workers at all, rank 0 does everything.
+// Either way the caller has to drain boss_pipeline afterwards.  
 int push_out_all_orders(vector <string> *transfer_order_list,
-			unsigned int total_ranks){
+			unsigned int total_ranks,
+			unsigned int queue_depth,
+			Parfu_create_pipeline *boss_pipeline,
+			string base_path,
+			MPI_File *archive_file_handle,
+			string instruction){
   unsigned int next_order=0;
-  unsigned int next_rank=1;
+  unsigned int orders_done=0;
   unsigned int total_orders = transfer_order_list->size();
-  char *return_receive_buffer=nullptr;
-  string return_receive_string;
+  // indexed by rank, so element 0 (us) is never used
+  vector <MPI_Request> reply_requests(total_ranks,MPI_REQUEST_NULL);
+  vector <unsigned> orders_outstanding(total_ranks,0);
+  vector <char> reply_buffers(total_ranks*INT_STRING_BUFFER_SIZE);
+  list <parfu_pending_order_t> pending_sends;
+  int replying_rank;
+  int reply_ready;
+  unsigned int boss_orders=0;
   int mpi_return_val;
-  //  MPI_Status message_status;
-  int worker_rank_received;
-  
-  // I assume any rank number printed to a string
-  // will fit within INT_STRING_BUFFER_SIZE characters
-  return_receive_buffer=(char*)malloc(INT_STRING_BUFFER_SIZE);
+
+  if(total_ranks < 2 && boss_pipeline == nullptr){
+    cerr << "push_out_all_orders: there are no worker ranks to send orders to!\n";
+    return -1;
+  }
+  if(queue_depth < 1){
+    queue_depth = 1;
+  }
   
-  // First we distribute initial orders to ranks.
-  // We start at order index 0 but at rank 1, because
+  cerr << "POAO: A ranks:" << total_ranks << " orders:" << total_orders;
+  cerr << " queue depth:" << queue_depth << "\n";
+
+  // First fill every worker's queue.  We go around the ranks once
+  // per queue slot, so if there are few orders they still get spread
+  // over as many ranks as possible.  We start at rank 1, because
   // *we* are rank zero.  
-  cerr << "POAO: A ranks:" << total_ranks << " orders:" << total_orders << "\n";
-  //  cerr << "POAO: A next
-  while( (next_rank < total_ranks) &&
-	 (next_order < total_orders)){
-    cerr << "POAO ph1: send order " << next_order << "\n";
-    parfu_send_order_to_rank(next_rank,
-			     0,  // MPI_Send tag=0
-			     string("C"), // C for "create" mode
-			     (transfer_order_list->at(next_order)));
-    //    cerr << "debugL1: sending order " << next_order << "\n";
-    // update loop
-    next_order++;
-    next_rank++;
-  }
-  // we've distributed order sets to ranks until we ran out of
-  // one of them.  We need to now deal with our status depending
-  // on whether we've run out of ranks, run out of order sets,
-  // or neither.
-
-  // If all the orders have been sent, then we don't need to
-  // worry about sending any more, we just need to wait for
-  // the returns from each of the order sets, then exit.
-
-  // this should work whether or not the ranks have been exhausted
-  // Because we're only doing as many receives as orders, so the
-  // ranks that never received any orders won't be sending us
-  // a complete message.  
-  cerr << "POAO next order:" << next_order << "  next rank:" << next_rank << "\n";
-
-  if(next_order >= total_orders){
-    cerr << "POAO: sent all orders, so wait for finished responses; next order:" << next_order <<"  \n";
-    for(unsigned i=0;i<total_orders;i++){
-      if((mpi_return_val = MPI_Recv((void*)(return_receive_buffer),
-				    INT_STRING_BUFFER_SIZE,MPI_CHAR,
-				    MPI_ANY_SOURCE,MPI_ANY_TAG,MPI_COMM_WORLD,
-				    MPI_STATUS_IGNORE))!=MPI_SUCCESS){
-	cerr << "push_out_all_orders:  MPI_Recv returned " << mpi_return_val << "!\n";
+  for(unsigned slot=0; slot<queue_depth; slot++){
+    for(unsigned rank=1; rank<total_ranks && next_order<total_orders; rank++){
+      parfu_isend_order_to_rank(rank,
+				0,  // MPI_Send tag=0
+				instruction,
+				transfer_order_list->at(next_order),
+				&pending_sends);
+      orders_outstanding.at(rank)++;
+      next_order++;
+    }
+  }
+  for(unsigned rank=1; rank<total_ranks; rank++){
+    if(orders_outstanding.at(rank)){
+      MPI_Irecv(&(reply_buffers.at(rank*INT_STRING_BUFFER_SIZE)),
+		INT_STRING_BUFFER_SIZE,MPI_CHAR,
+		rank,MPI_ANY_TAG,MPI_COMM_WORLD,
+		&(reply_requests.at(rank)));
+    }
+  }
+  cerr << "POAO next order:" << next_order << "\n";
+
+  // Now each "done" reply frees up a slot in that worker's queue,
+  // which gets the next order if there are any left.  
+  while(orders_done < total_orders){
+    if(boss_pipeline != nullptr && next_order < total_orders){
+      // see if anybody needs topping up, but don't wait on them
+      if((mpi_return_val = MPI_Testany(total_ranks,reply_requests.data(),
+				       &replying_rank,&reply_ready,
+				       MPI_STATUS_IGNORE))!=MPI_SUCCESS){
+	cerr << "push_out_all_orders:  MPI_Testany returned " << mpi_return_val << "!\n";
+	break;
       }
-      //      cerr << "individual RX: got buffer.\n";
-    } // for(unsigned i=0;i<total_orders;i++){
-  } // if(next_order >= total_orders){
-  else{
-    // in this case, we have orders left, which means that every single
-    // worker rank got orders.  So starting here, all worker ranks are busy,
-    // and we have leftover order sets to hand out.  
-
-    // As the busy worker ranks finish and send back that they're done, we
-    // hand each one that does that a new work item while we still have
-    // any 
-    while(next_order < total_orders){
-      cerr << "POAO: next order:" << next_order << "out of total:" << total_orders << "\n";
-      if((mpi_return_val = MPI_Recv((void*)(return_receive_buffer),
-				    INT_STRING_BUFFER_SIZE,MPI_CHAR,
-				    MPI_ANY_SOURCE,MPI_ANY_TAG,MPI_COMM_WORLD,
-				    MPI_STATUS_IGNORE))!=MPI_SUCCESS){
-	cerr << "push_out_all_orders:  MPI_Recv returned " << mpi_return_val << "!\n";
+      if(!reply_ready || replying_rank == MPI_UNDEFINED){
+	if(instruction == "V"){
+	  mpi_return_val =
+	    boss_pipeline->verify_order_sets(transfer_order_list->at(next_order).data(),
+					     transfer_order_list->at(next_order).size(),
+					     base_path,
+					     archive_file_handle);
+	}
+	else if(instruction == "E"){
+	  mpi_return_val =
+	    boss_pipeline->extract_order_sets(transfer_order_list->at(next_order).data(),
+					      transfer_order_list->at(next_order).size(),
+					      base_path,
+					      archive_file_handle);
+	}
+	else{
+	  mpi_return_val =
+	    boss_pipeline->submit_order_sets(transfer_order_list->at(next_order).data(),
+					     transfer_order_list->at(next_order).size(),
+					     base_path,
+					     archive_file_handle);
+	}
+	if(mpi_return_val < 0){
+	  cerr << "push_out_all_orders:  order " << next_order << " is not a valid order set!\n";
+	}
+	next_order++;
+	orders_done++;
+	boss_orders++;
+	continue;
       }
-      //      cerr << "debugL1: sending order " << next_order << "\n";
-      return_receive_string=string(return_receive_buffer);
-      //      cerr << "debug: indicated rank:" << return_receive_string << "\n";
-      worker_rank_received=stoi(return_receive_string);
-      parfu_send_order_to_rank(worker_rank_received,
-			       0,
-			       string("C"), // this has the "create" message baked in
-			       // we may want to make this an input parameter
-			       (transfer_order_list->at(next_order)));
-      cerr << "POAO: sent order " << next_order << " to rank " << worker_rank_received << "\n";
-      // loop cleanup
+    }
+    else if((mpi_return_val = MPI_Waitany(total_ranks,reply_requests.data(),
+					  &replying_rank,MPI_STATUS_IGNORE))!=MPI_SUCCESS){
+      cerr << "push_out_all_orders:  MPI_Waitany returned " << mpi_return_val << "!\n";
+      break;
+    }
+    if(replying_rank == MPI_UNDEFINED){
+      cerr << "push_out_all_orders:  no replies outstanding but only ";
+      cerr << orders_done << " of " << total_orders << " orders done!\n";
+      break;
+    }
+    orders_done++;
+    orders_outstanding.at(replying_rank)--;
+    if(next_order < total_orders){
+      parfu_isend_order_to_rank(replying_rank,
+				0,
+				instruction,
+				transfer_order_list->at(next_order),
+				&pending_sends);
+      cerr << "POAO: sent order " << next_order << " to rank " << replying_rank << "\n";
+      orders_outstanding.at(replying_rank)++;
       next_order++;
-    } // while
-    
-    // at this point, all work items have been distributed.  So we just need
-    // to wait for them all to report that they're finished
+    }
+    if(orders_outstanding.at(replying_rank)){
+      MPI_Irecv(&(reply_buffers.at(replying_rank*INT_STRING_BUFFER_SIZE)),
+		INT_STRING_BUFFER_SIZE,MPI_CHAR,
+		replying_rank,MPI_ANY_TAG,MPI_COMM_WORLD,
+		&(reply_requests.at(replying_rank)));
+    }
+    parfu_reap_order_sends(&pending_sends,false);
+  } // while(orders_done < total_orders)
+  
+  parfu_reap_order_sends(&pending_sends,true);
+  if(boss_pipeline != nullptr){
+    cerr << "POAO: rank 0 did " << boss_orders << " of " << total_orders << " orders itself\n";
+  }
+  return 0;
+}
+
+// Bundle consecutive order sets together so that each "C" message
+// hands a worker sets_per_message buckets at once, which keeps the
+// worker's create pipeline full.  The encoded order sets carry their
+// own lengths, so they just go back to back.  Returns a new list.
+vector <string> *parfu_bundle_transfer_orders(vector <string> *transfer_order_list,
+					      unsigned int sets_per_message){
+  vector <string> *bundled_orders = new vector <string>;
+  if(sets_per_message < 1){
+    sets_per_message = 1;
+  }
+  for(unsigned i=0; i<transfer_order_list->size(); i++){
+    if(!(i % sets_per_message)){
+      bundled_orders->push_back(string(""));
+    }
+    bundled_orders->back().append(transfer_order_list->at(i));
+  }
+  return bundled_orders;
+}
+
+// receive a variable-length reply (length first, then the buffer, the
+// same way orders go out) from whichever worker rank sends one first.
+// The rank of the sender is put in *source_rank.
+string parfu_receive_reply_from_worker(int *source_rank){
+  int message_length;
+  char *message_buffer=nullptr;
+  int mpi_return_val;
+  MPI_Status message_status;
+  string out_string;
+  
+  if((mpi_return_val = MPI_Recv((void*)(&message_length),1,MPI_INT,
+				MPI_ANY_SOURCE,MPI_ANY_TAG,MPI_COMM_WORLD,
+				&message_status))!=MPI_SUCCESS){
+    cerr << "parfu_receive_reply_from_worker:  MPI_Recv returned " << mpi_return_val << "!\n";
+  }
+  *source_rank = message_status.MPI_SOURCE;
+  message_buffer = (char*)malloc(message_length);
+  // the buffer has to come from the same rank that sent us the length
+  if((mpi_return_val = MPI_Recv((void*)(message_buffer),message_length,MPI_CHAR,
+				*source_rank,message_status.MPI_TAG,MPI_COMM_WORLD,
+				MPI_STATUS_IGNORE))!=MPI_SUCCESS){
+    cerr << "parfu_receive_reply_from_worker:  MPI_Recv returned " << mpi_return_val << "!\n";
+  }
+  out_string = string(message_buffer);
+  free(message_buffer);
+  return out_string;
+}
+
+// Distributed version of Parfu_directory::spider_directory().  Rank 0
+// keeps a queue of directories that still need to be read, and hands
+// them out (up to PARFU_SPIDER_MAX_DIRS_PER_ORDER at a time) to idle
+// worker ranks with "S" orders.  Each worker reads its directories one
+// level deep and sends back the entries it found as spider batch lines.
+// Rank 0 hangs those entries off of the right parent directory and
+// queues up any new subdirectories.  When this returns, root_dir is
+// the top of a fully-spidered tree exactly as if spider_directory()
+// had been run on it.
+//
+// The workers must already be in iNdividual receive mode and have
+// their base path set with a "P" order.
+long int parfu_distributed_spider(Parfu_directory *root_dir,
+				  unsigned int total_ranks){
+  list <Parfu_directory*> directory_queue;
+  map <string,Parfu_directory*> directory_by_path;
+  vector <vector <Parfu_directory*>> assigned_directories(total_ranks);
+  vector <int> idle_ranks;
+  unsigned int orders_outstanding=0;
+  long int total_entries_found=0;
+  
+  if(total_ranks < 2){
+    // nobody to hand work to, so do it ourselves
+    return root_dir->spider_directory();
+  }
+  
+  directory_by_path[root_dir->get_relative_path()] = root_dir;
+  directory_queue.push_back(root_dir);
+  for(unsigned int i=total_ranks-1; i>0; i--){
+    idle_ranks.push_back(i);
+  }
+  
+  while(directory_queue.size() > 0 || orders_outstanding > 0){
+    // hand out as much of the queue as we can.  Each idle rank gets
+    // a fair share of what's queued, so that a small queue gets spread
+    // wide and a big queue doesn't cost one message per directory.  
+    while(directory_queue.size() > 0 && idle_ranks.size() > 0){
+      int worker_rank = idle_ranks.back();
+      unsigned int n_dirs;
+      string order_string;
+      idle_ranks.pop_back();
+      n_dirs = 1 + ((directory_queue.size()-1) / (idle_ranks.size()+1));
+      if(n_dirs > PARFU_SPIDER_MAX_DIRS_PER_ORDER){
+	n_dirs = PARFU_SPIDER_MAX_DIRS_PER_ORDER;
+      }
+      for(unsigned int i=0; i<n_dirs; i++){
+	Parfu_directory *next_dir = directory_queue.front();
+	directory_queue.pop_front();
+	assigned_directories.at(worker_rank).push_back(next_dir);
+	order_string.append(next_dir->get_relative_path());
+	order_string += PARFU_LINE_SEPARATOR_CHARACTER;
+      }
+      parfu_send_order_to_rank(worker_rank,0,string("S"),order_string);
+      orders_outstanding++;
+    }
     
-    // [TODO perhaps we should move writing the catalog to here?]
-
-    // VERY IMPORTANT!!!  Index "i" MUST start at 1, NOT ZERO here.  Otherwise,
-    // you end up waiting for one more receive than you're ever going to get
-    // and it deadlocks
-    for(unsigned i=1;i<total_ranks;i++){
-      if((mpi_return_val = MPI_Recv((void*)(return_receive_buffer),
-				    INT_STRING_BUFFER_SIZE,MPI_CHAR,
-				    MPI_ANY_SOURCE,MPI_ANY_TAG,MPI_COMM_WORLD,
-				    MPI_STATUS_IGNORE))!=MPI_SUCCESS){
-	cerr << "push_out_all_orders:  MPI_Recv returned " << mpi_return_val << "!\n";
-      } // if((mpi_return_val...
-      
-    }// for(i=0   
-  } // else 
+    // now wait for some worker to send back its entries
+    int worker_rank;
+    string batch_string;
+    size_t line_begin,line_end;
+    batch_string = parfu_receive_reply_from_worker(&worker_rank);
+    line_begin=0;
+    while((line_end=batch_string.find(PARFU_LINE_SEPARATOR_CHARACTER,line_begin))
+	  != string::npos){
+      string spider_line = batch_string.substr(line_begin,line_end-line_begin);
+      string entry_path =
+	spider_line.substr(0,spider_line.find(PARFU_ENTRY_SEPARATOR_CHARACTER));
+      string parent_path;
+      size_t last_slash = entry_path.rfind('/');
+      if(last_slash != string::npos){
+	parent_path = entry_path.substr(0,last_slash);
+      }
+      auto self_iter = directory_by_path.find(entry_path);
+      auto parent_iter = directory_by_path.find(parent_path);
+      if(self_iter != directory_by_path.end()){
+	// this is the line for a directory we already know about and
+	// just had scanned; it carries that directory's own metadata
+	self_iter->second->set_own_metadata_from_spider_line(spider_line);
+      }
+      else if(parent_iter == directory_by_path.end()){
+	cerr << "parfu_distributed_spider: no parent directory for >" << entry_path << "<!\n";
+      }
+      else{
+	Parfu_directory *new_subdir =
+	  parent_iter->second->add_entry_from_spider_line(spider_line);
+	if(new_subdir != nullptr){
+	  directory_by_path[entry_path] = new_subdir;
+	  directory_queue.push_back(new_subdir);
+	}
+	total_entries_found++;
+      }
+      line_begin = line_end + 1;
+    }
+    for(unsigned int i=0; i<assigned_directories.at(worker_rank).size(); i++){
+      assigned_directories.at(worker_rank).at(i)->set_spidered();
+    }
+    assigned_directories.at(worker_rank).clear();
+    idle_ranks.push_back(worker_rank);
+    orders_outstanding--;
+  }
   
+  cerr << "parfu_distributed_spider: found " << total_entries_found << " entries in ";
+  cerr << directory_by_path.size() << " directories.\n";
+  return total_entries_found;
+}
+
+// Rank 0's first step in extract and verify mode: get the archive's
+// catalog, from the compressed archive's catalog member, the plain
+// catalog member, or (failing both) by having everybody index it as
+// a plain tar file, and apply any selection.  A selection of plain
+// paths, with no glob characters, is looked up in the binary index
+// instead when the archive has one, so the catalog isn't read at
+// all.  On failure, everybody has been told to exit and
+// *error_return says why.
+static Parfu_target_collection *parfu_load_archive_collection(string archive_file_name,
+							      parfu_behavior_settings_t *settings,
+							      unsigned int total_ranks,
+							      int *error_return){
+  string catalog_text;
+  Parfu_target_collection *archive_collec=nullptr;
+  Parfu_archive_index *archive_index=nullptr;
+  vector <parfu_compressed_bucket_t> bucket_table;
+  bool paths_only = (settings->select_patterns.size() > 0);
+
+  for(unsigned i=0; i<settings->select_patterns.size(); i++){
+    if(settings->select_patterns.at(i).find_first_of("*?[") != string::npos){
+      paths_only = false;
+    }
+  }
+
+  if(parfu_read_bucket_table(archive_file_name,&bucket_table)){
+    // a compressed archive; everybody gets the bucket table so they
+    // can find the members their buckets are in
+    string table_bytes = parfu_bucket_table_bytes(&bucket_table);
+    cout << archive_file_name << " is compressed, in " << bucket_table.size() << " members.\n";
+    if((catalog_text=parfu_read_compressed_catalog(archive_file_name,&bucket_table)).size() < 1){
+      cerr << "Could not read the catalog of " << archive_file_name << ".  Exiting.\n";
+      parfu_broadcast_order(string("X"),string("abort"));
+      *error_return = 1;
+      return nullptr;
+    }
+    parfu_broadcast_order(string("Z"),table_bytes);
+    parfu_load_bucket_table(table_bytes.data(),table_bytes.size());
+  }
+  else if(paths_only &&
+	  (archive_index=new Parfu_archive_index(archive_file_name))->is_valid()){
+    cout << "looking up the selection in the index of " << archive_file_name << ".\n";
+    archive_collec = new Parfu_target_collection(archive_index,
+						 settings->select_patterns);
+  }
+  else if((catalog_text=parfu_read_archive_catalog(archive_file_name)).size() < 1){
+    // not a parfu archive (or one from before the catalog); all the
+    // ranks index it as a plain tar file
+    cerr << "Indexing " << archive_file_name << " as a plain tar file.\n";
+    parfu_broadcast_order(string("T"),archive_file_name);
+    if((catalog_text=parfu_index_foreign_tar(archive_file_name,0,total_ranks)).size() < 1){
+      cerr << "Could not index " << archive_file_name << ".  Exiting.\n";
+      delete archive_index;
+      parfu_broadcast_order(string("X"),string("abort"));
+      *error_return = 1;
+      return nullptr;
+    }
+  }
+  delete archive_index;
+  if(archive_collec == nullptr){
+    archive_collec = new Parfu_target_collection(catalog_text);
+    catalog_text.clear();
+    cout << "catalog has " << archive_collec->n_entries() << " entries.\n";
+    if(settings->select_patterns.size()){
+      archive_collec->select_entries(settings->select_patterns);
+    }
+  }
+  if(settings->select_patterns.size()){
+    // only the buckets holding these entries get scheduled, and
+    // only their byte ranges get read
+    if(archive_collec->n_entries() < 1){
+      cerr << "Nothing in " << archive_file_name << " matches the selection.  Exiting.\n";
+      parfu_broadcast_order(string("X"),string("abort"));
+      *error_return = 5;
+      return nullptr;
+    }
+    cout << archive_collec->n_entries() << " entries selected.\n";
+  }
+  return archive_collec;
+}
+
+// Extract mode, from rank 0's side.  The archive's catalog says where
+// everything is, so the same bucket layout the archive was created
+// with is rebuilt from it and handed out as "E" orders; each bucket is
+// then read in one piece by whichever rank gets it.  The workers must
+// be in broadcast mode when this is called, and are shut down at the
+// end.  Returns 0 on success, or 7 if some entries' metadata couldn't
+// be put back or some hard links or duplicates couldn't be made.
+int parfu_extract_archive(string archive_file_name,
+			  string destination_path,
+			  unsigned long bucket_size,
+			  unsigned max_orders_per_bucket,
+			  parfu_behavior_settings_t *settings,
+			  unsigned int total_ranks){
+  Parfu_target_collection *archive_collec;
+  vector <string> *transfer_orders;
+  MPI_File *file_handle;
+  Parfu_buffer_pool *my_buffer_pool=nullptr;
+  Parfu_create_pipeline *boss_pipeline=nullptr;
+  long int restore_failures;
+  int mpi_return_val;
 
+  if((archive_collec=parfu_load_archive_collection(archive_file_name,settings,
+						   total_ranks,&mpi_return_val))==nullptr){
+    return mpi_return_val;
+  }
+  if(parfu_make_directory_path(destination_path)){
+    cerr << "Could not make destination directory " << destination_path << ".  Exiting.\n";
+    parfu_broadcast_order(string("X"),string("abort"));
+    return 2;
+  }
+  // Directories first, so nobody tries to write a file into a
+  // directory that isn't there yet.  With a selection, the
+  // directories above the selected entries may not be in the
+  // collection, so those get made too.  They're made a level at a
+  // time, in parallel.
+  {
+    set <string> needed_directories;
+    vector <vector <string>> directory_levels;
+    string directory_plan;
+    for(unsigned long ndx=0; ndx<archive_collec->n_entries(); ndx++){
+      Parfu_storage_entry *my_entry = archive_collec->entry(ndx)->storage_ptr;
+      string directory_path = my_entry->get_relative_path();
+      size_t slash_position;
+      if(my_entry->entry_type() != PARFU_FILE_TYPE_DIRECTORY){
+	if((slash_position=directory_path.rfind('/')) == string::npos){
+	  continue;
+	}
+	directory_path.resize(slash_position);
+      }
+      // this one and everything above it that we haven't seen yet
+      while(directory_path.size() &&
+	    needed_directories.insert(directory_path).second){
+	unsigned depth = count(directory_path.begin(),directory_path.end(),'/');
+	if(directory_levels.size() <= depth){
+	  directory_levels.resize(depth+1);
+	}
+	directory_levels.at(depth).push_back(directory_path);
+	if((slash_position=directory_path.rfind('/')) == string::npos){
+	  break;
+	}
+	directory_path.resize(slash_position);
+      }
+    }
+    directory_plan.append(destination_path);
+    directory_plan += '\0';
+    for(unsigned level=0; level<directory_levels.size(); level++){
+      for(unsigned long ndx=0; ndx<directory_levels.at(level).size(); ndx++){
+	directory_plan.append(directory_levels.at(level).at(ndx));
+	directory_plan += PARFU_LINE_SEPARATOR_CHARACTER;
+      }
+      directory_plan += PARFU_LINE_SEPARATOR_CHARACTER;
+    }
+    // and the files that will be split over several buckets, to be
+    // made at full size before anyone writes to them
+    unsigned long files_to_preallocate=0;
+    directory_plan += '\0';
+    for(unsigned long ndx=0; ndx<archive_collec->n_entries(); ndx++){
+      Parfu_storage_reference *my_ref = archive_collec->entry(ndx);
+      Parfu_storage_entry *my_entry = my_ref->storage_ptr;
+      // for regular files, order_size is the file size
+      if(my_entry->entry_type() == PARFU_FILE_TYPE_REGULAR &&
+	 ((unsigned long)(my_entry->header_size() + my_ref->order_size)) > bucket_size){
+	directory_plan.append(to_string(my_ref->order_size));
+	directory_plan += PARFU_ENTRY_SEPARATOR_CHARACTER;
+	directory_plan.append(my_entry->get_relative_path());
+	directory_plan += PARFU_LINE_SEPARATOR_CHARACTER;
+	files_to_preallocate++;
+      }
+    }
+    cout << "making " << needed_directories.size() << " directories in ";
+    cout << directory_levels.size() << " levels, and preallocating ";
+    cout << files_to_preallocate << " files.\n";
+    parfu_broadcast_order(string("M"),directory_plan);
+    if(parfu_make_directory_levels(directory_plan.data()+destination_path.size()+1,
+				   directory_plan.size()-destination_path.size()-1,
+				   destination_path,0,total_ranks) < 0){
+      cerr << "WARNING!  Some directories could not be made.\n";
+    }
+  }
+  
+  if((transfer_orders=archive_collec->create_transfer_orders(0,bucket_size,
+							     max_orders_per_bucket))==nullptr){
+    cerr << "Could not lay out buckets for extraction.  Exiting.\n";
+    parfu_broadcast_order(string("X"),string("abort"));
+    return 3;
+  }
+  cout << "there are " << transfer_orders->size() << " extract orders.\n";
+  
+  parfu_broadcast_order(string("D"),
+			to_string(settings->pipeline_depth));
+  parfu_broadcast_order(string("U"),
+			to_string(bucket_size));
+  parfu_broadcast_order(string("R"),
+			archive_file_name);
+  file_handle = new MPI_File;
+  if((mpi_return_val =
+      MPI_File_open(MPI_COMM_WORLD,archive_file_name.c_str(),
+		    MPI_MODE_RDONLY,MPI_INFO_NULL,file_handle)) != MPI_SUCCESS){
+    cerr << "parfu_extract_archive: MPI_File_open returned " << mpi_return_val << "!\n";
+    parfu_broadcast_order(string("X"),string("bye"));
+    return 4;
+  }
 
+  parfu_broadcast_order(string("N"),
+			string("individual"));
+  for(unsigned i=1; i<total_ranks; i++){
+    parfu_send_order_to_rank(i,0,string("P"),destination_path);
+  }
+  if(settings->pipeline_depth > 1){
+    vector <string> *single_orders = transfer_orders;
+    transfer_orders = parfu_bundle_transfer_orders(single_orders,
+						   settings->pipeline_depth);
+    delete single_orders;
+  }
+  if(settings->boss_moves_data || total_ranks < 2){
+    my_buffer_pool = new Parfu_buffer_pool(bucket_size,
+					   settings->pipeline_depth);
+    boss_pipeline = new Parfu_create_pipeline(my_buffer_pool,
+					      settings->pipeline_depth);
+  }
+  push_out_all_orders(transfer_orders,total_ranks,settings->queue_depth,
+		      boss_pipeline,destination_path,file_handle,
+		      string("E"));
+  // All the data is written everywhere, so now the metadata.
+  for(unsigned i=1; i<total_ranks; i++){
+    parfu_send_order_to_rank(i,0,string("B"),string("broadcast"));
+  }
+  parfu_broadcast_order(string("F"),string("metadata"));
+  if(boss_pipeline != nullptr){
+    restore_failures = parfu_restore_metadata(boss_pipeline->metadata_queue(),0);
+    delete boss_pipeline;
+    delete my_buffer_pool;
+  }
+  else{
+    vector <parfu_metadata_t> empty_queue;
+    restore_failures = parfu_restore_metadata(&empty_queue,0);
+  }
+  parfu_broadcast_order(string("X"),string("shutdown"));
+  // the workers close it along with us on the shutdown
+  MPI_File_close(file_handle);
+  cerr << "extract done; sent shutdown orders.\n";
+  delete transfer_orders;
+  if(restore_failures){
+    cout << restore_failures << " entries could not be fully restored from ";
+    cout << archive_file_name << ".\n";
+    return 7;
+  }
   return 0;
 }
+
+// Verify mode, from rank 0's side.  The buckets are laid out and
+// handed out just like extract mode (as "V" orders), but each rank
+// checksums the payloads it reads and, given the source directory,
+// compares them with the files there.  The slice checksums then come
+// to rank 0 as they do at the end of create mode, and every member is
+// checked against its catalog CRC32C.  Returns 0 if everything
+// matched.
+int parfu_verify_archive(string archive_file_name,
+			 string source_path,
+			 unsigned long bucket_size,
+			 unsigned max_orders_per_bucket,
+			 parfu_behavior_settings_t *settings,
+			 unsigned int total_ranks){
+  Parfu_target_collection *archive_collec;
+  vector <string> *transfer_orders;
+  vector <parfu_slice_checksum_t> slice_checksums;
+  MPI_File *file_handle;
+  Parfu_buffer_pool *my_buffer_pool=nullptr;
+  Parfu_create_pipeline *boss_pipeline=nullptr;
+  unsigned long n_bad;
+  int mpi_return_val;
+
+  if((archive_collec=parfu_load_archive_collection(archive_file_name,settings,
+						   total_ranks,&mpi_return_val))==nullptr){
+    return mpi_return_val;
+  }
+  if(source_path.size()){
+    cout << "verifying " << archive_file_name << " against " << source_path << ".\n";
+  }
+  else{
+    cout << "verifying " << archive_file_name << " against its catalog checksums only.\n";
+  }
+  if((transfer_orders=archive_collec->create_transfer_orders(0,bucket_size,
+							     max_orders_per_bucket))==nullptr){
+    cerr << "Could not lay out buckets for verification.  Exiting.\n";
+    parfu_broadcast_order(string("X"),string("abort"));
+    return 3;
+  }
+  cout << "there are " << transfer_orders->size() << " verify orders.\n";
+
+  parfu_broadcast_order(string("D"),
+			to_string(settings->pipeline_depth));
+  parfu_broadcast_order(string("U"),
+			to_string(bucket_size));
+  parfu_broadcast_order(string("R"),
+			archive_file_name);
+  file_handle = new MPI_File;
+  if((mpi_return_val =
+      MPI_File_open(MPI_COMM_WORLD,archive_file_name.c_str(),
+		    MPI_MODE_RDONLY,MPI_INFO_NULL,file_handle)) != MPI_SUCCESS){
+    cerr << "parfu_verify_archive: MPI_File_open returned " << mpi_return_val << "!\n";
+    parfu_broadcast_order(string("X"),string("bye"));
+    return 4;
+  }
+  parfu_broadcast_order(string("N"),
+			string("individual"));
+  for(unsigned i=1; i<total_ranks; i++){
+    parfu_send_order_to_rank(i,0,string("P"),source_path);
+  }
+  if(settings->pipeline_depth > 1){
+    vector <string> *single_orders = transfer_orders;
+    transfer_orders = parfu_bundle_transfer_orders(single_orders,
+						   settings->pipeline_depth);
+    delete single_orders;
+  }
+  if(settings->boss_moves_data || total_ranks < 2){
+    my_buffer_pool = new Parfu_buffer_pool(bucket_size,
+					   settings->pipeline_depth);
+    boss_pipeline = new Parfu_create_pipeline(my_buffer_pool,
+					      settings->pipeline_depth);
+  }
+  push_out_all_orders(transfer_orders,total_ranks,settings->queue_depth,
+		      boss_pipeline,source_path,file_handle,
+		      string("V"));
+  for(unsigned i=1; i<total_ranks; i++){
+    parfu_send_order_to_rank(i,0,string("B"),string("broadcast"));
+  }
+  parfu_broadcast_order(string("Q"),string("checksums"));
+  slice_checksums = parfu_gather_slice_checksums(0,total_ranks);
+  n_bad = archive_collec->verify_checksums(&slice_checksums);
+  if(boss_pipeline != nullptr){
+    delete boss_pipeline;
+    delete my_buffer_pool;
+  }
+  parfu_broadcast_order(string("X"),string("shutdown"));
+  MPI_File_close(file_handle);
+  delete transfer_orders;
+  if(n_bad){
+    cout << n_bad << " members of " << archive_file_name << " did not verify.\n";
+    return 6;
+  }
+  cout << archive_file_name << " verified.\n";
+  return 0;
+}
+
+// dedup=on: find the files in the collection with the same contents
+// as an earlier file and mark them as duplicates of it, so they get
+// no data buckets.  All the ranks read and compare files (see
+// parfu_find_duplicate_files()), so the workers must be in broadcast
+// mode.  Returns the number of duplicates.
+unsigned long parfu_deduplicate_collection(Parfu_target_collection *collection,
+					   unsigned int total_ranks){
+  string candidates = collection->duplicate_candidates();
+  vector <unsigned long> matches;
+  unsigned long n_duplicates;
+
+  if(!candidates.size()){
+    return 0;
+  }
+  parfu_broadcast_order(string("H"),
+			candidates);
+  matches = parfu_find_duplicate_files(candidates.data(),candidates.size(),
+				       0,total_ranks);
+  n_duplicates = collection->mark_duplicates(matches);
+  cout << n_duplicates << " files have the same contents as files already";
+  cout << " in the archive; storing them as duplicates.\n";
+  return n_duplicates;
+}
@@ -34,9 +34,55 @@ int parfu_send_order_to_rank(int rank,
 			     string message);
 int parfu_broadcast_order(string instruction,
 			  string message);
+// MPI_Bcast() of length bytes from rank 0, in pieces small enough
+// for an int count.  Every rank calls it, the workers too.
+int parfu_broadcast_bytes(void *buffer, unsigned long length);
+
+// an order message that's been handed to MPI_Isend() but may not
+// have finished sending yet
+typedef struct{
+  int message_length;
+  string message_contents;
+  MPI_Request requests[2];
+}parfu_pending_order_t;
+
+int parfu_isend_order_to_rank(int dest_rank,
+			      int tag,
+			      string instruction,
+			      string &message,
+			      list <parfu_pending_order_t> *pending_sends);
+void parfu_reap_order_sends(list <parfu_pending_order_t> *pending_sends,
+			    bool wait_for_all);
 
 int push_out_all_orders(vector <string> *transfer_order_list,
-			unsigned int total_ranks);
+			unsigned int total_ranks,
+			unsigned int queue_depth,
+			Parfu_create_pipeline *boss_pipeline,
+			string base_path,
+			MPI_File *archive_file_handle,
+			string instruction);
+vector <string> *parfu_bundle_transfer_orders(vector <string> *transfer_order_list,
+					      unsigned int sets_per_message);
+
+string parfu_receive_reply_from_worker(int *source_rank);
+
+int parfu_extract_archive(string archive_file_name,
+			  string destination_path,
+			  unsigned long bucket_size,
+			  unsigned max_orders_per_bucket,
+			  parfu_behavior_settings_t *settings,
+			  unsigned int total_ranks);
+int parfu_verify_archive(string archive_file_name,
+			 string source_path,
+			 unsigned long bucket_size,
+			 unsigned max_orders_per_bucket,
+			 parfu_behavior_settings_t *settings,
+			 unsigned int total_ranks);
+
+long int parfu_distributed_spider(Parfu_directory *root_dir,
+				  unsigned int total_ranks);
+unsigned long parfu_deduplicate_collection(Parfu_target_collection *collection,
+					   unsigned int total_ranks);
 
 
 #endif
@@ -0,0 +1,383 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  University of Illinois/NCSA Open Source License
+//  http://otm.illinois.edu/disclose-protect/illinois-open-source-license
+//
+//  Parfu is copyright (c) 2017-2022,
+//  by The Trustees of the University of Illinois.
+//  All rights reserved.
+//
+//  Parfu was developed by:
+//  The University of Illinois
+//  The National Center For Supercomputing Applications (NCSA)
+//  Blue Waters Science and Engineering Applications Support Team (SEAS)
+//  Craig P Steffen <csteffen@ncsa.illinois.edu>
+//  Roland Haas <rhaas@illinois.edu>
+//
+//  https://github.com/ncsa/parfu_archive_tool
+//  http://www.ncsa.illinois.edu/People/csteffen/parfu/
+//
+//  For full licnse text see the LICENSE file provided with the source
+//  distribution.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "parfu_main.hh"
+
+// see parfu_checksum.hh
+
+// reflected Castagnoli polynomial
+#define PARFU_CRC32C_POLY   (0x82f63b78U)
+
+static vector <parfu_slice_checksum_t> slice_checksums;
+
+static uint32_t crc32c_table[256];
+static bool crc32c_table_made=false;
+
+static void parfu_make_crc32c_table(void){
+  for(uint32_t i=0; i<256; i++){
+    uint32_t crc=i;
+    for(int bit=0; bit<8; bit++){
+      crc = (crc & 1) ? ((crc >> 1) ^ PARFU_CRC32C_POLY) : (crc >> 1);
+    }
+    crc32c_table[i] = crc;
+  }
+  crc32c_table_made = true;
+}
+
+// a byte at a time, for CPUs without SSE4.2
+static uint32_t parfu_crc32c_table(uint32_t crc, const unsigned char *data, size_t length){
+  if(!crc32c_table_made){
+    parfu_make_crc32c_table();
+  }
+  while(length--){
+    crc = crc32c_table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target("sse4.2")))
+static uint32_t parfu_crc32c_sse42(uint32_t crc, const unsigned char *data, size_t length){
+  uint64_t crc64 = crc;
+  uint64_t word;
+  while(length && (((uintptr_t)data) & 7)){
+    crc64 = __builtin_ia32_crc32qi(crc64,*data++);
+    length--;
+  }
+  while(length >= 8){
+    memcpy(&word,data,8);
+    crc64 = __builtin_ia32_crc32di(crc64,word);
+    data += 8;
+    length -= 8;
+  }
+  while(length--){
+    crc64 = __builtin_ia32_crc32qi(crc64,*data++);
+  }
+  return crc64;
+}
+#endif
+
+uint32_t parfu_crc32c(uint32_t crc, const void *data, size_t length){
+  crc = ~crc;
+#if defined(__x86_64__) && defined(__GNUC__)
+  static int have_sse42 = -1;
+  if(have_sse42 < 0){
+    have_sse42 = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+  }
+  if(have_sse42){
+    return ~parfu_crc32c_sse42(crc,(const unsigned char*)data,length);
+  }
+#endif
+  return ~parfu_crc32c_table(crc,(const unsigned char*)data,length);
+}
+
+// GF(2) matrix helpers for parfu_crc32c_combine(), as in zlib's
+// crc32_combine()
+static uint32_t parfu_gf2_matrix_times(const uint32_t *matrix, uint32_t vector){
+  uint32_t sum=0;
+  while(vector){
+    if(vector & 1){
+      sum ^= *matrix;
+    }
+    vector >>= 1;
+    matrix++;
+  }
+  return sum;
+}
+
+static void parfu_gf2_matrix_square(uint32_t *square, const uint32_t *matrix){
+  for(int n=0; n<32; n++){
+    square[n] = parfu_gf2_matrix_times(matrix,matrix[n]);
+  }
+}
+
+uint32_t parfu_crc32c_combine(uint32_t crc_a, uint32_t crc_b, uint64_t length_b){
+  uint32_t even[32];
+  uint32_t odd[32];
+  uint32_t row=1;
+
+  if(!length_b){
+    return crc_a;
+  }
+  // the operator for one zero bit
+  odd[0] = PARFU_CRC32C_POLY;
+  for(int n=1; n<32; n++){
+    odd[n] = row;
+    row <<= 1;
+  }
+  // two zero bits, then four
+  parfu_gf2_matrix_square(even,odd);
+  parfu_gf2_matrix_square(odd,even);
+  // apply length_b zero bytes to crc_a
+  do{
+    parfu_gf2_matrix_square(even,odd);
+    if(length_b & 1){
+      crc_a = parfu_gf2_matrix_times(even,crc_a);
+    }
+    length_b >>= 1;
+    if(!length_b){
+      break;
+    }
+    parfu_gf2_matrix_square(odd,even);
+    if(length_b & 1){
+      crc_a = parfu_gf2_matrix_times(odd,crc_a);
+    }
+    length_b >>= 1;
+  }while(length_b);
+  return crc_a ^ crc_b;
+}
+
+void parfu_note_slice_checksum(unsigned long data_location,
+			       unsigned long offset_in_file,
+			       unsigned long length,
+			       uint32_t checksum,
+			       uint32_t flags){
+  parfu_slice_checksum_t slice;
+  slice.data_location = data_location;
+  slice.offset_in_file = offset_in_file;
+  slice.length = length;
+  slice.checksum = checksum;
+  slice.flags = flags;
+  slice_checksums.push_back(slice);
+}
+
+vector <parfu_slice_checksum_t> parfu_gather_slice_checksums(int my_rank,
+							     int total_ranks){
+  int n_slices = slice_checksums.size();
+  vector <int> rank_counts;
+  vector <int> displacements;
+  vector <parfu_slice_checksum_t> all_slices;
+  MPI_Datatype slice_type;
+
+  // counted in slices, not bytes, so the counts and displacements
+  // stay within an int for as many slices as there are files
+  MPI_Type_contiguous(sizeof(parfu_slice_checksum_t),MPI_BYTE,&slice_type);
+  MPI_Type_commit(&slice_type);
+  if(my_rank == 0){
+    rank_counts.resize(total_ranks);
+  }
+  MPI_Gather(&n_slices,1,MPI_INT,rank_counts.data(),1,MPI_INT,0,MPI_COMM_WORLD);
+  if(my_rank == 0){
+    unsigned long total_slices=0;
+    displacements.resize(total_ranks);
+    for(int i=0; i<total_ranks; i++){
+      displacements.at(i) = total_slices;
+      total_slices += rank_counts.at(i);
+    }
+    all_slices.resize(total_slices);
+  }
+  MPI_Gatherv(slice_checksums.data(),n_slices,slice_type,
+	      all_slices.data(),rank_counts.data(),displacements.data(),slice_type,
+	      0,MPI_COMM_WORLD);
+  MPI_Type_free(&slice_type);
+  slice_checksums.clear();
+  return all_slices;
+}
+
+// how much of a file dedup reads at a time
+#define PARFU_DEDUP_READ_SIZE   (4UL*1024UL*1024UL)
+
+// read length bytes, or as many as there are; returns how many, or
+// -1 on an error
+static ssize_t parfu_read_fully(int fd, char *buffer, size_t length){
+  size_t bytes_read=0;
+  ssize_t read_return;
+  while(bytes_read < length){
+    if((read_return=read(fd,buffer+bytes_read,length-bytes_read))<0){
+      if(errno == EINTR){
+	continue;
+      }
+      return -1;
+    }
+    if(!read_return){
+      break;
+    }
+    bytes_read += read_return;
+  }
+  return bytes_read;
+}
+
+// the CRC32C of the first file_size bytes of the file.  Returns 0 if
+// it could read them all.
+static int parfu_file_crc32c(const string &path, unsigned long file_size,
+			     vector <char> *buffer, uint32_t *crc){
+  int fd;
+  ssize_t chunk;
+  unsigned long bytes_done=0;
+
+  if((fd=open(path.c_str(),O_RDONLY))<0){
+    return -1;
+  }
+  *crc = 0;
+  while(bytes_done < file_size){
+    chunk = min(file_size-bytes_done,PARFU_DEDUP_READ_SIZE);
+    if(parfu_read_fully(fd,buffer->data(),chunk) != chunk){
+      close(fd);
+      return -1;
+    }
+    *crc = parfu_crc32c(*crc,buffer->data(),chunk);
+    bytes_done += chunk;
+  }
+  close(fd);
+  return 0;
+}
+
+int parfu_whole_file_crc32c(const string &path, uint32_t *crc,
+			    unsigned long *file_size){
+  vector <char> buffer(PARFU_DEDUP_READ_SIZE);
+  int fd;
+  ssize_t chunk;
+
+  if((fd=open(path.c_str(),O_RDONLY))<0){
+    return -1;
+  }
+  *crc = 0;
+  *file_size = 0;
+  while((chunk=parfu_read_fully(fd,buffer.data(),buffer.size())) > 0){
+    *crc = parfu_crc32c(*crc,buffer.data(),chunk);
+    *file_size += chunk;
+  }
+  close(fd);
+  return (chunk < 0) ? -1 : 0;
+}
+
+static bool parfu_same_contents(const string &path_a, const string &path_b,
+				unsigned long file_size,
+				vector <char> *buffer_a, vector <char> *buffer_b){
+  int fd_a,fd_b;
+  ssize_t chunk;
+  unsigned long bytes_done=0;
+  bool same=true;
+
+  if((fd_a=open(path_a.c_str(),O_RDONLY))<0){
+    return false;
+  }
+  if((fd_b=open(path_b.c_str(),O_RDONLY))<0){
+    close(fd_a);
+    return false;
+  }
+  while(same && bytes_done < file_size){
+    chunk = min(file_size-bytes_done,PARFU_DEDUP_READ_SIZE);
+    same = (parfu_read_fully(fd_a,buffer_a->data(),chunk) == chunk &&
+	    parfu_read_fully(fd_b,buffer_b->data(),chunk) == chunk &&
+	    !memcmp(buffer_a->data(),buffer_b->data(),chunk));
+    bytes_done += chunk;
+  }
+  close(fd_a);
+  close(fd_b);
+  return same;
+}
+
+// one set of files of the same size: each one that's the same as an
+// earlier one goes in matches as (its index, the earlier one's index)
+static void parfu_match_same_size_files(const vector <pair <unsigned long,string>> &same_size,
+					unsigned long file_size,
+					vector <char> *buffer_a,
+					vector <char> *buffer_b,
+					vector <unsigned long> *matches){
+  // the files with contents we haven't seen before in this set, by
+  // checksum
+  multimap <uint32_t,unsigned> originals;
+  uint32_t crc;
+
+  for(unsigned ndx=0; ndx<same_size.size(); ndx++){
+    if(parfu_file_crc32c(same_size.at(ndx).second,file_size,buffer_a,&crc)){
+      // it'll be stored as it is
+      continue;
+    }
+    auto same_crc = originals.equal_range(crc);
+    auto original = same_crc.first;
+    while(original != same_crc.second &&
+	  !parfu_same_contents(same_size.at(original->second).second,
+			       same_size.at(ndx).second,
+			       file_size,buffer_a,buffer_b)){
+      original++;
+    }
+    if(original != same_crc.second){
+      matches->push_back(same_size.at(ndx).first);
+      matches->push_back(same_size.at(original->second).first);
+    }
+    else{
+      originals.insert(make_pair(crc,ndx));
+    }
+  }
+}
+
+vector <unsigned long> parfu_find_duplicate_files(const char *candidates,
+						  unsigned long candidates_length,
+						  int my_rank,
+						  int total_ranks){
+  vector <unsigned long> matches;
+  vector <pair <unsigned long,string>> same_size;
+  vector <char> buffer_a(PARFU_DEDUP_READ_SIZE);
+  vector <char> buffer_b(PARFU_DEDUP_READ_SIZE);
+  unsigned long set_size=0;
+  unsigned long n_sets=0;
+  unsigned long position=0;
+  int n_matches;
+  vector <int> rank_counts;
+  vector <int> rank_displacements;
+  vector <unsigned long> all_matches;
+
+  // each entry is "index \t size \t path \0", in order of size
+  while(position < candidates_length){
+    const char *entry = candidates + position;
+    char *field_end;
+    unsigned long file_index = strtoul(entry,&field_end,10);
+    unsigned long file_size = strtoul(field_end+1,&field_end,10);
+    string path(field_end+1);
+    position = (field_end+1-candidates) + path.size() + 1;
+    if(same_size.size() && file_size != set_size){
+      if((n_sets++ % total_ranks) == (unsigned long)my_rank){
+	parfu_match_same_size_files(same_size,set_size,&buffer_a,&buffer_b,&matches);
+      }
+      same_size.clear();
+    }
+    set_size = file_size;
+    same_size.push_back(make_pair(file_index,path));
+  }
+  if(same_size.size() &&
+     (n_sets++ % total_ranks) == (unsigned long)my_rank){
+    parfu_match_same_size_files(same_size,set_size,&buffer_a,&buffer_b,&matches);
+  }
+
+  n_matches = matches.size();
+  if(my_rank == 0){
+    rank_counts.resize(total_ranks);
+  }
+  MPI_Gather(&n_matches,1,MPI_INT,rank_counts.data(),1,MPI_INT,0,MPI_COMM_WORLD);
+  if(my_rank == 0){
+    unsigned long total_matches=0;
+    rank_displacements.resize(total_ranks);
+    for(int i=0; i<total_ranks; i++){
+      rank_displacements.at(i) = total_matches;
+      total_matches += rank_counts.at(i);
+    }
+    all_matches.resize(total_matches);
+  }
+  MPI_Gatherv(matches.data(),n_matches,MPI_UNSIGNED_LONG,
+	      all_matches.data(),rank_counts.data(),rank_displacements.data(),
+	      MPI_UNSIGNED_LONG,0,MPI_COMM_WORLD);
+  return all_matches;
+}
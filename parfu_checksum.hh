@@ -0,0 +1,110 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  University of Illinois/NCSA Open Source License
+//  http://otm.illinois.edu/disclose-protect/illinois-open-source-license
+//
+//  Parfu is copyright (c) 2017-2022,
+//  by The Trustees of the University of Illinois.
+//  All rights reserved.
+//
+//  Parfu was developed by:
+//  The University of Illinois
+//  The National Center For Supercomputing Applications (NCSA)
+//  Blue Waters Science and Engineering Applications Support Team (SEAS)
+//  Craig P Steffen <csteffen@ncsa.illinois.edu>
+//  Roland Haas <rhaas@illinois.edu>
+//
+//  https://github.com/ncsa/parfu_archive_tool
+//  http://www.ncsa.illinois.edu/People/csteffen/parfu/
+//
+//  For full licnse text see the LICENSE file provided with the source
+//  distribution.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef PARFU_CHECKSUM_HH_
+#define PARFU_CHECKSUM_HH_
+
+#include "parfu_main.hh"
+
+////////////////
+//
+// Payload checksums.
+//
+// Every regular file's payload is checksummed (CRC32C) by the rank
+// that moves it, while it's sitting in the staging buffer, so it
+// costs no extra I/O.  A file that's split over several buckets gets
+// one checksum per slice; the slice checksums all go to rank 0 at the
+// end, which combines them into the checksum of the whole file (CRCs
+// can be combined knowing only the length of the second piece) and
+// puts that in the catalog.
+
+// CRC32C (Castagnoli), as used by iSCSI, ext4 and friends.  crc is
+// the checksum so far (0 to start), so the data can be fed in pieces.
+// Uses the SSE4.2 crc32 instruction when the CPU has it.
+uint32_t parfu_crc32c(uint32_t crc, const void *data, size_t length);
+// the CRC32C of A followed by B, from the CRC32C of each and the
+// length of B
+uint32_t parfu_crc32c_combine(uint32_t crc_a, uint32_t crc_b, uint64_t length_b);
+
+// the checksum of one slice of a file
+typedef struct{
+  // where the file's data starts in the archive; this identifies
+  // the file
+  uint64_t data_location;
+  uint64_t offset_in_file;
+  uint64_t length;
+  uint32_t checksum;
+  // PARFU_SLICE_* bits
+  uint32_t flags;
+}parfu_slice_checksum_t;
+
+// verify mode: the slice in the archive isn't the same as the
+// source file, or the source file couldn't be read to compare.
+// Create mode sets PARFU_SLICE_SOURCE_UNREADABLE too, for a slice
+// that couldn't be read to put in the archive.
+#define PARFU_SLICE_DIFFERS_FROM_SOURCE 0x1
+#define PARFU_SLICE_SOURCE_UNREADABLE 0x2
+// the member's tar header is damaged; such a slice has length 0
+#define PARFU_SLICE_BAD_HEADER 0x4
+
+// remember a slice this rank moved (or verified)
+void parfu_note_slice_checksum(unsigned long data_location,
+			       unsigned long offset_in_file,
+			       unsigned long length,
+			       uint32_t checksum,
+			       uint32_t flags=0);
+// Collective.  Every rank's slice checksums end up on rank 0 (and are
+// returned there); other ranks get an empty list.  Each rank's own
+// list is cleared.
+vector <parfu_slice_checksum_t> parfu_gather_slice_checksums(int my_rank,
+							     int total_ranks);
+// the CRC32C and size of a whole file, for verifying a hard link or
+// duplicate's source against the member it refers to.  Returns 0 if
+// it could read it all.
+int parfu_whole_file_crc32c(const string &path, uint32_t *crc,
+			    unsigned long *file_size);
+
+////////////////
+//
+// Duplicate payloads (dedup=on in create mode).
+//
+// Files can only have the same contents if they're the same size, so
+// rank 0 sends round the files that share their size with another
+// (see Parfu_target_collection::duplicate_candidates()).  Each rank
+// takes every total_ranks'th set of files of one size, checksums
+// them, and compares the ones whose checksums match byte for byte,
+// so a CRC32C collision never costs anyone a file.  Each file that
+// turns out to be the same as an earlier one in its set is stored as
+// a duplicate of it, with no data of its own.
+
+// Collective.  candidates is the text from duplicate_candidates(),
+// the same on every rank.  Returns, on rank 0, pairs of indices
+// (duplicate, the file it's the same as); other ranks get an empty
+// list.
+vector <unsigned long> parfu_find_duplicate_files(const char *candidates,
+						  unsigned long candidates_length,
+						  int my_rank,
+						  int total_ranks);
+
+#endif // #ifndef PARFU_CHECKSUM_HH_
@@ -0,0 +1,499 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  University of Illinois/NCSA Open Source License
+//  http://otm.illinois.edu/disclose-protect/illinois-open-source-license
+//
+//  Parfu is copyright (c) 2017-2022,
+//  by The Trustees of the University of Illinois.
+//  All rights reserved.
+//
+//  Parfu was developed by:
+//  The University of Illinois
+//  The National Center For Supercomputing Applications (NCSA)
+//  Blue Waters Science and Engineering Applications Support Team (SEAS)
+//  Craig P Steffen <csteffen@ncsa.illinois.edu>
+//  Roland Haas <rhaas@illinois.edu>
+//
+//  https://github.com/ncsa/parfu_archive_tool
+//  http://www.ncsa.illinois.edu/People/csteffen/parfu/
+//
+//  For full licnse text see the LICENSE file provided with the source
+//  distribution.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "parfu_main.hh"
+#include <zlib.h>
+
+// see parfu_compressed_archive.hh
+
+// this rank's compressed buckets so far (create mode)
+static bool compress_buckets=false;
+static vector <parfu_compressed_bucket_t> written_buckets;
+// the archive's bucket table (extract mode), and the last member
+// decompressed, since the next bucket usually starts in it too
+static vector <parfu_compressed_bucket_t> bucket_table;
+static long int cached_member=-1;
+static string cached_member_data;
+static string compressed_scratch;
+
+// zlib's lengths are 32 bits, so anything bigger goes in pieces
+#define PARFU_ZLIB_CHUNK  (1073741824UL)
+
+unsigned long parfu_gzip_bound(unsigned long in_length){
+  // deflateBound() plus the gzip header and trailer, plus the stored
+  // block overhead for each chunk we feed in
+  return compressBound(in_length) + 18 +
+    5*((in_length/PARFU_ZLIB_CHUNK)+1);
+}
+
+unsigned long parfu_gzip_member(const void *in_buffer, unsigned long in_length,
+				void *out_buffer, unsigned long out_length){
+  z_stream stream;
+  unsigned long in_done=0;
+  int flush;
+  int return_val;
+
+  memset(&stream,0,sizeof(stream));
+  // 16 + window bits asks for a gzip wrapper
+  if(deflateInit2(&stream,PARFU_COMPRESSION_LEVEL,Z_DEFLATED,16+15,8,
+		  Z_DEFAULT_STRATEGY) != Z_OK){
+    cerr << "parfu_gzip_member: deflateInit2 failed!\n";
+    return 0;
+  }
+  stream.next_out = (Bytef*)out_buffer;
+  do{
+    unsigned long in_chunk = min(PARFU_ZLIB_CHUNK,in_length-in_done);
+    stream.next_in = (Bytef*)(((const char*)in_buffer)+in_done);
+    stream.avail_in = in_chunk;
+    in_done += in_chunk;
+    flush = (in_done == in_length) ? Z_FINISH : Z_NO_FLUSH;
+    do{
+      unsigned long out_left = out_length - stream.total_out;
+      stream.avail_out = min(PARFU_ZLIB_CHUNK,out_left);
+      return_val = deflate(&stream,flush);
+      if(return_val == Z_STREAM_ERROR ||
+	 (stream.avail_out == 0 && out_left <= PARFU_ZLIB_CHUNK)){
+	cerr << "parfu_gzip_member: deflate ran out of room!\n";
+	deflateEnd(&stream);
+	return 0;
+      }
+    }while(stream.avail_in || (flush == Z_FINISH && return_val != Z_STREAM_END));
+  }while(flush != Z_FINISH);
+  deflateEnd(&stream);
+  return stream.total_out;
+}
+
+long int parfu_gunzip_member(const void *in_buffer, unsigned long in_length,
+			     void *out_buffer, unsigned long out_length){
+  z_stream stream;
+  int return_val;
+
+  memset(&stream,0,sizeof(stream));
+  if(inflateInit2(&stream,16+15) != Z_OK){
+    cerr << "parfu_gunzip_member: inflateInit2 failed!\n";
+    return -1;
+  }
+  stream.next_in = (Bytef*)in_buffer;
+  stream.next_out = (Bytef*)out_buffer;
+  do{
+    stream.avail_in = min(PARFU_ZLIB_CHUNK,in_length-(stream.total_in));
+    stream.avail_out = min(PARFU_ZLIB_CHUNK,out_length-(stream.total_out));
+    return_val = inflate(&stream,Z_NO_FLUSH);
+  }while(return_val == Z_OK &&
+	 (stream.total_in < in_length && stream.total_out < out_length));
+  inflateEnd(&stream);
+  if(return_val != Z_STREAM_END){
+    cerr << "parfu_gunzip_member: bad or truncated gzip member (" << return_val << ")\n";
+    return -1;
+  }
+  return stream.total_out;
+}
+
+void parfu_set_bucket_compression(bool compress){
+  compress_buckets = compress;
+}
+
+bool parfu_bucket_compression(void){
+  return compress_buckets;
+}
+
+void parfu_note_compressed_bucket(unsigned long raw_location,
+				  unsigned long raw_length,
+				  unsigned long length){
+  parfu_compressed_bucket_t bucket;
+  bucket.raw_location = raw_location;
+  bucket.raw_length = raw_length;
+  bucket.location = 0;
+  bucket.length = length;
+  written_buckets.push_back(bucket);
+}
+
+static void parfu_put_le64(unsigned char *destination, uint64_t value){
+  for(int i=0; i<8; i++){
+    destination[i] = (value >> (8*i)) & 0xff;
+  }
+}
+
+static uint64_t parfu_get_le64(const unsigned char *source){
+  uint64_t value=0;
+  for(int i=7; i>=0; i--){
+    value = (value << 8) | source[i];
+  }
+  return value;
+}
+
+// the empty gzip member that ends a compressed archive
+static string parfu_bucket_trailer(uint64_t table_location, uint64_t table_length){
+  unsigned char trailer[PARFU_BUCKET_TRAILER_SIZE];
+  
+  memset(trailer,0,sizeof(trailer));
+  trailer[0] = 0x1f;
+  trailer[1] = 0x8b;
+  trailer[2] = 8;       // deflate
+  trailer[3] = 4;       // FEXTRA
+  trailer[9] = 255;     // OS unknown
+  trailer[10] = 20;     // XLEN
+  trailer[12] = 'P';
+  trailer[13] = 'B';
+  trailer[14] = 16;     // subfield length
+  parfu_put_le64(trailer+16,table_location);
+  parfu_put_le64(trailer+24,table_length);
+  trailer[32] = 3;      // an empty final fixed-Huffman block
+  // crc32 and size of nothing are both 0
+  return string((char*)trailer,sizeof(trailer));
+}
+
+string parfu_bucket_table_bytes(vector <parfu_compressed_bucket_t> *table){
+  string out_string;
+  parfu_bucket_table_header_t header;
+
+  memset(&header,0,sizeof(header));
+  memcpy(header.magic,PARFU_BUCKET_TABLE_MAGIC,PARFU_BUCKET_TABLE_MAGIC_SIZE);
+  header.n_buckets = table->size();
+  out_string.append((char*)&header,sizeof(header));
+  out_string.append((char*)(table->data()),
+		    table->size()*sizeof(parfu_compressed_bucket_t));
+  return out_string;
+}
+
+// copies this rank's buckets from partial_handle into archive_handle
+static int parfu_copy_compressed_buckets(MPI_File *partial_handle,
+					 MPI_File *archive_handle,
+					 vector <parfu_compressed_bucket_t> *table){
+  string copy_buffer;
+  int return_val=0;
+  
+  for(unsigned long i=0; i<written_buckets.size(); i++){
+    auto table_position =
+      lower_bound(table->begin(),table->end(),written_buckets.at(i),
+		  [](const parfu_compressed_bucket_t &a,
+		     const parfu_compressed_bucket_t &b){
+		    return a.raw_location < b.raw_location;
+		  });
+    if(table_position == table->end() ||
+       table_position->raw_location != written_buckets.at(i).raw_location){
+      cerr << "parfu_compact_archive: bucket at " << written_buckets.at(i).raw_location;
+      cerr << " is missing from the table!\n";
+      return_val = -1;
+      continue;
+    }
+    copy_buffer.resize(written_buckets.at(i).length);
+    if(MPI_File_read_at(*partial_handle,2*written_buckets.at(i).raw_location,
+			&(copy_buffer[0]),copy_buffer.size(),MPI_CHAR,
+			MPI_STATUS_IGNORE) != MPI_SUCCESS ||
+       MPI_File_write_at(*archive_handle,table_position->location,
+			 &(copy_buffer[0]),copy_buffer.size(),MPI_CHAR,
+			 MPI_STATUS_IGNORE) != MPI_SUCCESS){
+      cerr << "parfu_compact_archive: could not copy bucket at ";
+      cerr << written_buckets.at(i).raw_location << "!\n";
+      return_val = -1;
+    }
+  }
+  return return_val;
+}
+
+int parfu_compact_archive(MPI_File *partial_handle,
+			  string partial_file_name,
+			  string archive_file_name,
+			  string *catalog_member,
+			  unsigned long catalog_region_size,
+			  int my_rank, int total_ranks){
+  unsigned long n_written = written_buckets.size();
+  vector <unsigned long> rank_counts;
+  vector <int> byte_counts;
+  vector <int> byte_displacements;
+  vector <parfu_compressed_bucket_t> table;
+  unsigned long table_size;
+  MPI_File archive_handle;
+  int return_val=0;
+
+  // close and reopen, so every rank's writes are visible to every
+  // other rank
+  MPI_File_close(partial_handle);
+  if(MPI_File_open(MPI_COMM_WORLD,partial_file_name.c_str(),MPI_MODE_RDONLY,
+		   MPI_INFO_NULL,partial_handle) != MPI_SUCCESS){
+    cerr << "parfu_compact_archive: rank " << my_rank << " could not reopen ";
+    cerr << partial_file_name << "!\n";
+    return_val = -1;
+  }
+  
+  // everybody's bucket list goes to rank 0, which puts them in order
+  // and works out where each one goes
+  if(my_rank == 0){
+    rank_counts.resize(total_ranks);
+  }
+  MPI_Gather(&n_written,1,MPI_UNSIGNED_LONG,
+	     rank_counts.data(),1,MPI_UNSIGNED_LONG,0,MPI_COMM_WORLD);
+  if(my_rank == 0){
+    unsigned long total_buckets=0;
+    byte_counts.resize(total_ranks);
+    byte_displacements.resize(total_ranks);
+    for(int i=0; i<total_ranks; i++){
+      byte_counts.at(i) = rank_counts.at(i)*sizeof(parfu_compressed_bucket_t);
+      byte_displacements.at(i) = (1+total_buckets)*sizeof(parfu_compressed_bucket_t);
+      total_buckets += rank_counts.at(i);
+    }
+    table.resize(total_buckets+1);
+    table.front().raw_location = 0;
+    table.front().raw_length = catalog_region_size;
+    table.front().length = catalog_member->size();
+  }
+  MPI_Gatherv(written_buckets.data(),n_written*sizeof(parfu_compressed_bucket_t),MPI_BYTE,
+	      table.data(),byte_counts.data(),byte_displacements.data(),MPI_BYTE,
+	      0,MPI_COMM_WORLD);
+  if(my_rank == 0){
+    uint64_t location=0;
+    sort(table.begin(),table.end(),
+	 [](const parfu_compressed_bucket_t &a,
+	    const parfu_compressed_bucket_t &b){
+	   return a.raw_location < b.raw_location;
+	 });
+    for(unsigned long i=0; i<table.size(); i++){
+      if(i && table.at(i).raw_location !=
+	 table.at(i-1).raw_location + table.at(i-1).raw_length){
+	cerr << "parfu_compact_archive: WARNING! buckets at ";
+	cerr << table.at(i-1).raw_location << " and " << table.at(i).raw_location;
+	cerr << " don't meet!\n";
+      }
+      table.at(i).location = location;
+      location += table.at(i).length;
+    }
+    table_size = table.size();
+  }
+  MPI_Bcast(&table_size,1,MPI_UNSIGNED_LONG,0,MPI_COMM_WORLD);
+  table.resize(table_size);
+  MPI_Bcast(table.data(),table_size*sizeof(parfu_compressed_bucket_t),MPI_BYTE,
+	    0,MPI_COMM_WORLD);
+
+  if(MPI_File_open(MPI_COMM_WORLD,archive_file_name.c_str(),
+		   MPI_MODE_WRONLY|MPI_MODE_CREATE|MPI_MODE_EXCL,
+		   MPI_INFO_NULL,&archive_handle) != MPI_SUCCESS){
+    cerr << "parfu_compact_archive: rank " << my_rank << " could not create ";
+    cerr << archive_file_name << "!\n";
+    MPI_File_close(partial_handle);
+    return -1;
+  }
+  if(parfu_copy_compressed_buckets(partial_handle,&archive_handle,&table)){
+    return_val = -1;
+  }
+  if(my_rank == 0){
+    // the catalog region at the front, and the table and trailer at
+    // the end
+    string table_region;
+    string table_member;
+    uint64_t table_location = table.back().location + table.back().length;
+    parfu_append_metadata_member(&table_region,PARFU_BUCKET_TABLE_ENTRY_NAME,
+				 parfu_bucket_table_bytes(&table));
+    table_region.append(2*BLOCKSIZE,'\0');
+    table_member.resize(parfu_gzip_bound(table_region.size()));
+    table_member.resize(parfu_gzip_member(table_region.data(),table_region.size(),
+					  &(table_member[0]),table_member.size()));
+    table_member.append(parfu_bucket_trailer(table_location,table_member.size()));
+    if(MPI_File_write_at(archive_handle,0,&((*catalog_member)[0]),catalog_member->size(),
+			 MPI_CHAR,MPI_STATUS_IGNORE) != MPI_SUCCESS ||
+       MPI_File_write_at(archive_handle,table_location,&(table_member[0]),
+			 table_member.size(),MPI_CHAR,MPI_STATUS_IGNORE) != MPI_SUCCESS){
+      cerr << "parfu_compact_archive: could not write the catalog and bucket table!\n";
+      return_val = -1;
+    }
+    cout << "compressed archive is " << (table_location+table_member.size());
+    cout << " bytes in " << table.size() << " members.\n";
+  }
+  MPI_File_close(&archive_handle);
+  MPI_File_close(partial_handle);
+  if(my_rank == 0){
+    MPI_File_delete(partial_file_name.c_str(),MPI_INFO_NULL);
+  }
+  written_buckets.clear();
+  return return_val;
+}
+
+bool parfu_read_bucket_table(string archive_file_name,
+			     vector <parfu_compressed_bucket_t> *table){
+  unsigned char trailer[PARFU_BUCKET_TRAILER_SIZE];
+  struct stat archive_stat;
+  string table_member;
+  string table_region;
+  uint64_t table_location;
+  uint64_t table_length;
+  uint32_t table_region_size;
+  unsigned long table_bytes;
+  const parfu_bucket_table_header_t *header;
+  int archive_fd;
+
+  if((archive_fd=open(archive_file_name.c_str(),O_RDONLY))<0){
+    return false;
+  }
+  if(fstat(archive_fd,&archive_stat) ||
+     archive_stat.st_size < PARFU_BUCKET_TRAILER_SIZE ||
+     pread(archive_fd,trailer,PARFU_BUCKET_TRAILER_SIZE,
+	   archive_stat.st_size-PARFU_BUCKET_TRAILER_SIZE) != PARFU_BUCKET_TRAILER_SIZE ||
+     trailer[0] != 0x1f || trailer[1] != 0x8b || trailer[3] != 4 ||
+     trailer[12] != 'P' || trailer[13] != 'B'){
+    close(archive_fd);
+    return false;
+  }
+  table_location = parfu_get_le64(trailer+16);
+  table_length = parfu_get_le64(trailer+24);
+  if(table_location + table_length + PARFU_BUCKET_TRAILER_SIZE !=
+     ((uint64_t)(archive_stat.st_size)) || table_length < 8){
+    close(archive_fd);
+    return false;
+  }
+  table_member.resize(table_length);
+  if(pread(archive_fd,&(table_member[0]),table_length,table_location) !=
+     ((ssize_t)table_length)){
+    close(archive_fd);
+    return false;
+  }
+  close(archive_fd);
+  // the uncompressed size is the last thing in a gzip member
+  memcpy(&table_region_size,&(table_member[table_length-4]),4);
+  table_region.resize(table_region_size);
+  if(parfu_gunzip_member(table_member.data(),table_member.size(),
+			 &(table_region[0]),table_region.size()) !=
+     ((long int)table_region_size) ||
+     table_region_size < BLOCKSIZE ||
+     strncmp(table_region.data(),PARFU_BUCKET_TABLE_ENTRY_NAME,100)){
+    cerr << "parfu_read_bucket_table: " << archive_file_name << " has a bad bucket table.\n";
+    return false;
+  }
+  table_bytes = strtoul(table_region.substr(124,12).c_str(),nullptr,8);
+  header = (const parfu_bucket_table_header_t*)
+    (table_region.data() +
+     tarentry::compute_hdr_size(PARFU_BUCKET_TABLE_ENTRY_NAME,"",table_bytes));
+  if(table_bytes < sizeof(parfu_bucket_table_header_t) ||
+     memcmp(header->magic,PARFU_BUCKET_TABLE_MAGIC,PARFU_BUCKET_TABLE_MAGIC_SIZE) ||
+     sizeof(parfu_bucket_table_header_t) +
+     header->n_buckets*sizeof(parfu_compressed_bucket_t) != table_bytes){
+    cerr << "parfu_read_bucket_table: " << archive_file_name << " has a bad bucket table.\n";
+    return false;
+  }
+  table->resize(header->n_buckets);
+  memcpy(table->data(),header+1,header->n_buckets*sizeof(parfu_compressed_bucket_t));
+  return true;
+}
+
+string parfu_read_compressed_catalog(string archive_file_name,
+				     vector <parfu_compressed_bucket_t> *table){
+  string catalog_member;
+  string catalog_region;
+  unsigned long catalog_size;
+  int archive_fd;
+
+  if(table->empty() || table->front().raw_location != 0){
+    return string("");
+  }
+  if((archive_fd=open(archive_file_name.c_str(),O_RDONLY))<0){
+    return string("");
+  }
+  catalog_member.resize(table->front().length);
+  if(pread(archive_fd,&(catalog_member[0]),catalog_member.size(),
+	   table->front().location) != ((ssize_t)(catalog_member.size()))){
+    close(archive_fd);
+    return string("");
+  }
+  close(archive_fd);
+  catalog_region.resize(table->front().raw_length);
+  if(parfu_gunzip_member(catalog_member.data(),catalog_member.size(),
+			 &(catalog_region[0]),catalog_region.size()) !=
+     ((long int)(catalog_region.size())) ||
+     catalog_region.size() < BLOCKSIZE ||
+     strncmp(catalog_region.data(),PARFU_CATALOG_ENTRY_NAME,100)){
+    cerr << "parfu_read_compressed_catalog: " << archive_file_name;
+    cerr << " does not start with a parfu catalog.\n";
+    return string("");
+  }
+  catalog_size = strtoul(catalog_region.substr(124,12).c_str(),nullptr,8);
+  return catalog_region.substr(tarentry::compute_hdr_size(PARFU_CATALOG_ENTRY_NAME,
+							  "",catalog_size),
+			       catalog_size);
+}
+
+void parfu_load_bucket_table(const char *table_buffer, size_t table_length){
+  const parfu_bucket_table_header_t *header =
+    (const parfu_bucket_table_header_t*)table_buffer;
+  bucket_table.clear();
+  cached_member = -1;
+  if(table_length < sizeof(parfu_bucket_table_header_t) ||
+     memcmp(header->magic,PARFU_BUCKET_TABLE_MAGIC,PARFU_BUCKET_TABLE_MAGIC_SIZE) ||
+     table_length != sizeof(parfu_bucket_table_header_t) +
+     header->n_buckets*sizeof(parfu_compressed_bucket_t)){
+    cerr << "parfu_load_bucket_table: bad bucket table!\n";
+    return;
+  }
+  bucket_table.resize(header->n_buckets);
+  memcpy(bucket_table.data(),header+1,header->n_buckets*sizeof(parfu_compressed_bucket_t));
+}
+
+bool parfu_archive_is_compressed(void){
+  return !(bucket_table.empty());
+}
+
+int parfu_read_compressed_range(MPI_File *archive_file_handle,
+				unsigned long raw_location,
+				unsigned long length,
+				void *destination){
+  unsigned long done=0;
+  // the last member that starts at or before raw_location
+  long int member =
+    upper_bound(bucket_table.begin(),bucket_table.end(),raw_location,
+		[](unsigned long location, const parfu_compressed_bucket_t &b){
+		  return location < b.raw_location;
+		}) - bucket_table.begin() - 1;
+  
+  while(done < length){
+    unsigned long position = raw_location + done;
+    unsigned long offset_in_member;
+    unsigned long copy_length;
+    if(member < 0 || ((unsigned long)member) >= bucket_table.size() ||
+       position >= bucket_table.at(member).raw_location + bucket_table.at(member).raw_length){
+      cerr << "parfu_read_compressed_range: nothing in the archive at " << position << "!\n";
+      return -1;
+    }
+    const parfu_compressed_bucket_t &bucket = bucket_table.at(member);
+    if(cached_member != member){
+      cached_member = -1;
+      compressed_scratch.resize(bucket.length);
+      cached_member_data.resize(bucket.raw_length);
+      if(MPI_File_read_at(*archive_file_handle,bucket.location,
+			  &(compressed_scratch[0]),bucket.length,MPI_CHAR,
+			  MPI_STATUS_IGNORE) != MPI_SUCCESS ||
+	 parfu_gunzip_member(compressed_scratch.data(),bucket.length,
+			     &(cached_member_data[0]),bucket.raw_length) !=
+	 ((long int)(bucket.raw_length))){
+	cerr << "parfu_read_compressed_range: could not decompress the member at ";
+	cerr << bucket.location << "!\n";
+	return -1;
+      }
+      cached_member = member;
+    }
+    offset_in_member = position - bucket.raw_location;
+    copy_length = min(length-done,bucket.raw_length-offset_in_member);
+    memcpy(((char*)destination)+done,cached_member_data.data()+offset_in_member,copy_length);
+    done += copy_length;
+    member++;
+  }
+  return 0;
+}
@@ -0,0 +1,137 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  University of Illinois/NCSA Open Source License
+//  http://otm.illinois.edu/disclose-protect/illinois-open-source-license
+//
+//  Parfu is copyright (c) 2017-2022,
+//  by The Trustees of the University of Illinois.
+//  All rights reserved.
+//
+//  Parfu was developed by:
+//  The University of Illinois
+//  The National Center For Supercomputing Applications (NCSA)
+//  Blue Waters Science and Engineering Applications Support Team (SEAS)
+//  Craig P Steffen <csteffen@ncsa.illinois.edu>
+//  Roland Haas <rhaas@illinois.edu>
+//
+//  https://github.com/ncsa/parfu_archive_tool
+//  http://www.ncsa.illinois.edu/People/csteffen/parfu/
+//
+//  For full licnse text see the LICENSE file provided with the source
+//  distribution.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef PARFU_COMPRESSED_ARCHIVE_HH_
+#define PARFU_COMPRESSED_ARCHIVE_HH_
+
+#include "parfu_main.hh"
+
+////////////////
+//
+// Compressed archives.
+//
+// In compressed mode every bucket is compressed by the rank that
+// assembled it, as its own gzip member.  gzip members can simply be
+// concatenated, so the archive as a whole is an ordinary .tar.gz that
+// "tar xzf" reads.  Because each member starts fresh, parfu can also
+// decompress any one of them on its own, given where it is.
+//
+// The layout of a compressed archive:
+//   gzip member: the catalog region (the .parfu_catalog and
+//                .parfu_index members)
+//   gzip member for each bucket, in archive order
+//   gzip member: a .parfu_buckets tar member holding the bucket table
+//                (below), then the two zero blocks that end a tar file
+//   the trailer: an empty gzip member (PARFU_BUCKET_TRAILER_SIZE bytes)
+//                whose gzip "extra" field holds where the bucket table
+//                member is
+// So a reader finds the trailer at the end of the file, the table from
+// that, and any byte of the uncompressed tar through the table.
+//
+// While the data moves, the compressed buckets don't know where they
+// belong in the archive yet (that depends on the size of every bucket
+// before them).  So each one is written to a partial file at twice its
+// uncompressed location, which can't collide with the next bucket, and
+// at the end all the ranks copy their buckets into the archive at the
+// places given by a prefix sum of the compressed sizes; see
+// parfu_compact_archive().  The partial file is sparse and removed
+// afterwards.
+
+#define PARFU_BUCKET_TABLE_ENTRY_NAME    ".parfu_buckets"
+#define PARFU_BUCKET_TABLE_MAGIC         "PFUBKT01"
+#define PARFU_BUCKET_TABLE_MAGIC_SIZE    (8)
+#define PARFU_PARTIAL_ARCHIVE_SUFFIX     ".parfu_partial"
+// gzip header with extra field, empty deflate block, crc and size
+#define PARFU_BUCKET_TRAILER_SIZE        (42)
+// compression level for deflate; favors speed
+#define PARFU_COMPRESSION_LEVEL          (1)
+
+// one gzip member; the table is a parfu_bucket_table_header_t and
+// then these, sorted by location.  As in the index, the numbers are in
+// the byte order of the machine that wrote the archive.  (The ones in
+// the trailer are little endian, as gzip's own are.)
+typedef struct{
+  // where the member's data sits in the uncompressed tar
+  uint64_t raw_location;
+  uint64_t raw_length;
+  // and where the member is in the compressed archive
+  uint64_t location;
+  uint64_t length;
+}parfu_compressed_bucket_t;
+
+typedef struct{
+  char magic[PARFU_BUCKET_TABLE_MAGIC_SIZE];
+  uint64_t n_buckets;
+}parfu_bucket_table_header_t;
+
+// Compress in_length bytes into a single gzip member in out_buffer,
+// which must be at least parfu_gzip_bound(in_length) bytes.  Returns
+// the length of the member, or 0 on failure.
+unsigned long parfu_gzip_bound(unsigned long in_length);
+unsigned long parfu_gzip_member(const void *in_buffer, unsigned long in_length,
+				void *out_buffer, unsigned long out_length);
+// Decompress one gzip member into out_buffer.  Returns the number of
+// bytes it decompressed to, or -1.
+long int parfu_gunzip_member(const void *in_buffer, unsigned long in_length,
+			     void *out_buffer, unsigned long out_length);
+
+// create mode: whether this rank's create pipelines compress buckets
+void parfu_set_bucket_compression(bool compress);
+bool parfu_bucket_compression(void);
+// a compressed bucket this rank has written to the partial file
+void parfu_note_compressed_bucket(unsigned long raw_location,
+				  unsigned long raw_length,
+				  unsigned long length);
+// Collective, once all the data is written.  partial_handle is the
+// partial file the buckets went to; it's closed and deleted.  On rank
+// 0, catalog_member is the compressed catalog region (its raw length
+// is catalog_region_size); other ranks pass nullptr.
+int parfu_compact_archive(MPI_File *partial_handle,
+			  string partial_file_name,
+			  string archive_file_name,
+			  string *catalog_member,
+			  unsigned long catalog_region_size,
+			  int my_rank, int total_ranks);
+
+// extract mode: read the bucket table of a compressed archive.
+// Returns false if it isn't one.
+bool parfu_read_bucket_table(string archive_file_name,
+			     vector <parfu_compressed_bucket_t> *bucket_table);
+// the catalog text from the first member of a compressed archive
+string parfu_read_compressed_catalog(string archive_file_name,
+				     vector <parfu_compressed_bucket_t> *bucket_table);
+// the table that parfu_read_compressed_range() uses on this rank;
+// loaded from the raw table bytes
+void parfu_load_bucket_table(const char *table_buffer, size_t table_length);
+string parfu_bucket_table_bytes(vector <parfu_compressed_bucket_t> *bucket_table);
+bool parfu_archive_is_compressed(void);
+// Fill destination with length bytes of the uncompressed tar
+// starting at raw_location, decompressing whichever members hold
+// them.  Returns 0 on success.
+int parfu_read_compressed_range(MPI_File *archive_file_handle,
+				unsigned long raw_location,
+				unsigned long length,
+				void *destination);
+
+#endif // #ifndef PARFU_COMPRESSED_ARCHIVE_HH_
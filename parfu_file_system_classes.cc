@@ -44,6 +44,10 @@ char Parfu_storage_entry::type_char(void){
     return PARFU_FILE_TYPE_SYMLINK_CHAR;
   case PARFU_FILE_TYPE_REGULAR:
     return PARFU_FILE_TYPE_REGULAR_CHAR;
+  case PARFU_FILE_TYPE_HARDLINK:
+    return PARFU_FILE_TYPE_HARDLINK_CHAR;
+  case PARFU_FILE_TYPE_DUPLICATE:
+    return PARFU_FILE_TYPE_DUPLICATE_CHAR;
   default:
     return PARFU_FILE_TYPE_INVALID_CHAR;
   }
@@ -104,11 +108,13 @@ long int Parfu_storage_entry::next_available_after_me(long int start_of_availabl
 //  return slices.size();
 //}
 
-string Parfu_storage_entry::generate_archive_catalog_line(void){
+string Parfu_storage_entry::generate_archive_catalog_line(unsigned long location_in_archive){
   // dump contents as a string
   // format is the *archive* catalog line
   // (the shorter one)
   string out_string;
+  char location_string[PARFU_CATALOG_OFFSET_DIGITS+1];
+  char checksum_string[PARFU_CATALOG_CHECKSUM_DIGITS+1];
 
   // path + filename within the archive
   out_string.append(relative_path);
@@ -125,10 +131,17 @@ string Parfu_storage_entry::generate_archive_catalog_line(void){
   case PARFU_FILE_TYPE_SYMLINK:
     out_string += PARFU_FILE_TYPE_SYMLINK_CHAR;
     break;
+  case PARFU_FILE_TYPE_HARDLINK:
+    out_string += PARFU_FILE_TYPE_HARDLINK_CHAR;
+    break;
+  case PARFU_FILE_TYPE_DUPLICATE:
+    out_string += PARFU_FILE_TYPE_DUPLICATE_CHAR;
+    break;
   }
   out_string.append("\t"); // \t
 
-  // symlink target
+  // symlink target, or for a hard link or duplicate the path of the
+  // file it's another name for (or a copy of)
   out_string.append(symlink_target);
   out_string.append("\t"); // \t
 
@@ -140,8 +153,22 @@ string Parfu_storage_entry::generate_archive_catalog_line(void){
   out_string.append(to_string(this->header_size()));
   out_string.append("\t");  // \t
 
-  // location in archive file
-  //  out_string.append(to_string(
+  // payload checksum (fixed width, too, so the catalog is the same
+  // size before and after the checksums are known)
+  if(checksum_known){
+    snprintf(checksum_string,sizeof(checksum_string),"%0*x",
+	     PARFU_CATALOG_CHECKSUM_DIGITS,payload_checksum);
+    out_string.append(checksum_string);
+  }
+  else{
+    out_string.append(PARFU_CATALOG_CHECKSUM_DIGITS,PARFU_CATALOG_NO_CHECKSUM_CHAR);
+  }
+  out_string.append("\t");  // \t
+
+  // location in archive file (fixed width; see parfu_main.hh)
+  snprintf(location_string,sizeof(location_string),"%0*lu",
+	   PARFU_CATALOG_OFFSET_DIGITS,location_in_archive);
+  out_string.append(location_string);
   out_string.append("\n");// \n
 
   return out_string;  
@@ -176,6 +203,12 @@ string Parfu_storage_entry::generate_full_catalog_line(void){
   case PARFU_FILE_TYPE_SYMLINK:
     out_string += PARFU_FILE_TYPE_SYMLINK_CHAR;
     break;
+  case PARFU_FILE_TYPE_HARDLINK:
+    out_string += PARFU_FILE_TYPE_HARDLINK_CHAR;
+    break;
+  case PARFU_FILE_TYPE_DUPLICATE:
+    out_string += PARFU_FILE_TYPE_DUPLICATE_CHAR;
+    break;
   }
   out_string.append("\t"); // \t
 
@@ -215,6 +248,21 @@ int Parfu_storage_entry::header_size(void){
   if(tar_header_size<0){
     // compute it
     string my_absolute_path=this->absolute_path();
+    // the name in a directory's tar header ends in "/", which counts
+    // against the ustar name field; tarentry adds it the same way
+    if(entry_type_value == PARFU_FILE_TYPE_DIRECTORY &&
+       *my_absolute_path.rbegin() != '/'){
+      my_absolute_path += "/";
+    }
+    // a hard link's link name is the other member's name in full,
+    // just like its own name.  A duplicate is a hard link in tar.
+    if(entry_type_value == PARFU_FILE_TYPE_HARDLINK ||
+       entry_type_value == PARFU_FILE_TYPE_DUPLICATE){
+      tar_header_size =
+	tarentry::compute_hdr_size(my_absolute_path.c_str(),
+				   (base_path+"/"+symlink_target).c_str(),0);
+      return tar_header_size;
+    }
     tar_header_size =
       tarentry::compute_hdr_size(my_absolute_path.c_str(),symlink_target.c_str(),file_size);
   }
@@ -223,7 +271,54 @@ int Parfu_storage_entry::header_size(void){
 
 Parfu_target_file::Parfu_target_file(string catalog_line){
   // take a catalog line as a string as input
-  // and build a target file class  
+  // and build a target file class.  The line is in the archive
+  // catalog format:
+  // AAA \t T \t TGT \t SZ \t THSZ \t CRC \t LOC_AR
+  // (the location in the archive isn't something a target file keeps;
+  // Parfu_target_collection(string) puts it in the entry's slice).
+  // Catalogs from plain tar files have no CRC field.
+  size_t field_begin=0,field_end;
+  string fields[5];
+  
+  for(int i=0; i<5; i++){
+    if((field_end=catalog_line.find(PARFU_ENTRY_SEPARATOR_CHARACTER,field_begin))
+       == string::npos){
+      cerr << "Parfu_target_file: short catalog line:>" << catalog_line << "<\n";
+      entry_type_value = PARFU_FILE_TYPE_INVALID;
+      return;
+    }
+    fields[i] = catalog_line.substr(field_begin,field_end-field_begin);
+    field_begin = field_end + 1;
+  }
+  relative_path = fields[0];
+  switch(fields[1].size()?fields[1].at(0):PARFU_FILE_TYPE_INVALID_CHAR){
+  case PARFU_FILE_TYPE_REGULAR_CHAR:
+    entry_type_value = PARFU_FILE_TYPE_REGULAR;
+    break;
+  case PARFU_FILE_TYPE_DIRECTORY_CHAR:
+    entry_type_value = PARFU_FILE_TYPE_DIRECTORY;
+    break;
+  case PARFU_FILE_TYPE_SYMLINK_CHAR:
+    entry_type_value = PARFU_FILE_TYPE_SYMLINK;
+    break;
+  case PARFU_FILE_TYPE_HARDLINK_CHAR:
+    entry_type_value = PARFU_FILE_TYPE_HARDLINK;
+    break;
+  case PARFU_FILE_TYPE_DUPLICATE_CHAR:
+    entry_type_value = PARFU_FILE_TYPE_DUPLICATE;
+    break;
+  default:
+    entry_type_value = PARFU_FILE_TYPE_INVALID;
+  }
+  symlink_target = fields[2];
+  file_size = stol(fields[3]);
+  tar_header_size = stoi(fields[4]);
+  if((field_end=catalog_line.find(PARFU_ENTRY_SEPARATOR_CHARACTER,field_begin))
+     != string::npos &&
+     catalog_line.at(field_begin) != PARFU_CATALOG_NO_CHECKSUM_CHAR){
+    set_checksum(stoul(catalog_line.substr(field_begin,field_end-field_begin),
+		       nullptr,16));
+  }
 }
 
 //Parfu_target_file::Parfu_target_file(string in_base_path, string in_relative_path,
@@ -269,22 +364,7 @@ long int Parfu_directory::spider_directory(void){
   // This is a big fuction, used when creating an 
   // archive.  
   long int total_entries_found=0;
-  // OS-level directory structure
-  DIR *my_dir;
-  struct dirent * next_entry;
-  // internal parfu variable telling us what the entry is
-  // regular file, symlink, directory, etc. 
-  unsigned int path_type_result;
-
-  string my_directory_path;
 
-  string link_target;
-  // File size if > 0.  Otherwise, this will be some slightly
-  // negative number useful for classification
-  long int file_size=(-1);
-  // TODO: make this sensitive to command-line input
-  int follow_symlinks=0;
-  
   if(spidered){
     cerr << "This directory already spidered!  >>" << base_path << "\n";
     return -1L;
@@ -292,7 +372,49 @@ long int Parfu_directory::spider_directory(void){
   cerr << "spider dir: base=>" << base_path ;
   cerr << "< relative=>" << relative_path << "<\n";
 
+  if((total_entries_found=this->scan_directory_level()) < 0L){
+    return total_entries_found;
+  }
   
+  // Now this directory has been read.  Now we need to
+  // go through all the subdirectories and read their
+  // entries too.
+  //
+  // For now (May 19 2022) we'll attempt to do this
+  // as a recursive function call.
+  // If I've done this right, I think this should
+  // basically end up as a callstack as deep as the
+  // deepest layer of the file directory.  I don't
+  // think we'll get a thread explosion; I think
+  // the upper calling threads will just be waiting
+  // for the lower directory threads each to finish. 
+
+  // The distributed version of this, where the worker
+  // ranks do the reading, is parfu_distributed_spider()
+  // in parfu_boss_functions.cc.  It uses scan_directory_level()
+  // one directory at a time instead of this recursion.
+  
+  for(std::size_t subdir_index=0;subdir_index < subdirectories.size();subdir_index++){
+    // fire off the spider function of each subdirectory in turn
+    Parfu_directory *local_subdir;
+    local_subdir=subdirectories[subdir_index];
+    local_subdir->spider_directory();
+  }
+  
+  spidered=true;
+  return total_entries_found;
+} // long int spider_directory()
+
+long int Parfu_directory::scan_directory_level(void){
+  // Read the entries of this one directory (and only this
+  // directory; no recursion) into subfiles and subdirectories.
+  // Returns the number of entries stored, or a negative number
+  // if the directory could not be opened.  
+  long int total_entries_found=0;
+  // OS-level directory structure
+  DIR *my_dir;
+  string my_directory_path;
+
   my_directory_path = base_path;
 
   if(relative_path.length() > 0){
@@ -303,8 +425,49 @@ long int Parfu_directory::spider_directory(void){
   //    for (const auto & next_entry : std::filesystem::directory_iterator(directory_path)){
   if((my_dir=opendir(my_directory_path.c_str()))==nullptr){
     cerr << "Could not open directory >>" << my_directory_path << "<<for scanning!\n";
+    this->stat_unopened_directory(AT_FDCWD,my_directory_path.c_str());
     return -2L;
   }
+  total_entries_found = this->scan_open_directory(my_dir);
+  closedir(my_dir);
+  
+  return total_entries_found;
+} // long int scan_directory_level()
+
+long int Parfu_directory::scan_open_directory(DIR *my_dir){
+  // This does the actual reading for scan_directory_level() and for the
+  // threaded spider.  my_dir is this directory, already open.  Everything
+  // in it is looked at *relative to the directory's file descriptor*
+  // (fstatat(), readlinkat()) so we never have to build up and hand the
+  // full path of each entry to the file system; the file system
+  // doesn't have to walk that path from the top every time either.
+  long int total_entries_found=0;
+  int my_dir_fd;
+  struct dirent * next_entry;
+  struct stat entry_stat;
+  // internal parfu variable telling us what the entry is
+  // regular file, symlink, directory, etc. 
+  unsigned int path_type_result;
+
+  string link_target;
+  // File size if > 0.  Otherwise, this will be some slightly
+  // negative number useful for classification
+  long int file_size=(-1);
+  // TODO: make this sensitive to command-line input
+  int follow_symlinks=0;
+  
+  my_dir_fd = dirfd(my_dir);
+
+  // this is the one and only stat() of this directory; its own
+  // metadata (for its tar header) comes from here.  Its parent
+  // didn't stat it because readdir() told it it was a directory.
+  if(fstat(my_dir_fd,&entry_stat)){
+    cerr << "scan_open_directory: could not fstat directory >>" << relative_path << "<<\n";
+  }
+  else{
+    set_metadata(entry_stat);
+  }
+  
   // This loop is the *initial* traverse of the directory that
   // this instance points to.  That is, this next loop
   // traverses the top level of the directory.  This will
@@ -314,16 +477,8 @@ long int Parfu_directory::spider_directory(void){
   // need to be traversed.  
   
   // using the C library for traversing this directory
-  //  next_entry=readdir(my_dir);
-  //  if(next_entry == nullptr){
-  //    cerr << "\nFound nullptr entry in directory!!!\n\n";
-  //  }
   while( (next_entry=readdir(my_dir)) != nullptr ){
 
-    //    cerr << "Raw filename: >" << string(next_entry->d_name) << "<\n";
-    //    if(next_entry == nullptr){
-    //      cerr << "\nFound nullptr entry in directory!!!\n\n";
-    //    }
     // traverse once per entry
     // skip over "." and ".."
     if(!strncmp(next_entry->d_name,".",1) &&
@@ -337,9 +492,7 @@ long int Parfu_directory::spider_directory(void){
     // We know now that it's an actual thing with a name,
     // so we need to check *what* it is
     string entry_bare_name = string(next_entry->d_name);
-    //    string entry_relative_name = directory_path;
     string entry_relative_name = string("");
-    string entry_full_name;
     if(relative_path.length() == 0){
       entry_relative_name = entry_bare_name;
     }
@@ -353,24 +506,23 @@ long int Parfu_directory::spider_directory(void){
     // (directory,regular file, symlink) and how big
     // it is if it's a regular file.
     //
-    // for file system purposes we need to combine it with the
-    // base path so that we can find it.
-    if(base_path.length()){
-      entry_full_name = base_path;
-      entry_full_name.append("/");
+    // If readdir() already told us it's a directory we don't
+    // need to stat it at all; directories carry no size.  
+    if(next_entry->d_type == DT_DIR && !follow_symlinks){
+      path_type_result = PARFU_WHAT_IS_PATH_DIR;
+    }
+    else{
+      path_type_result =
+	parfu_what_is_path_at(my_dir_fd,next_entry->d_name,
+			      link_target,&file_size,&entry_stat,follow_symlinks);
     }
-    entry_full_name.append(entry_relative_name);
-    path_type_result=
-      parfu_what_is_path(entry_full_name.c_str(),link_target,&file_size,follow_symlinks);
-    //    cout << "relative name: >>" << entry_full_name << "<< file size: " << file_size;
-    //    cout << " file type:" << path_type_result << "\n";
     switch(path_type_result){
     case PARFU_WHAT_IS_PATH_DOES_NOT_EXIST:
-      cerr << "Parfu_directory const; does not exist: >>" << entry_full_name << "<<\n";
+      cerr << "Parfu_directory const; does not exist: >>" << entry_relative_name << "<<\n";
       // this should generally never happen 
       break;
     case PARFU_WHAT_IS_PATH_IGNORED_TYPE:
-      cerr << "Parfu_directory spider_dir function: ignored type, will skip file: >>" << entry_full_name << "<<\n";
+      cerr << "Parfu_directory spider_dir function: ignored type, will skip file: >>" << entry_relative_name << "<<\n";
       // I presume for now we'll just jump over this entry without acknowledging it or storing
       // anywhere.  This would be an entry that's not a file, not a symlink, and not a
       // subdirectory.  So....a dev file?  Something else?  Probably safe to not save it
@@ -382,7 +534,9 @@ long int Parfu_directory::spider_directory(void){
       Parfu_target_file *new_target_file_ptr;
       new_target_file_ptr = new 
 	Parfu_target_file(base_path,entry_relative_name,PARFU_FILE_TYPE_REGULAR,file_size);
+      new_target_file_ptr->set_metadata(entry_stat);
       subfiles.push_back(new_target_file_ptr);
+      total_entries_found++;
       break;
     case PARFU_WHAT_IS_PATH_DIR:
       // it's a directory that we need to note and it will need to be spidered in the future
@@ -391,54 +545,191 @@ long int Parfu_directory::spider_directory(void){
       	new Parfu_directory(base_path,entry_relative_name);
       new_subdir_ptr->file_size = 0L;
       subdirectories.push_back(new_subdir_ptr);
+      total_entries_found++;
       break;
     case PARFU_WHAT_IS_PATH_SYMLINK:
       // simlink that we'll need to store for now
       Parfu_target_file *my_tempfile;
       my_tempfile = 
 	new Parfu_target_file(base_path,entry_relative_name,PARFU_FILE_TYPE_SYMLINK,0,link_target);
-      //      my_tempfile->set_symlink_target(link_target);
+      my_tempfile->set_metadata(entry_stat);
       subfiles.push_back(my_tempfile);
+      total_entries_found++;
       break;
     case PARFU_WHAT_IS_PATH_ERROR:
       // not sure what would cause an error in this function, but catch it here
-      cerr << "Parfu_directory const; ERROR from what_is_path: >>" << entry_full_name << "<<\n";
+      cerr << "Parfu_directory const; ERROR from what_is_path: >>" << entry_relative_name << "<<\n";
       break;
     default:
       // don't know if it's possible to fall through to here??
-      cerr << "Parfu_directory const; reached default branch??: >>" << entry_full_name << "<<\n";
+      cerr << "Parfu_directory const; reached default branch??: >>" << entry_relative_name << "<<\n";
       break;
     }
   } // while(next_entry...)
   
-  // Now this directory has been read.  Now we need to
-  // go through all the subdirectories and read their
-  // entries too.
-  //
-  // For now (May 19 2022) we'll attempt to do this
-  // as a recursive function call.
-  // If I've done this right, I think this should
-  // basically end up as a callstack as deep as the
-  // deepest layer of the file directory.  I don't
-  // think we'll get a thread explosion; I think
-  // the upper calling threads will just be waiting
-  // for the lower directory threads each to finish. 
+  return total_entries_found;
+} // long int scan_open_directory()
+
+void Parfu_directory::stat_unopened_directory(int parent_fd, const char *name){
+  // A directory normally gets its own metadata from the fstat() in
+  // scan_open_directory(), since its parent skipped stat()ing it.
+  // If we couldn't open it (EACCES, EMFILE...) that never happens,
+  // so stat it by name here; otherwise its header would go into the
+  // archive as mode 0, owned by root, dated 1970.  
+  struct stat dir_stat;
+  if(fstatat(parent_fd,name,&dir_stat,AT_SYMLINK_NOFOLLOW)){
+    cerr << "Could not stat directory >>" << relative_path << "<<: " << strerror(errno) << "\n";
+    return;
+  }
+  set_metadata(dir_stat);
+} // void stat_unopened_directory()
+
+// The distributed spider ships the results of scan_directory_level()
+// from a worker rank back to rank 0 as text lines, one per entry: 
+// AAA \t T \t TGT \t SZ \t MODE \t UID \t GID \t MTIME \t DEV \t INO \n
+// which are the first four columns of the archive catalog line plus
+// the metadata captured by the scan.  DEV and INO are zero unless
+// the entry is a file with more than one name.  The first line is the scanned
+// directory itself (so rank 0 gets its metadata); the subdirectory
+// lines carry no metadata since those get filled in when they
+// are scanned in turn.  
+void Parfu_storage_entry::append_spider_line(string *out_string){
+  out_string->append(relative_path);
+  *out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  *out_string += type_char();
+  *out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  out_string->append(symlink_target);
+  *out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  out_string->append(to_string(file_size));
+  *out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  out_string->append(to_string(entry_mode));
+  *out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  out_string->append(to_string(entry_uid));
+  *out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  out_string->append(to_string(entry_gid));
+  *out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  out_string->append(to_string(entry_mtime));
+  *out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  out_string->append(to_string(entry_dev));
+  *out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  out_string->append(to_string(entry_ino));
+  *out_string += PARFU_LINE_SEPARATOR_CHARACTER;
+}
 
-  // Possibly in the
-  // future, here we'll make calls to other ranks
-  // to do this, although we'll have to be very
-  // careful not to make a giant mess.
-  
-  for(std::size_t subdir_index=0;subdir_index < subdirectories.size();subdir_index++){
-    // fire off the spider function of each subdirectory in turn
-    Parfu_directory *local_subdir;
-    local_subdir=subdirectories[subdir_index];
-    local_subdir->spider_directory();
+// pull the metadata columns (MODE UID GID MTIME DEV INO) out of a
+// spider line starting at position entry_begin 
+void Parfu_storage_entry::set_metadata_from_spider_line(string spider_line,
+							size_t entry_begin){
+  size_t entry_end;
+  entry_end = spider_line.find(PARFU_ENTRY_SEPARATOR_CHARACTER,entry_begin);
+  entry_mode = stoul(spider_line.substr(entry_begin,entry_end-entry_begin));
+  entry_begin = entry_end + 1;
+  entry_end = spider_line.find(PARFU_ENTRY_SEPARATOR_CHARACTER,entry_begin);
+  entry_uid = stoul(spider_line.substr(entry_begin,entry_end-entry_begin));
+  entry_begin = entry_end + 1;
+  entry_end = spider_line.find(PARFU_ENTRY_SEPARATOR_CHARACTER,entry_begin);
+  entry_gid = stoul(spider_line.substr(entry_begin,entry_end-entry_begin));
+  entry_begin = entry_end + 1;
+  entry_end = spider_line.find(PARFU_ENTRY_SEPARATOR_CHARACTER,entry_begin);
+  entry_mtime = stol(spider_line.substr(entry_begin,entry_end-entry_begin));
+  entry_begin = entry_end + 1;
+  entry_end = spider_line.find(PARFU_ENTRY_SEPARATOR_CHARACTER,entry_begin);
+  entry_dev = stoul(spider_line.substr(entry_begin,entry_end-entry_begin));
+  entry_begin = entry_end + 1;
+  entry_ino = stoul(spider_line.substr(entry_begin));
+}
+
+string Parfu_directory::spider_batch_lines(void){
+  string out_string;
+
+  this->append_spider_line(&out_string);
+  for(std::size_t ndx=0; ndx < subdirectories.size(); ndx++){
+    subdirectories[ndx]->append_spider_line(&out_string);
   }
-  
-  spidered=true;
-  return total_entries_found;
-} // long int spider_directory()
+  for(std::size_t ndx=0; ndx < subfiles.size(); ndx++){
+    subfiles[ndx]->append_spider_line(&out_string);
+  }
+  return out_string;
+}
+
+// take one line generated by spider_batch_lines() (without its
+// trailing line separator) and add the entry it describes to this
+// directory.  If the entry is a subdirectory, the new (not yet
+// spidered) Parfu_directory is returned so the caller can queue it;
+// otherwise this returns nullptr.
+Parfu_directory* Parfu_directory::add_entry_from_spider_line(string spider_line){
+  size_t entry_begin,entry_end;
+  string entry_relative_name;
+  string link_target;
+  char type_char;
+  long int entry_size;
+  Parfu_target_file *new_file_ptr=nullptr;
+
+  entry_begin = 0;
+  entry_end = spider_line.find(PARFU_ENTRY_SEPARATOR_CHARACTER,entry_begin);
+  if(entry_end == string::npos){
+    cerr << "add_entry_from_spider_line: bad line >" << spider_line << "<\n";
+    return nullptr;
+  }
+  entry_relative_name = spider_line.substr(entry_begin,entry_end-entry_begin);
+  entry_begin = entry_end + 1;
+  type_char = spider_line.at(entry_begin);
+  entry_begin += 2;
+  entry_end = spider_line.find(PARFU_ENTRY_SEPARATOR_CHARACTER,entry_begin);
+  link_target = spider_line.substr(entry_begin,entry_end-entry_begin);
+  entry_begin = entry_end + 1;
+  entry_end = spider_line.find(PARFU_ENTRY_SEPARATOR_CHARACTER,entry_begin);
+  entry_size = stol(spider_line.substr(entry_begin,entry_end-entry_begin));
+  entry_begin = entry_end + 1;
+
+  switch(type_char){
+  case PARFU_FILE_TYPE_DIRECTORY_CHAR:
+    Parfu_directory *new_subdir_ptr;
+    new_subdir_ptr = new Parfu_directory(base_path,entry_relative_name);
+    new_subdir_ptr->file_size = 0L;
+    subdirectories.push_back(new_subdir_ptr);
+    return new_subdir_ptr;
+  case PARFU_FILE_TYPE_REGULAR_CHAR:
+    new_file_ptr = new Parfu_target_file(base_path,entry_relative_name,
+					 PARFU_FILE_TYPE_REGULAR,entry_size);
+    break;
+  case PARFU_FILE_TYPE_SYMLINK_CHAR:
+    new_file_ptr = new Parfu_target_file(base_path,entry_relative_name,
+					 PARFU_FILE_TYPE_SYMLINK,0,link_target);
+    break;
+  default:
+    cerr << "add_entry_from_spider_line: unknown type >" << type_char << "<\n";
+    return nullptr;
+  }
+  new_file_ptr->set_metadata_from_spider_line(spider_line,entry_begin);
+  subfiles.push_back(new_file_ptr);
+  return nullptr;
+}
+
+// the first line of a spider batch is the scanned directory itself;
+// this takes the metadata from that line.
+void Parfu_directory::set_own_metadata_from_spider_line(string spider_line){
+  size_t entry_begin=0;
+  // skip the first four columns
+  for(int i=0; i<4; i++){
+    entry_begin = spider_line.find(PARFU_ENTRY_SEPARATOR_CHARACTER,entry_begin) + 1;
+  }
+  set_metadata_from_spider_line(spider_line,entry_begin);
+}
+
+// frees the entries created by scan_directory_level().  Used by
+// worker ranks in the distributed spider once they've shipped the
+// entries back to rank 0.  
+void Parfu_directory::release_entries(void){
+  for(std::size_t ndx=0; ndx < subdirectories.size(); ndx++){
+    delete subdirectories[ndx];
+  }
+  subdirectories.clear();
+  for(std::size_t ndx=0; ndx < subfiles.size(); ndx++){
+    delete subfiles[ndx];
+  }
+  subfiles.clear();
+}
 
 Parfu_target_collection::Parfu_target_collection(Parfu_directory *in_directory){
   // take a directory tree, presumably a root of a collection of files,
@@ -523,6 +814,12 @@ Parfu_target_collection::Parfu_target_collection(Parfu_directory *in_directory){
 
   // Now walk through the directories again, and this time, pull in all the
   // files and sylinks in each directory and add them to our subfiles list.
+  //
+  // A file with several names in the tree is only stored under the
+  // first name we come to.  The rest become hard links to that name,
+  // with no data, so it's only read and stored once.
+  map <pair <dev_t,ino_t>,Parfu_storage_entry*> first_names;
+  unsigned long n_hardlinks=0;
 
   for(unsigned int myiter = 0 ; myiter < directories.size(); myiter++ ){
     Parfu_storage_entry *loop_dir_ptr = directories.at(myiter).storage_ptr;
@@ -535,9 +832,24 @@ Parfu_target_collection::Parfu_target_collection(Parfu_directory *in_directory){
       //      cerr << "one file\n";
       my_ref.storage_ptr =
 	loop_dir_ptr->nth_subfile(file_ndx);
+      if(my_ref.storage_ptr->entry_ino){
+	auto first_name =
+	  first_names.insert(make_pair(make_pair(my_ref.storage_ptr->entry_dev,
+						 my_ref.storage_ptr->entry_ino),
+				       my_ref.storage_ptr));
+	if(!first_name.second){
+	  my_ref.storage_ptr->entry_type_value = PARFU_FILE_TYPE_HARDLINK;
+	  my_ref.storage_ptr->symlink_target = first_name.first->second->relative_path;
+	  my_ref.storage_ptr->file_size = 0L;
+	  n_hardlinks++;
+	}
+      }
       my_slice.header_size_this_slice =
 	my_ref.storage_ptr->header_size();
-      if(my_ref.storage_ptr->is_symlink()){
+      if(my_ref.storage_ptr->entry_type() == PARFU_FILE_TYPE_HARDLINK){
+	my_ref.order_size=PARFU_FILE_SIZE_HARDLINK;
+      }
+      else if(my_ref.storage_ptr->is_symlink()){
 	my_ref.order_size=PARFU_FILE_SIZE_SYMLINK;
       }
       else{
@@ -546,7 +858,66 @@ Parfu_target_collection::Parfu_target_collection(Parfu_directory *in_directory){
       files.push_back(my_ref);
     } // for(std::size_t file_ndx=0; 
   } // for(unsigned int myiter = 0 ;
-    
+  if(n_hardlinks){
+    cerr << n_hardlinks << " files are other names for files already in the";
+    cerr << " archive; storing them as hard links.\n";
+  }
+}
+
+string Parfu_target_collection::duplicate_candidates(void){
+  vector <unsigned long> regular_files;
+  string out_string;
+
+  for(unsigned long ndx=0; ndx<files.size(); ndx++){
+    if(files.at(ndx).storage_ptr->entry_type() == PARFU_FILE_TYPE_REGULAR &&
+       files.at(ndx).storage_ptr->file_size > 0){
+      regular_files.push_back(ndx);
+    }
+  }
+  // stable, so the first of any set of duplicates in the spider's
+  // order is the one that gets stored
+  stable_sort(regular_files.begin(),regular_files.end(),
+	      [this](unsigned long a, unsigned long b){
+		return files.at(a).storage_ptr->file_size <
+		  files.at(b).storage_ptr->file_size;
+	      });
+  for(unsigned long first=0; first<regular_files.size(); ){
+    long int size = files.at(regular_files.at(first)).storage_ptr->file_size;
+    unsigned long last=first+1;
+    while(last < regular_files.size() &&
+	  files.at(regular_files.at(last)).storage_ptr->file_size == size){
+      last++;
+    }
+    if(last-first > 1){
+      for(unsigned long ndx=first; ndx<last; ndx++){
+	out_string.append(to_string(regular_files.at(ndx)));
+	out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+	out_string.append(to_string(size));
+	out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+	out_string.append(files.at(regular_files.at(ndx)).storage_ptr->absolute_path());
+	out_string += '\0';
+      }
+    }
+    first = last;
+  }
+  return out_string;
+}
+
+unsigned long Parfu_target_collection::mark_duplicates(const vector <unsigned long> &matches){
+  unsigned long n_duplicates=0;
+
+  for(unsigned long ndx=0; ndx+1<matches.size(); ndx+=2){
+    Parfu_storage_reference *duplicate = &(files.at(matches.at(ndx)));
+    Parfu_storage_entry *original = files.at(matches.at(ndx+1)).storage_ptr;
+    duplicate->storage_ptr->entry_type_value = PARFU_FILE_TYPE_DUPLICATE;
+    duplicate->storage_ptr->symlink_target = original->relative_path;
+    duplicate->storage_ptr->file_size = 0L;
+    // the header now has a link name in it
+    duplicate->storage_ptr->tar_header_size = -1;
+    duplicate->order_size = PARFU_FILE_SIZE_DUPLICATE;
+    n_duplicates++;
+  }
+  return n_duplicates;
 }
 
 void Parfu_target_collection::dump(void){
@@ -616,9 +987,11 @@ long unsigned int parfu_next_block_boundary(long unsigned int first_available){
 
 
 
-void Parfu_target_collection::set_offsets(){
+void Parfu_target_collection::set_offsets(unsigned long start_offset){
   // After this fuction this collection will have valid
   // offsets all the way through it.  The files aren't sub-divded, though. 
+  // The first entry starts at start_offset, which is the end of the
+  // catalog region at the front of the archive.  
   long unsigned int working_offset = 0L;
   long int my_file_size;
   long unsigned int total_extent; // length of header plus file payload
@@ -640,9 +1013,9 @@ void Parfu_target_collection::set_offsets(){
 
   // every entry has an empty vector of slices; all offsets are gone
   // now we walk the collection from the beginning, starting with
-  // offset zero
+  // the beginning of the data area
 
-  working_offset = 0L;
+  working_offset = parfu_next_block_boundary(start_offset);
   // first directories
   for(std::size_t ndx=0; ndx < directories.size(); ndx++){
     my_header_size = directories.at(ndx).storage_ptr->header_size();
@@ -680,6 +1053,31 @@ void Parfu_target_collection::set_offsets(){
   }  
 }
 
+// A collection that only holds some of an archive's entries (a
+// selective extract) has holes in it.  A small hole gets read
+// through, as part of the current bucket; anything bigger starts a
+// new bucket at the next entry, so that range never gets read at all.
+static void parfu_skip_archive_gap(vector <vector <parfu_move_order_t>> *bucket_orders,
+				   unsigned *orders_in_bundle,
+				   long unsigned int *position_in_bucket,
+				   long unsigned int *position_in_archive,
+				   long unsigned int entry_offset){
+  long unsigned int gap = entry_offset - *position_in_archive;
+  *position_in_archive = entry_offset;
+  if(bucket_orders->back().size() == 0){
+    *position_in_bucket = 0UL;
+    return;
+  }
+  if(gap <= PARFU_MAX_READ_THROUGH_GAP){
+    *position_in_bucket += gap;
+  }
+  else{
+    bucket_orders->push_back(vector <parfu_move_order_t>());
+    *orders_in_bundle = 0;
+    *position_in_bucket = 0UL;
+  }
+}
+
 vector <string> *Parfu_target_collection::create_transfer_orders(int archive_file_index,
 								 long unsigned int bucket_size,
 								 unsigned int max_orders_per_bundle){
@@ -687,6 +1085,9 @@ vector <string> *Parfu_target_collection::create_transfer_orders(int archive_fil
   // (essentially just a series of buffers that will be sent
   // via MPI but managed by string classes)
   vector <string> *trans_orders = new vector <string>;
+  // the orders for each bucket, which get packed into the
+  // binary wire format (one string per bucket) at the very end
+  vector <vector <parfu_move_order_t>> bucket_orders;
   // endpoint is one byte past the last byte the archive file should occupy
   long unsigned int endpoint;
   long unsigned int position_in_archive;
@@ -696,6 +1097,7 @@ vector <string> *Parfu_target_collection::create_transfer_orders(int archive_fil
   long unsigned int next_position_in_bucket;
   long unsigned int total_extent;
   long unsigned int position_jump;
+  long unsigned int entry_offset;
   Parfu_file_slice last_slice;
   bool limit_orders_by_number;
   unsigned orders_in_bundle;
@@ -736,12 +1138,18 @@ vector <string> *Parfu_target_collection::create_transfer_orders(int archive_fil
   // endpoint is now one byte past where we should end
   // we use it as a signpost to tell when we're done
 
-  // we start by loading the tranfer orders vector with an empty buffer
-  trans_orders->push_back(string(""));
+  // we start by loading the tranfer orders vector with an empty bucket
+  bucket_orders.push_back(vector <parfu_move_order_t>());
   orders_in_bundle=0;
   // Our virtual position in the archive file starts at the
-  // beginning of the data area
-  position_in_archive = 0UL;
+  // beginning of the data area, which is where set_offsets() put
+  // the first entry
+  if(directories.size() > 0){
+    position_in_archive = directories.front().slices.front().slice_offset_in_container;
+  }
+  else{
+    position_in_archive = files.front().slices.front().slice_offset_in_container;
+  }
   // We start our position in the virtual buck likewise
   // at its beginning
   position_in_bucket = 0UL;
@@ -752,6 +1160,12 @@ vector <string> *Parfu_target_collection::create_transfer_orders(int archive_fil
     Parfu_storage_entry *mydir = directories.at(ndx).storage_ptr;
     //    Parfu_file_slice *myslice = &(directories.at(ndx).slices.back());
     //    unsigned long int position_in_file=0UL;
+    entry_offset = directories.at(ndx).slices.front().slice_offset_in_container;
+    if(entry_offset != position_in_archive){
+      parfu_skip_archive_gap(&bucket_orders,&orders_in_bundle,
+			     &position_in_bucket,&position_in_archive,
+			     entry_offset);
+    }
     total_extent = mydir->header_size();
     position_jump = parfu_next_block_boundary(total_extent);
     next_position_in_bucket = position_in_bucket + position_jump;
@@ -768,7 +1182,7 @@ vector <string> *Parfu_target_collection::create_transfer_orders(int archive_fil
 	// it spills off the end, so we jump to the
 	// next bucket.  We load a new empty buffer,
 	// leaving the other one complete
-	trans_orders->push_back(string(""));
+	bucket_orders.push_back(vector <parfu_move_order_t>());
 	orders_in_bundle=0;
 	// back to the beginning of the bucket
 	position_in_bucket = 0UL;
@@ -781,7 +1195,7 @@ vector <string> *Parfu_target_collection::create_transfer_orders(int archive_fil
 	}
       }
       // whatever bucket we're in, this file will fit in it
-      trans_orders->back().append(print_marching_order(archive_file_index,
+      bucket_orders.back().push_back(marching_order(archive_file_index,
 						       directories.at(ndx)));
       orders_in_bundle++;
       position_in_bucket = next_position_in_bucket;
@@ -800,6 +1214,12 @@ vector <string> *Parfu_target_collection::create_transfer_orders(int archive_fil
   for(unsigned int ndx=0 ; ndx < files.size() ; ndx++){
     Parfu_storage_entry *myfile = files.at(ndx).storage_ptr;
     //    Parfu_file_slice *myslice = &(directories.at(ndx).slices.back());
+    entry_offset = files.at(ndx).slices.front().slice_offset_in_container;
+    if(entry_offset != position_in_archive){
+      parfu_skip_archive_gap(&bucket_orders,&orders_in_bundle,
+			     &position_in_bucket,&position_in_archive,
+			     entry_offset);
+    }
     total_extent = myfile->header_size() + myfile->file_size;
     // position_jump is the next position in the archive file
     // we will write, given the block structure of tarfiles
@@ -818,7 +1238,7 @@ vector <string> *Parfu_target_collection::create_transfer_orders(int archive_fil
 	// due to others in bucket,
 	// (or if we've hit the "max orders per bucket" limit)
 	// jump to next bucket
-	trans_orders->push_back(string(""));
+	bucket_orders.push_back(vector <parfu_move_order_t>());
 	orders_in_bundle=0;
 	// back to the beginning of the bucket
 	position_in_bucket = 0UL;
@@ -832,7 +1252,7 @@ vector <string> *Parfu_target_collection::create_transfer_orders(int archive_fil
       }
       // whatever bucket we're in, this file will fit in it
       //      cerr << "check before call: " << files.at(ndx).slices.front().header_size_this_slice << "\n";
-      trans_orders->back().append(print_marching_order(archive_file_index,
+      bucket_orders.back().push_back(marching_order(archive_file_index,
 						       files.at(ndx)));
       orders_in_bundle++;
       if (files.at(ndx).slices.front().slice_offset_in_container !=
@@ -852,8 +1272,8 @@ vector <string> *Parfu_target_collection::create_transfer_orders(int archive_fil
       // start by jumping to the next bucket no matter what
       unsigned long int position_in_file=0UL;
       unsigned long int extent_remaining;
-      if(trans_orders->back().size()>0){
-	trans_orders->push_back(string(""));
+      if(bucket_orders.back().size()>0){
+	bucket_orders.push_back(vector <parfu_move_order_t>());
 	orders_in_bundle=0;
       }
       extent_remaining = total_extent;
@@ -871,7 +1291,7 @@ vector <string> *Parfu_target_collection::create_transfer_orders(int archive_fil
       // note that it contains the correct, non-zero header size
       // to indicate to the receiving rank that this entry is to
       // have the header placed before it.
-      trans_orders->back().append(print_marching_order_raw(archive_file_index,
+      bucket_orders.back().push_back(marching_order_raw(archive_file_index,
 							   files.at(ndx),
 							   bucket_size-files.at(ndx).storage_ptr->header_size(),
 							   files.at(ndx).storage_ptr->header_size(),
@@ -887,10 +1307,10 @@ vector <string> *Parfu_target_collection::create_transfer_orders(int archive_fil
 	// exactly one bucket or less is left to transfer
 
 	// print the orders for this full bucket
-	trans_orders->push_back(string(""));
+	bucket_orders.push_back(vector <parfu_move_order_t>());
 	orders_in_bundle=0;
 
-	trans_orders->back().append(print_marching_order_raw(archive_file_index,
+	bucket_orders.back().push_back(marching_order_raw(archive_file_index,
 							     files.at(ndx),
 							     bucket_size, // full bucket
 							     0,   // header zero because header would have
@@ -907,9 +1327,9 @@ vector <string> *Parfu_target_collection::create_transfer_orders(int archive_fil
       // a bucket (possibly zero if the file extent (file itself plus its
       // header) is exactly a multiple of bucket size)
       if(extent_remaining > 0){
-	trans_orders->push_back(string(""));
+	bucket_orders.push_back(vector <parfu_move_order_t>());
 	orders_in_bundle=0;
-	trans_orders->back().append(print_marching_order_raw(archive_file_index,
+	bucket_orders.back().push_back(marching_order_raw(archive_file_index,
 							     files.at(ndx),
 							     extent_remaining, // just the remainder
 							     0,   // header zero because header would have
@@ -922,53 +1342,118 @@ vector <string> *Parfu_target_collection::create_transfer_orders(int archive_fil
 	// the main archive position to the next tar-compatible block position
 	position_in_archive += extent_remaining;
 	position_in_archive = parfu_next_block_boundary(position_in_archive);
+	// and the remainder is what's in the current bucket so far
+	position_in_bucket = parfu_next_block_boundary(extent_remaining);
       } // if(extent_remaining > 0)
+      else{
+	// the last piece filled its bucket exactly
+	position_in_bucket = bucket_size;
+      }
       
     } // else (if the file extent is bigger than a bucket
 
   } // for( ndx over files
+
+  for(unsigned int ndx=0 ; ndx < bucket_orders.size() ; ndx++){
+    trans_orders->push_back(parfu_encode_order_set(bucket_orders.at(ndx)));
+  }
   
   return trans_orders;
 }
 
-string Parfu_target_collection::print_marching_order(int file_index,
-						     Parfu_storage_reference myref){
+parfu_move_order_t Parfu_target_collection::marching_order(int file_index,
+							   Parfu_storage_reference myref){
   //  cerr << "debug: " << myref.slices.front().header_size_this_slice << "\n";
-  return print_marching_order_raw(file_index,
-				  myref,
-				  myref.slices.front().slice_size,
-				  myref.slices.front().header_size_this_slice,
-				  myref.slices.front().slice_offset_in_container,
-				  myref.slices.front().slice_offset_in_file);
+  return marching_order_raw(file_index,
+			    myref,
+			    myref.slices.front().slice_size,
+			    myref.slices.front().header_size_this_slice,
+			    myref.slices.front().slice_offset_in_container,
+			    myref.slices.front().slice_offset_in_file);
 }
 
-string Parfu_target_collection::print_marching_order_raw(int file_index,
-							 Parfu_storage_reference myref,
-							 unsigned long mysize,
-							 unsigned int my_header_size,
-							 unsigned long my_container_offset,
-							 unsigned long my_file_offset){
-  string out_string;
-  string type_string;
+parfu_move_order_t Parfu_target_collection::marching_order_raw(int file_index,
+							       Parfu_storage_reference myref,
+							       unsigned long mysize,
+							       unsigned int my_header_size,
+							       unsigned long my_container_offset,
+							       unsigned long my_file_offset){
+  parfu_move_order_t out_order;
   
-  out_string.append(to_string(file_index));
-  out_string.append("\t");
-  out_string.append(myref.storage_ptr->relative_path);
-  out_string.append("\t");
-  type_string = myref.storage_ptr->type_char();
-  out_string.append(type_string);
-  out_string.append("\t");
-  out_string.append(myref.storage_ptr->symlink_target);     
-  out_string.append("\t");
-  out_string.append(to_string(mysize));
-  out_string.append("\t");
-  out_string.append(to_string(my_header_size));
-  out_string.append("\t");
-  out_string.append(to_string(my_container_offset));
-  out_string.append("\t");
-  out_string.append(to_string(my_file_offset));
-  out_string.append("\n");
+  out_order.file_index = file_index;
+  out_order.rel_filename = myref.storage_ptr->relative_path;
+  out_order.file_type = myref.storage_ptr->type_char();
+  out_order.symlink_target = myref.storage_ptr->symlink_target;
+  out_order.file_size = mysize;
+  out_order.header_size = my_header_size;
+  out_order.position_in_archive = my_container_offset;
+  out_order.offset_in_file = my_file_offset;
+  out_order.mode = myref.storage_ptr->entry_mode;
+  out_order.uid = myref.storage_ptr->entry_uid;
+  out_order.gid = myref.storage_ptr->entry_gid;
+  out_order.mtime = myref.storage_ptr->entry_mtime;
+  out_order.total_file_size = myref.storage_ptr->file_size;
+
+  return out_order;
+}
 
+
+// Every tar header has the owner's user and group *names* in it.  So
+// that the worker ranks never have to ask NSS (which on most clusters
+// means LDAP or SSSD over the network) for them, rank 0 looks up each
+// distinct uid and gid in the collection once and sends the whole table
+// out in one broadcast.  The table is text lines:
+// U \t UID \t NAME \n   or   G \t GID \t NAME \n
+string Parfu_target_collection::owner_name_table(void){
+  map <uid_t,bool> uids_seen;
+  map <gid_t,bool> gids_seen;
+  string out_string;
+  
+  for(std::size_t ndx=0; ndx < directories.size(); ndx++){
+    uids_seen[directories.at(ndx).storage_ptr->entry_uid] = true;
+    gids_seen[directories.at(ndx).storage_ptr->entry_gid] = true;
+  }
+  for(std::size_t ndx=0; ndx < files.size(); ndx++){
+    uids_seen[files.at(ndx).storage_ptr->entry_uid] = true;
+    gids_seen[files.at(ndx).storage_ptr->entry_gid] = true;
+  }
+  for(auto uid_iter=uids_seen.begin(); uid_iter != uids_seen.end(); uid_iter++){
+    out_string += 'U';
+    out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+    out_string.append(to_string(uid_iter->first));
+    out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+    out_string.append(tarentry::user_name(uid_iter->first));
+    out_string += PARFU_LINE_SEPARATOR_CHARACTER;
+  }
+  for(auto gid_iter=gids_seen.begin(); gid_iter != gids_seen.end(); gid_iter++){
+    out_string += 'G';
+    out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+    out_string.append(to_string(gid_iter->first));
+    out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+    out_string.append(tarentry::group_name(gid_iter->first));
+    out_string += PARFU_LINE_SEPARATOR_CHARACTER;
+  }
   return out_string;
 }
 
+// load a table made by owner_name_table() into this rank's name cache
+void parfu_load_owner_name_table(string name_table){
+  size_t line_begin=0,line_end;
+  size_t entry_begin,entry_end;
+  unsigned long id;
+  
+  while((line_end=name_table.find(PARFU_LINE_SEPARATOR_CHARACTER,line_begin))
+	!= string::npos){
+    entry_begin = line_begin + 2;
+    entry_end = name_table.find(PARFU_ENTRY_SEPARATOR_CHARACTER,entry_begin);
+    id = stoul(name_table.substr(entry_begin,entry_end-entry_begin));
+    entry_begin = entry_end + 1;
+    if(name_table.at(line_begin) == 'U'){
+      tarentry::add_user_name(id,name_table.substr(entry_begin,line_end-entry_begin));
+    }
+    else{
+      tarentry::add_group_name(id,name_table.substr(entry_begin,line_end-entry_begin));
+    }
+    line_begin = line_end + 1;
+  }
+}
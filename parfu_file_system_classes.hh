@@ -31,6 +31,9 @@
 #define PARFU_FILE_SYSTEM_CLASSES_HH_
 
 using namespace std;
+
+#include "parfu_rank_move_data.hh"
+#include "parfu_checksum.hh"
 //using namespace filesystem;
 //namespace fs = std::filesystem;
 
@@ -65,6 +68,17 @@ using namespace std;
 ////////////////////
 
 long unsigned int parfu_next_block_boundary(long unsigned int first_available);
+string parfu_read_archive_catalog(string archive_file_name);
+string parfu_catalog_header(unsigned long body_size,
+			    unsigned long total_entries);
+// appends one metadata member (header, contents, padding) to out_string
+void parfu_append_metadata_member(string *out_string,
+				  const char *member_name,
+				  const string &member_contents);
+string parfu_index_foreign_tar(string archive_file_name,
+			       int my_rank, int total_ranks);
+bool parfu_path_selected(const string &path, const vector <string> &patterns);
+void parfu_load_owner_name_table(string name_table);
 
 ////////////
 // 
@@ -88,6 +102,7 @@ class Parfu_file_slice;
 class Parfu_container_file;
 class Parfu_directory;
 class Parfu_target_file;
+class Parfu_archive_index;
 
 ////////////////
 //
@@ -98,13 +113,18 @@ class Parfu_target_file;
 class Parfu_storage_entry
 {
 public:
+  virtual ~Parfu_storage_entry(void){
+  }
   string absolute_path(){
     return base_path+"/"+relative_path;
   }
+  string get_relative_path(void){
+    return relative_path;
+  }
   bool are_locations_set(void){
     return are_locations_filled_out;
   }
-  string generate_archive_catalog_line(void);
+  string generate_archive_catalog_line(unsigned long location_in_archive);
   string generate_full_catalog_line(void);
   int header_size(void);
   int entry_type(){
@@ -130,6 +150,31 @@ public:
     return false;
   }
   char type_char(void);
+  void append_spider_line(string *out_string);
+  void set_metadata_from_spider_line(string spider_line,
+				     size_t entry_begin);
+  void set_metadata(const struct stat &in_stat){
+    entry_mode = in_stat.st_mode;
+    entry_uid = in_stat.st_uid;
+    entry_gid = in_stat.st_gid;
+    entry_mtime = in_stat.st_mtime;
+    // only files with more than one name can be hard links
+    if(S_ISREG(in_stat.st_mode) && in_stat.st_nlink > 1){
+      entry_dev = in_stat.st_dev;
+      entry_ino = in_stat.st_ino;
+    }
+  }
+  // CRC32C of the payload (see parfu_checksum.hh), if we know it
+  bool has_checksum(void){
+    return checksum_known;
+  }
+  uint32_t checksum(void){
+    return payload_checksum;
+  }
+  void set_checksum(uint32_t in_checksum){
+    payload_checksum = in_checksum;
+    checksum_known = true;
+  }
   
 private:
   // allow derived classes to initialize variables
@@ -172,6 +217,24 @@ private:
   // Size of the file in bytes
   long int file_size=0L;
 
+  // Metadata captured (once) when the entry is spidered.  These travel
+  // with the entry in the transfer orders so that the rank that writes
+  // the tar header never has to stat() the file again.  
+  mode_t entry_mode=0;
+  uid_t entry_uid=0;
+  gid_t entry_gid=0;
+  time_t entry_mtime=0;
+  // the file's inode, if it has other names that might be in the
+  // archive too; zero otherwise.  Later names for the same inode are
+  // stored as hard links to the first.
+  dev_t entry_dev=0;
+  ino_t entry_ino=0;
+
+  // filled in from the slice checksums after the data has moved, or
+  // from the catalog in extract mode
+  uint32_t payload_checksum=0;
+  bool checksum_known=false;
+
   // Entry type.  Regular file, symlink, directory, etc.  
   int entry_type_value=PARFU_FILE_TYPE_INVALID;
 
@@ -217,6 +280,12 @@ public:
     tar_header_size = in_file.tar_header_size;
     entry_type_value = in_file.entry_type_value;
     symlink_target = in_file.symlink_target;
+    entry_mode = in_file.entry_mode;
+    entry_uid = in_file.entry_uid;
+    entry_gid = in_file.entry_gid;
+    entry_mtime = in_file.entry_mtime;
+    entry_dev = in_file.entry_dev;
+    entry_ino = in_file.entry_ino;
   }
   // assignment operator
   Parfu_target_file& operator=(const Parfu_target_file &in_file){
@@ -228,6 +297,12 @@ public:
     tar_header_size = in_file.tar_header_size;
     entry_type_value = in_file.entry_type_value;
     symlink_target = in_file.symlink_target;    
+    entry_mode = in_file.entry_mode;
+    entry_uid = in_file.entry_uid;
+    entry_gid = in_file.entry_gid;
+    entry_mtime = in_file.entry_mtime;
+    entry_dev = in_file.entry_dev;
+    entry_ino = in_file.entry_ino;
     return *this;
   }
   // destructor
@@ -244,7 +319,8 @@ public:
   //			 long int slice_size);
   //  long int offset_in_container(void);
   virtual bool is_symlink(void){
-    if(symlink_target.size() > 0)
+    if(entry_type_value == PARFU_FILE_TYPE_SYMLINK &&
+       symlink_target.size() > 0)
       return true;
     else
       return false;
@@ -311,6 +387,18 @@ public:
   // destructor
   ~Parfu_file_slice(void){
     
+  }
+  unsigned long int offset_in_container(void){
+    return slice_offset_in_container;
+  }
+  long int offset_in_file(void){
+    return slice_offset_in_file;
+  }
+  long int size(void){
+    return slice_size;
+  }
+  int header_size(void){
+    return header_size_this_slice;
   }
   Parfu_storage_entry *parent_file=nullptr;
 private:
@@ -396,6 +484,23 @@ public:
     return spidered;
   }
   long int spider_directory(void);
+  long int scan_directory_level(void);
+  long int scan_open_directory(DIR *my_dir);
+  void stat_unopened_directory(int parent_fd, const char *name);
+  long int spider_directory_threaded(unsigned int n_threads);
+  string spider_batch_lines(void);
+  Parfu_directory* add_entry_from_spider_line(string spider_line);
+  void set_own_metadata_from_spider_line(string spider_line);
+  void release_entries(void);
+  void set_spidered(void){
+    spidered=true;
+  }
+  string get_relative_path(void){
+    return relative_path;
+  }
+  string get_base_path(void){
+    return base_path;
+  }
   // copy constructor
   Parfu_directory(const Parfu_directory &in_dir){
     base_path = in_dir.base_path;
@@ -533,22 +638,89 @@ public:
   // destructor
   ~Parfu_target_collection(void){
   }
+  // build a collection back out of an archive's catalog (the text
+  // from parfu_read_archive_catalog()).  Every entry gets one slice
+  // that gives its location in the archive.  
+  Parfu_target_collection(const string &catalog_text);
+  // the same, from the archive's binary index, but only with the
+  // entries the patterns pick out, none of which may have glob
+  // characters (see select_entries()).  Only the index entries that
+  // get used are read.
+  Parfu_target_collection(Parfu_archive_index *archive_index,
+			  const vector <string> &patterns);
+  // dedup=on.  The regular files that might have the same contents
+  // as another, that is, that aren't the only one of their size, in
+  // order of size: for each, the index, size and absolute path,
+  // tab-separated, and the path ended by a null.  Empty if there
+  // aren't any.
+  string duplicate_candidates(void);
+  // turn files into duplicates of others, from pairs of indices
+  // (duplicate, original) as from parfu_find_duplicate_files().  Must
+  // come before order_files().  Returns the number of duplicates.
+  unsigned long mark_duplicates(const vector <unsigned long> &matches);
   void order_files(void);
-  void set_offsets();
+  // lay out the entries starting at start_offset in the archive,
+  // which is normally catalog_region_size()
+  void set_offsets(unsigned long start_offset=0UL);
   void dump_offsets(void);
   vector <string> *create_transfer_orders(int archive_file_index,
 					  long unsigned int bucket_size,
 					  unsigned int max_orders_per_bundle);
-  string print_marching_order(int file_index,
-			      Parfu_storage_reference myref);
-  string print_marching_order_raw(int file_index,
-				  Parfu_storage_reference myref,
-				  unsigned long mysize,
-				  unsigned int my_header_size,
-				  unsigned long my_container_offset,
-				  unsigned long my_file_offset);
+  string owner_name_table(void);
+  // the catalog text (header plus one line per entry), generated
+  // with n_threads threads (0 means one per core)
+  string archive_catalog(unsigned n_threads=0);
+  // size of the catalog's tar entry (header, catalog, padding) at the
+  // front of the archive, plus the binary index entry after it if
+  // with_index; this is where the data area starts
+  unsigned long catalog_region_size(bool with_index=true);
+  // the whole catalog tar entry (and index entry), ready to write at
+  // offset 0.  Only valid after set_offsets(catalog_region_size()).
+  string catalog_region(bool with_index=true);
+  // drop every entry that doesn't match one of the patterns (see
+  // parfu_path_selected()), except what a selected hard link or
+  // duplicate needs its data from.  Returns the number of entries left.
+  // Only for collections built from a catalog, since the entries
+  // that get dropped are deleted.
+  unsigned long select_entries(const vector <string> &patterns);
+  // the binary path index (see parfu_archive_index.hh) and its size
+  unsigned long archive_index_size(void);
+  string archive_index(void);
+  // Combine the slice checksums from parfu_gather_slice_checksums()
+  // into a checksum for each regular file.  Only valid after
+  // set_offsets().  Returns the number of files that got one.
+  // *n_unreadable is how many files had slices that couldn't be read
+  // (see fill_bucket_Create()); those get no checksum.
+  unsigned long set_checksums(vector <parfu_slice_checksum_t> *slices,
+			      unsigned long *n_unreadable);
+  // Verify mode: combine the slice checksums the same way and check
+  // every member against the catalog CRC32C and the flags the ranks
+  // set (see verify_bucket()); a hard link or duplicate's source is
+  // checked against the file it refers to.  Each bad member is
+  // reported on stdout.  Returns how many there were.
+  unsigned long verify_checksums(vector <parfu_slice_checksum_t> *slices);
+  unsigned long n_entries(void){
+    return directories.size()+files.size();
+  }
+  Parfu_storage_reference *entry(unsigned long entry_index){
+    if(entry_index < directories.size()){
+      return &(directories.at(entry_index));
+    }
+    return &(files.at(entry_index-directories.size()));
+  }
+  parfu_move_order_t marching_order(int file_index,
+				    Parfu_storage_reference myref);
+  parfu_move_order_t marching_order_raw(int file_index,
+					Parfu_storage_reference myref,
+					unsigned long mysize,
+					unsigned int my_header_size,
+					unsigned long my_container_offset,
+					unsigned long my_file_offset);
     
 private:
+  // one line of an archive catalog, as an entry with its location
+  // in the archive.  Returns false for a line that isn't an entry.
+  bool add_catalog_line(const string &catalog_line);
   vector <Parfu_storage_reference> directories;
   vector <Parfu_storage_reference> files;
 };
@@ -664,5 +836,3 @@ private:
 
 #endif // #ifndef PARFU_FILE_SYSTEM_CLASSES_HH_
 
-string print_marching_order(int file_index,
-			    Parfu_storage_reference myref);
@@ -0,0 +1,430 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  University of Illinois/NCSA Open Source License
+//  http://otm.illinois.edu/disclose-protect/illinois-open-source-license
+//
+//  Parfu is copyright (c) 2017-2022,
+//  by The Trustees of the University of Illinois.
+//  All rights reserved.
+//
+//  Parfu was developed by:
+//  The University of Illinois
+//  The National Center For Supercomputing Applications (NCSA)
+//  Blue Waters Science and Engineering Applications Support Team (SEAS)
+//  Craig P Steffen <csteffen@ncsa.illinois.edu>
+//  Roland Haas <rhaas@illinois.edu>
+//
+//  https://github.com/ncsa/parfu_archive_tool
+//  http://www.ncsa.illinois.edu/People/csteffen/parfu/
+//
+//  For full licnse text see the LICENSE file provided with the source
+//  distribution.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "parfu_main.hh"
+
+#include <climits>
+
+////////////////
+//
+// Indexing tar files that don't have a parfu catalog (made by GNU
+// tar, or by parfu before the catalog existed).
+//
+// Every rank takes an equal byte range of the archive, finds the
+// first block in it that looks like a tar header, and follows the
+// header chain from there until it passes the end of its range,
+// writing a catalog line per member.  A block that looks like a
+// header might really be the inside of some file's data, so rank 0
+// then stitches the pieces together starting from the one header it
+// knows is real (the one at offset 0): a rank's piece is used only if
+// it starts exactly where the previous piece's chain said the next
+// header is.  If it doesn't, rank 0 follows the chain across that
+// range itself.  Either way the result is exactly the chain a serial
+// reader would have found, as catalog text that extract mode can use
+// as if it had come from the front of a parfu archive.
+
+#define PARFU_TAR_CHAIN_PASSED_STOP     (0)
+#define PARFU_TAR_CHAIN_END             (1)
+#define PARFU_TAR_CHAIN_ERROR           (2)
+
+// how much a rank reads at a time looking for its first header
+#define PARFU_TAR_SCAN_CHUNK            (1048576UL)
+
+static unsigned long parfu_tar_round_to_block(unsigned long size){
+  return (size + BLOCKSIZE-1) & ~((unsigned long)(BLOCKSIZE-1));
+}
+
+static bool parfu_tar_block_is_zero(const ustar_hdr *block){
+  const char *bytes = (const char*)block;
+  for(int i=0; i<BLOCKSIZE; i++){
+    if(bytes[i]){
+      return false;
+    }
+  }
+  return true;
+}
+
+// The data of a GNU long name/link member or a pax header
+static bool parfu_read_tar_member_data(int archive_fd,
+				       unsigned long data_location,
+				       unsigned long data_size,
+				       string *out_data){
+  out_data->resize(data_size);
+  if(data_size &&
+     pread(archive_fd,&((*out_data)[0]),data_size,data_location) !=
+     ((ssize_t)data_size)){
+    return false;
+  }
+  return true;
+}
+
+// Paths in the catalog are relative to wherever we extract to, so
+// leading "/" and "./" go, as does a trailing "/".  Anything with a
+// ".." in it is refused (empty return).
+static string parfu_clean_tar_path(string path){
+  size_t component_begin=0,component_end;
+  while(path.size()){
+    if(path.at(0) == '/'){
+      path.erase(0,1);
+    }
+    else if(path.compare(0,2,"./") == 0){
+      path.erase(0,2);
+    }
+    else{
+      break;
+    }
+  }
+  while(path.size() && path.back() == '/'){
+    path.pop_back();
+  }
+  if(path == "."){
+    return string("");
+  }
+  while(component_begin <= path.size()){
+    if((component_end=path.find('/',component_begin)) == string::npos){
+      component_end = path.size();
+    }
+    if(path.compare(component_begin,component_end-component_begin,"..") == 0){
+      cerr << "skipping tar member with \"..\" in its path: " << path << "\n";
+      return string("");
+    }
+    component_begin = component_end+1;
+  }
+  return path;
+}
+
+// Follow the header chain from start (which must be a header) until
+// the next header is at or past stop.  One catalog line per member
+// goes on catalog_lines.  Returns where the next header is (or where
+// the chain ended or broke), and sets *chain_status.
+static unsigned long parfu_follow_tar_chain(int archive_fd,
+					    unsigned long start,
+					    unsigned long stop,
+					    unsigned long archive_size,
+					    string *catalog_lines,
+					    unsigned long *n_members,
+					    int *chain_status){
+  ustar_hdr header;
+  unsigned long position=start;
+  // where the current member's first header (pax, GNU long name, or
+  // the real one) is
+  unsigned long member_start=start;
+  string pending_path,pending_link,member_data;
+  long int pending_size=-1;
+  char location_string[PARFU_CATALOG_OFFSET_DIGITS+1];
+
+  while(true){
+    if(position >= stop && position == member_start){
+      *chain_status = PARFU_TAR_CHAIN_PASSED_STOP;
+      return position;
+    }
+    if(position+BLOCKSIZE > archive_size ||
+       pread(archive_fd,&header,BLOCKSIZE,position) != BLOCKSIZE){
+      // ran off the end without an end-of-archive marker; tar
+      // accepts that, so we do too
+      *chain_status = PARFU_TAR_CHAIN_END;
+      return position;
+    }
+    if(parfu_tar_block_is_zero(&header)){
+      // end-of-archive marker
+      *chain_status = PARFU_TAR_CHAIN_END;
+      return position;
+    }
+    if(!tarentry::valid_header_block(header)){
+      *chain_status = PARFU_TAR_CHAIN_ERROR;
+      return position;
+    }
+    unsigned long data_location = position + BLOCKSIZE;
+    long int data_size = tarentry::parse_number(header.size,sizeof(header.size));
+    string member_path,member_link;
+    char type_char;
+
+    switch(header.typeflag){
+    case XHDTYPE:
+      if(!parfu_read_tar_member_data(archive_fd,data_location,data_size,&member_data)){
+	*chain_status = PARFU_TAR_CHAIN_ERROR;
+	return position;
+      }
+      tarentry::parse_pax_records(member_data.data(),member_data.size(),
+				  pending_path,pending_link,pending_size);
+      position = data_location + parfu_tar_round_to_block(data_size);
+      continue;
+    case GNU_LONGNAME_TYPE:
+    case GNU_LONGLINK_TYPE:
+      if(!parfu_read_tar_member_data(archive_fd,data_location,data_size,&member_data)){
+	*chain_status = PARFU_TAR_CHAIN_ERROR;
+	return position;
+      }
+      member_data.resize(strnlen(member_data.data(),member_data.size()));
+      if(header.typeflag == GNU_LONGNAME_TYPE){
+	pending_path = member_data;
+      }
+      else{
+	pending_link = member_data;
+      }
+      position = data_location + parfu_tar_round_to_block(data_size);
+      continue;
+    case XGLTYPE:
+      // global pax headers don't describe a member
+      position = data_location + parfu_tar_round_to_block(data_size);
+      member_start = position;
+      continue;
+    }
+
+    // an actual member
+    if(pending_path.size()){
+      member_path = pending_path;
+    }
+    else{
+      member_path = string(header.name,strnlen(header.name,sizeof(header.name)));
+      // the prefix field is only a prefix in POSIX ustar headers
+      if(!memcmp(header.magic,TMAGIC,sizeof(header.magic)) && header.prefix[0]){
+	member_path = string(header.prefix,strnlen(header.prefix,sizeof(header.prefix))) +
+	  "/" + member_path;
+      }
+    }
+    if(pending_link.size()){
+      member_link = pending_link;
+    }
+    else{
+      member_link = string(header.linkname,strnlen(header.linkname,sizeof(header.linkname)));
+    }
+    if(pending_size >= 0){
+      data_size = pending_size;
+    }
+    switch(header.typeflag){
+    case REGTYPE:
+    case AREGTYPE:
+    case CONTTYPE:
+      // old tars mark directories with a trailing / on a regular file
+      if(member_path.size() && member_path.back() == '/'){
+	type_char = PARFU_FILE_TYPE_DIRECTORY_CHAR;
+	data_size = 0;
+      }
+      else{
+	type_char = PARFU_FILE_TYPE_REGULAR_CHAR;
+      }
+      break;
+    case DIRTYPE:
+      type_char = PARFU_FILE_TYPE_DIRECTORY_CHAR;
+      data_size = 0;
+      break;
+    case SYMTYPE:
+      type_char = PARFU_FILE_TYPE_SYMLINK_CHAR;
+      data_size = 0;
+      break;
+    case LNKTYPE:
+      // the link name is another member's name, so it gets cleaned
+      // up the same way
+      type_char = PARFU_FILE_TYPE_HARDLINK_CHAR;
+      member_link = parfu_clean_tar_path(member_link);
+      data_size = 0;
+      if(!member_link.size()){
+	type_char = PARFU_FILE_TYPE_INVALID_CHAR;
+      }
+      break;
+    default:
+      // devices, fifos
+      cerr << "skipping tar member " << member_path << " of unsupported type ";
+      cerr << header.typeflag << "\n";
+      type_char = PARFU_FILE_TYPE_INVALID_CHAR;
+    }
+    member_path = parfu_clean_tar_path(member_path);
+    if(type_char != PARFU_FILE_TYPE_INVALID_CHAR && member_path.size() &&
+       member_path != PARFU_CATALOG_ENTRY_NAME && member_path != PARFU_INDEX_ENTRY_NAME){
+      catalog_lines->append(member_path);
+      *catalog_lines += PARFU_ENTRY_SEPARATOR_CHARACTER;
+      *catalog_lines += type_char;
+      *catalog_lines += PARFU_ENTRY_SEPARATOR_CHARACTER;
+      if(type_char == PARFU_FILE_TYPE_SYMLINK_CHAR ||
+	 type_char == PARFU_FILE_TYPE_HARDLINK_CHAR){
+	catalog_lines->append(member_link);
+      }
+      *catalog_lines += PARFU_ENTRY_SEPARATOR_CHARACTER;
+      catalog_lines->append(to_string(data_size));
+      *catalog_lines += PARFU_ENTRY_SEPARATOR_CHARACTER;
+      catalog_lines->append(to_string(data_location-member_start));
+      *catalog_lines += PARFU_ENTRY_SEPARATOR_CHARACTER;
+      snprintf(location_string,sizeof(location_string),"%0*lu",
+	       PARFU_CATALOG_OFFSET_DIGITS,member_start);
+      catalog_lines->append(location_string);
+      *catalog_lines += PARFU_LINE_SEPARATOR_CHARACTER;
+      (*n_members)++;
+    }
+    position = data_location + parfu_tar_round_to_block(data_size);
+    member_start = position;
+    pending_path.clear();
+    pending_link.clear();
+    pending_size = -1;
+  }
+}
+
+// The first block in [range_begin,range_end) that looks like a
+// header, or ULONG_MAX if there isn't one.
+static unsigned long parfu_find_tar_header(int archive_fd,
+					   unsigned long range_begin,
+					   unsigned long range_end){
+  vector <char> scan_buffer(PARFU_TAR_SCAN_CHUNK);
+  unsigned long position=range_begin;
+  ssize_t bytes_read;
+
+  while(position < range_end){
+    unsigned long chunk = min(PARFU_TAR_SCAN_CHUNK,range_end-position);
+    if((bytes_read=pread(archive_fd,scan_buffer.data(),chunk,position)) < BLOCKSIZE){
+      break;
+    }
+    for(ssize_t block=0; block+BLOCKSIZE<=bytes_read; block+=BLOCKSIZE){
+      if(tarentry::valid_header_block(*((ustar_hdr*)(scan_buffer.data()+block)))){
+	return position+block;
+      }
+    }
+    position += bytes_read - (bytes_read % BLOCKSIZE);
+  }
+  return ULONG_MAX;
+}
+
+// Called on every rank (rank 0 sends the "T" order that gets the
+// workers here).  Returns the catalog text on rank 0, and an empty
+// string on the other ranks or if the archive isn't a tar file.
+string parfu_index_foreign_tar(string archive_file_name,
+			       int my_rank, int total_ranks){
+  // what each rank sends rank 0 about its piece of the chain
+  enum {first_header=0,next_header,chain_status,n_members,text_size,n_summary};
+  unsigned long my_summary[n_summary];
+  vector <unsigned long> summaries;
+  vector <int> text_sizes,text_displacements;
+  string my_lines,all_lines,catalog_text;
+  unsigned long archive_size,blocks_per_rank;
+  unsigned long range_begin,range_end;
+  unsigned long expected_header,total_members;
+  struct stat archive_statbuf;
+  int archive_fd;
+  int status;
+  bool chain_done;
+
+  if((archive_fd=open(archive_file_name.c_str(),O_RDONLY)) < 0 ||
+     fstat(archive_fd,&archive_statbuf)){
+    cerr << "parfu_index_foreign_tar: rank " << my_rank << " could not open ";
+    cerr << archive_file_name << ": " << strerror(errno) << "\n";
+    archive_size = 0;
+  }
+  else{
+    archive_size = archive_statbuf.st_size;
+  }
+  blocks_per_rank = ((archive_size+BLOCKSIZE-1)/BLOCKSIZE + total_ranks-1) / total_ranks;
+  range_begin = min(archive_size,my_rank*blocks_per_rank*BLOCKSIZE);
+  range_end = min(archive_size,(my_rank+1)*blocks_per_rank*BLOCKSIZE);
+
+  my_summary[n_members] = 0;
+  my_summary[chain_status] = PARFU_TAR_CHAIN_ERROR;
+  my_summary[first_header] = ULONG_MAX;
+  my_summary[next_header] = range_end;
+  if(range_begin < range_end){
+    // offset 0 is the one place we know is a header
+    my_summary[first_header] = range_begin ?
+      parfu_find_tar_header(archive_fd,range_begin,range_end) : 0;
+    if(my_summary[first_header] != ULONG_MAX){
+      int my_status;
+      my_summary[next_header] =
+	parfu_follow_tar_chain(archive_fd,my_summary[first_header],range_end,
+			       archive_size,&my_lines,&(my_summary[n_members]),
+			       &my_status);
+      my_summary[chain_status] = my_status;
+    }
+  }
+  my_summary[text_size] = my_lines.size();
+
+  if(my_rank == 0){
+    summaries.resize(n_summary*total_ranks);
+  }
+  MPI_Gather(my_summary,n_summary,MPI_UNSIGNED_LONG,
+	     summaries.data(),n_summary,MPI_UNSIGNED_LONG,
+	     0,MPI_COMM_WORLD);
+  if(my_rank == 0){
+    unsigned long total_text=0;
+    text_sizes.resize(total_ranks);
+    text_displacements.resize(total_ranks);
+    for(int i=0; i<total_ranks; i++){
+      text_sizes.at(i) = summaries.at(i*n_summary+text_size);
+      text_displacements.at(i) = total_text;
+      total_text += text_sizes.at(i);
+    }
+    all_lines.resize(total_text);
+  }
+  MPI_Gatherv(my_lines.data(),my_lines.size(),MPI_CHAR,
+	      (my_rank==0)?&(all_lines[0]):nullptr,
+	      text_sizes.data(),text_displacements.data(),MPI_CHAR,
+	      0,MPI_COMM_WORLD);
+  if(my_rank != 0){
+    if(archive_fd >= 0){
+      close(archive_fd);
+    }
+    return string("");
+  }
+  if(archive_fd < 0){
+    return string("");
+  }
+
+  // Now stitch.  expected_header is where the real chain says the
+  // next header is.
+  expected_header = 0;
+  total_members = 0;
+  chain_done = false;
+  my_lines.clear();
+  for(int i=0; i<total_ranks && !chain_done; i++){
+    unsigned long *summary = &(summaries.at(i*n_summary));
+    range_end = min(archive_size,(i+1)*blocks_per_rank*BLOCKSIZE);
+    if(expected_header >= range_end){
+      // all of this range is inside one member's data
+      continue;
+    }
+    if(summary[first_header] == expected_header &&
+       summary[chain_status] != PARFU_TAR_CHAIN_ERROR){
+      catalog_text.append(all_lines,text_displacements.at(i),text_sizes.at(i));
+      total_members += summary[n_members];
+      expected_header = summary[next_header];
+      status = summary[chain_status];
+    }
+    else{
+      // that rank started on something that only looked like a
+      // header, so we walk its range ourselves
+      cerr << "parfu_index_foreign_tar: re-walking the chain from byte ";
+      cerr << expected_header << " (rank " << i << " started at ";
+      cerr << (long)(summary[first_header]) << ")\n";
+      expected_header = parfu_follow_tar_chain(archive_fd,expected_header,range_end,
+					       archive_size,&catalog_text,
+					       &total_members,&status);
+    }
+    if(status == PARFU_TAR_CHAIN_ERROR){
+      cerr << "parfu_index_foreign_tar: " << archive_file_name;
+      cerr << " has no valid tar header at byte " << expected_header << ".\n";
+      close(archive_fd);
+      return string("");
+    }
+    chain_done = (status == PARFU_TAR_CHAIN_END);
+  }
+  close(archive_fd);
+  cerr << "indexed " << total_members << " tar members in " << archive_file_name << "\n";
+  return parfu_catalog_header(catalog_text.size(),total_members) + catalog_text;
+}
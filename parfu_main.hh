@@ -28,15 +28,22 @@
 #include <cstdio>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <mpi.h>
 #include <dirent.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <limits.h>
 
 #include <iostream>
 #include <string>
 #include <vector>
 #include <list>
+#include <map>
+#include <set>
 //#include <experimental/filesystem>
 #include <algorithm>
 #include <fstream>
@@ -74,6 +81,12 @@
 #define PARFU_FILE_TYPE_REGULAR          (0)
 #define PARFU_FILE_TYPE_DIRECTORY     (1)
 #define PARFU_FILE_TYPE_SYMLINK       (2)
+// a second (or later) name for a file that's already in the archive;
+// stored as a tar hard link with no data
+#define PARFU_FILE_TYPE_HARDLINK      (3)
+// a file with the same contents as one that's already in the archive
+// (dedup=on); a tar hard link too, but parfu extracts it as a copy
+#define PARFU_FILE_TYPE_DUPLICATE     (4)
 #define PARFU_FILE_TYPE_PAD           (22)
 
 
@@ -87,9 +100,31 @@
 #define PARFU_FILE_SIZE_INVALID                 (-10L)
 #define PARFU_FILE_SIZE_SYMLINK                 (-11L)
 #define PARFU_FILE_SIZE_DIR                     (-12L)
+// Hard links sort after every regular file, so the file a link points
+// to is always earlier in the archive; tar has to have extracted it
+// before it can make the link.
+#define PARFU_FILE_SIZE_HARDLINK                (LONG_MAX)
+// and duplicates just before them, since a hard link can be another
+// name for a duplicate
+#define PARFU_FILE_SIZE_DUPLICATE               (LONG_MAX-1)
 
 #define PARFU_SPIDER_DIRECTORY_RETURN_ERROR             (-1L)
 
+// The catalog is the first entry in a 0.6 archive, as an ordinary tar
+// member with this name (see parfu_2022_catalog_format.txt)
+#define PARFU_CATALOG_ENTRY_NAME           ".parfu_catalog"
+#define PARFU_CATALOG_VERSION_STRING       "parfu_v06 "
+// width of the numbers in the catalog header
+#define PARFU_CATALOG_HEADER_DIGITS        (10)
+// archive locations in catalog lines are zero-padded to this many
+// digits, so the size of the catalog doesn't depend on where the
+// entries land (which in turn depends on the size of the catalog)
+#define PARFU_CATALOG_OFFSET_DIGITS        (16)
+// payload checksums in catalog lines are this many hex digits, or
+// this many PARFU_CATALOG_NO_CHECKSUM_CHARs if there isn't one
+#define PARFU_CATALOG_CHECKSUM_DIGITS      (8)
+#define PARFU_CATALOG_NO_CHECKSUM_CHAR     '-'
+
 #include "tarentry.hh"
 #include "parfu_file_system_classes.hh"
 #include "parfu_2021_legacy.hh"
@@ -104,15 +139,107 @@
 #define PARFU_FILE_TYPE_REGULAR_CHAR 'F'
 #define PARFU_FILE_TYPE_DIRECTORY_CHAR 'D'
 #define PARFU_FILE_TYPE_SYMLINK_CHAR 'L'
+#define PARFU_FILE_TYPE_HARDLINK_CHAR 'H'
+#define PARFU_FILE_TYPE_DUPLICATE_CHAR 'C'
 #define PARFU_FILE_TYPE_INVALID_CHAR 'X'
-  
+
+// what a run of parfu does
+// 'C' create: build an archive from a target directory
+// 'E' extract: unpack an archive (using its catalog) into a directory
+// 'V' verify: read an archive back and check it against its catalog
+//     checksums and, if given one, the directory it was made from
+#define PARFU_RUN_MODE_CREATE             'C'
+#define PARFU_RUN_MODE_EXTRACT            'E'
+#define PARFU_RUN_MODE_VERIFY             'V'
+
+// how the target directory tree gets spidered in create mode
+// 'S' serial: rank 0 recurses through the whole tree by itself
+// 'D' distributed: rank 0 hands directories out to the worker ranks
+// 'T' threaded: rank 0 spiders with a pool of threads
+#define PARFU_SPIDER_MODE_SERIAL          'S'
+#define PARFU_SPIDER_MODE_DISTRIBUTED     'D'
+#define PARFU_SPIDER_MODE_THREADED        'T'
+
+// the most directories rank 0 will hand a worker in a single
+// distributed spider order
+#define PARFU_SPIDER_MAX_DIRS_PER_ORDER   (16)
+
+// how many staging buffers each worker cycles through in create mode
+// (see Parfu_create_pipeline).  This is also how many buckets rank 0
+// bundles into one order message.  1 means no overlap of reads and
+// writes at all.  
+#define PARFU_DEFAULT_PIPELINE_DEPTH      (2)
+
+// how create-mode order sets get to the ranks that do the data
+// movement
+// 'B' boss: rank 0 hands order sets to the workers one message at a time
+// 'S' self: rank 0 broadcasts the whole plan and every rank (rank 0
+//     included) claims order sets off a shared RMA counter
+#define PARFU_DISPATCH_MODE_BOSS          'B'
+#define PARFU_DISPATCH_MODE_SELF          'S'
+
+// how many order messages rank 0 keeps in flight to each worker at
+// once in create mode, so workers never sit idle waiting on a round
+// trip to rank 0 between buckets
+#define PARFU_DEFAULT_QUEUE_DEPTH         (2)
+
+// In a selective extract, a hole in the archive between two wanted
+// entries this size or smaller is just read through as part of the
+// same bucket; a bigger hole isn't read at all.
+#define PARFU_MAX_READ_THROUGH_GAP        (262144UL)
+
+// In create mode, target file pieces this size or smaller are read
+// with open()/pread()/close() instead of an MPI-IO file handle.
+#define PARFU_POSIX_READ_THRESHOLD        (4194304UL)
+
+// Define this to have the worker staging buffer pool ask for
+// explicit huge pages (MAP_HUGETLB).  That only works if the nodes
+// have huge pages reserved; if the request fails the pool quietly
+// falls back to ordinary pages, which it marks for transparent huge
+// pages where the OS supports it.
+//#define PARFU_USE_HUGETLB
+
+// Define this to batch the create-mode small-file reads in a bucket
+// through io_uring (see parfu_uring_reader.hh).  If the Linux kernel
+// headers at build time are too old for it, it's left out; at run
+// time it falls back to pread() if the kernel doesn't support it.
+#define PARFU_USE_IO_URING
+
 using namespace std;
 
+// run-time behavior settings for the 0.6 code.  These get filled in
+// from the command line by parfu_parse_args(); anything not set
+// on the command line keeps the default value given here.
+typedef struct{
+  char run_mode=PARFU_RUN_MODE_CREATE;
+  char spider_mode=PARFU_SPIDER_MODE_SERIAL;
+  // 0 means use as many threads as the node has cores
+  unsigned int spider_threads=0;
+  unsigned int pipeline_depth=PARFU_DEFAULT_PIPELINE_DEPTH;
+  unsigned int queue_depth=PARFU_DEFAULT_QUEUE_DEPTH;
+  char dispatch_mode=PARFU_DISPATCH_MODE_BOSS;
+  // in boss dispatch, whether rank 0 also moves data between handing
+  // out orders.  (It always does if it's the only rank.)
+  bool boss_moves_data=true;
+  // whether create mode writes the binary index after the catalog
+  bool build_index=true;
+  // whether create mode writes a compressed (.tar.gz) archive
+  bool compress=false;
+  // whether create mode stores files with the same contents only once
+  bool dedup=false;
+  // in extract mode, only extract entries matching (or inside a
+  // directory matching) one of these; empty means everything
+  vector <string> select_patterns;
+}parfu_behavior_settings_t;
+
 #include "parfu_2021_legacy.hh"
 #include "parfu_data_transfer.hh"
 #include "parfu_file_system_classes.hh"
 #include "tarentry.hh"
 #include "parfu_rank_move_data.hh"
+#include "parfu_archive_index.hh"
+#include "parfu_uring_reader.hh"
+#include "parfu_compressed_archive.hh"
 #include "parfu_worker_node.hh"
 #include "parfu_boss_functions.hh"
 
@@ -121,7 +248,8 @@ vector <string> *parfu_parse_args(unsigned nargs,
 				 unsigned long *bucket_size,
 				  unsigned *max_orders_per_bucket,
 				  string *archive_file_name,
-				  int *archive_file_multiplier);
+				  int *archive_file_multiplier,
+				  parfu_behavior_settings_t *settings);
 void parfu_usage(void);
 
 // classes to define for new structure of parfu
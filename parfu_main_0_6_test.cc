@@ -29,7 +29,7 @@
 #define DEFAULT_BUCKET_SIZE         (4992000)
 
 int main(int argc, char *argv[]){
-  char run_mode='C';
+  char run_mode=PARFU_RUN_MODE_CREATE;
   Parfu_directory *my_target_directory;
   //  string base_path;
   Parfu_target_collection *my_target_collec;
@@ -40,10 +40,11 @@ int main(int argc, char *argv[]){
   string initial_order;
   int mpi_return_val;
   //  int *length_buffer=nullptr;
-  unsigned max_orders_per_bucket;
+  unsigned max_orders_per_bucket=0;
   long unsigned bucket_size=DEFAULT_BUCKET_SIZE;
   string *archive_file_name_from_command_line;
   int *archive_file_multiplier;
+  parfu_behavior_settings_t run_settings;
   
   string archive_file_name;
 
@@ -54,6 +55,18 @@ int main(int argc, char *argv[]){
   }
   
   MPI_File *file_handle=nullptr;
+  // for rank 0's own share of the data movement
+  Parfu_buffer_pool *my_buffer_pool=nullptr;
+  Parfu_create_pipeline *boss_pipeline=nullptr;
+  unsigned long catalog_region_size=0UL;
+  string catalog_region;
+  // files that couldn't be read in full while archiving them; create
+  // mode then finishes the archive but returns 8
+  unsigned long n_unreadable=0UL;
+  // the file the buckets are written to, and in compressed mode the
+  // compressed catalog region
+  string data_file_name;
+  string catalog_member;
   //  MPI_Info file_info;
   
   //  char *word_buffer=nullptr;
@@ -86,7 +99,8 @@ int main(int argc, char *argv[]){
     if((target_paths =
 	parfu_parse_args(argc,argv,&bucket_size,&max_orders_per_bucket,
 			 archive_file_name_from_command_line,
-			 archive_file_multiplier))
+			 archive_file_multiplier,
+			 &run_settings))
        == nullptr){
       cerr << "Error from command line parsing!  Exiting.\n";
       parfu_broadcast_order(string("X"),string("abort"));
@@ -95,23 +109,66 @@ int main(int argc, char *argv[]){
     //    cerr << "checking: max orders per bucket after argument parsing: ";
     //    cerr << max_orders_per_bucket << "\n";
 
+    run_mode = run_settings.run_mode;
     archive_file_name = *archive_file_name_from_command_line;
     if(archive_file_name.size()<1){
       cerr << "No archive file specified.  Aborting.\n";
       exit(5);
     }
+
+    if(run_mode == PARFU_RUN_MODE_EXTRACT){
+      // the one target, if there is one, is where to extract to
+      string destination_path;
+      if(target_paths->size() > 1){
+	cerr << "Extract mode takes at most one destination directory.  Aborting.\n";
+	parfu_broadcast_order(string("X"),string("abort"));
+	exit(4);
+      }
+      if(target_paths->size()){
+	destination_path = target_paths->front();
+      }
+      else{
+	char *cwd_buffer = getcwd(nullptr,0);
+	destination_path = string(cwd_buffer);
+	free(cwd_buffer);
+      }
+      mpi_return_val = parfu_extract_archive(archive_file_name,destination_path,
+					     bucket_size,max_orders_per_bucket,
+					     &run_settings,total_ranks);
+      cout << "rank " << my_rank << " done, about to call MPI_Finalize()\n";
+      MPI_Finalize();
+      return mpi_return_val;
+    }
+    if(run_mode == PARFU_RUN_MODE_VERIFY){
+      // the one target, if there is one, is the source to compare with
+      string source_path;
+      if(target_paths->size() > 1){
+	cerr << "Verify mode takes at most one source directory.  Aborting.\n";
+	parfu_broadcast_order(string("X"),string("abort"));
+	exit(4);
+      }
+      if(target_paths->size()){
+	source_path = target_paths->front();
+      }
+      mpi_return_val = parfu_verify_archive(archive_file_name,source_path,
+					    bucket_size,max_orders_per_bucket,
+					    &run_settings,total_ranks);
+      cout << "rank " << my_rank << " done, about to call MPI_Finalize()\n";
+      MPI_Finalize();
+      return mpi_return_val;
+    }
     
     cerr << "We got " << target_paths->size() << " target paths from command line.\n";
     for(unsigned i=0;i<target_paths->size();i++){
       cerr << "path " << i << " :" << target_paths->at(i) << "\n";
     }
-    if(run_mode == 'C' && (target_paths->size() < 1)){
+    if(run_mode == PARFU_RUN_MODE_CREATE && (target_paths->size() < 1)){
       cerr << "We are in \"create\" mode and have no targets to archive.  Aborting.\n";
       exit(3);
     }
 
     // this is for the testing stage, where we assume we have one and only one target
-    if(run_mode == 'C' && (target_paths->size() > 1)){
+    if(run_mode == PARFU_RUN_MODE_CREATE && (target_paths->size() > 1)){
       cerr << "Parfu test-mode create only allows one target.  Aborting.\n";
       exit(4);
     }
@@ -142,20 +199,48 @@ int main(int argc, char *argv[]){
     //    base_path = string(argv[1]);
     
     //  cout << "Have we spidered directory? " << my_target_directory->is_directory_spidered() << "\n";
-    my_target_directory->spider_directory();
+    if(run_settings.spider_mode == PARFU_SPIDER_MODE_DISTRIBUTED){
+      // the workers do the reading of the directories.  They need
+      // to be in iNdividual mode and know the base path for that.
+      // Once the tree is built we flip them back to broadcast mode
+      // so the rest of the setup below goes as usual.
+      parfu_broadcast_order(string("N"),
+			    string("individual"));
+      for(int i=1; i<total_ranks; i++){
+	parfu_send_order_to_rank(i,0,string("P"),target_paths->front());
+      }
+      parfu_distributed_spider(my_target_directory,total_ranks);
+      for(int i=1; i<total_ranks; i++){
+	parfu_send_order_to_rank(i,0,string("B"),string("broadcast"));
+      }
+    }
+    else if(run_settings.spider_mode == PARFU_SPIDER_MODE_THREADED){
+      my_target_directory->spider_directory_threaded(run_settings.spider_threads);
+    }
+    else{
+      my_target_directory->spider_directory();
+    }
     //  cout << "Have we spidered directory? " << my_target_directory->is_directory_spidered() << "\n";
     
     //  cout << "First build the target collection\n";
     my_target_collec = new Parfu_target_collection(my_target_directory);
     cout << "Target collection built.  ";
+    if(run_settings.dedup){
+      cout << "look for files with the same contents...\n";
+      parfu_deduplicate_collection(my_target_collec,total_ranks);
+    }
     //    cout << "Now dump it, unsorted.\n";
     //    my_target_collec->dump();
     cout << "now sort the files...\n";
     my_target_collec->order_files();
     //    cout << "and dump it again.\n";
     //    my_target_collec->dump();
+    // the catalog goes at the front of the archive, so size it first
+    // and start the data area right after it
+    catalog_region_size = my_target_collec->catalog_region_size(run_settings.build_index);
+    cout << "catalog region is " << catalog_region_size << " bytes.\n";
     cout << "set offsets.\n";
-    my_target_collec->set_offsets();
+    my_target_collec->set_offsets(catalog_region_size);
     //    cout << "dump offsets\n";
     //    my_target_collec->dump_offsets();
     cout << "generate rank orders\n";
@@ -198,15 +283,42 @@ int main(int argc, char *argv[]){
     
     */
 
+    // the pipeline depth goes first, because the workers allocate
+    // their staging buffers when they get the bucket size
+    parfu_broadcast_order(string("D"),
+			  to_string(run_settings.pipeline_depth));
     string bucket_size_string = to_string(bucket_size);
     parfu_broadcast_order(string("U"),
 			  bucket_size_string);
 
+    // look up the owner names once here so the workers don't each
+    // have to do it for every tar header they build
+    parfu_broadcast_order(string("O"),
+			  my_target_collec->owner_name_table());
+
     
+    // In compressed mode the buckets go to a partial file first and
+    // are packed into the archive at the end.
+    data_file_name = archive_file_name;
+    if(run_settings.compress){
+      struct stat archive_stat;
+      if(!stat(archive_file_name.c_str(),&archive_stat)){
+	cerr << "Archive file " << archive_file_name << " already exists.  Exiting.\n";
+	parfu_broadcast_order(string("X"),
+			      string("bye"));
+	MPI_Finalize();
+	exit(1);
+      }
+      data_file_name.append(PARFU_PARTIAL_ARCHIVE_SUFFIX);
+      parfu_broadcast_order(string("G"),
+			    string("gzip"));
+      parfu_set_bucket_compression(true);
+    }
+
     cout << "Now we try collective file open.\n";
 
     parfu_broadcast_order(string("A"),
-			  archive_file_name);
+			  data_file_name);
     
     //    mpi_return_val =
     //      MPI_File_open(MPI_COMM_WORLD,word_buffer,
@@ -216,11 +328,11 @@ int main(int argc, char *argv[]){
 
     //    MPI_Barrier(MPI_COMM_WORLD);
     if((mpi_return_val =
-      MPI_File_open(MPI_COMM_WORLD,archive_file_name.c_str(),
+      MPI_File_open(MPI_COMM_WORLD,data_file_name.c_str(),
     		    MPI_MODE_WRONLY|MPI_MODE_CREATE|MPI_MODE_EXCL,
 		    MPI_INFO_NULL,file_handle)) != MPI_SUCCESS){
       cerr << "\n\nmain MPI_File_open returned " << mpi_return_val << "!\n";
-      cerr << "WARNING!  Attempted to open file:>" << archive_file_name << "<\n";
+      cerr << "WARNING!  Attempted to open file:>" << data_file_name << "<\n";
       cerr << "but it failed.  This is likely because the file already exists,\n";
       cerr << "or the directory doesn't exist or you don't have permission\n";
       cerr << "to write there.  Exiting program.\n";
@@ -230,42 +342,142 @@ int main(int argc, char *argv[]){
       exit(1);
     }
 
-    cout << "Successfully opened archive file >" << archive_file_name << "< for writing.\n";
+    cout << "Successfully opened archive file >" << data_file_name << "< for writing.\n";
+
+    // The catalog region doesn't overlap any bucket, but it has the
+    // payload checksums in it, so it's written once the data has moved.
 		    
     // Now send out a set of orders.
     cout << "We have " << transfer_orders->size();
     cout << " transfer orders available; return val=" << mpi_return_val <<".\n";
 
-    parfu_broadcast_order(string("N"),
-			  string("individual"));
-    // we're now in individual mode.
-    // all commands must be sent to each rank individually including the shutdown
-    // until we've either sent each of them a shutdown, or sent each of them a command
+    if(run_settings.dispatch_mode == PARFU_DISPATCH_MODE_SELF){
+      // everybody gets the whole plan at once and helps themselves,
+      // rank 0 included.  The base path rides along in front of the
+      // plan, ended by a null.
+      string plan_message = target_paths->front();
+      plan_message.push_back('\0');
+      for(unsigned i=0; i<transfer_orders->size(); i++){
+	plan_message.append(transfer_orders->at(i));
+      }
+      parfu_broadcast_order(string("W"),
+			    plan_message);
+      my_buffer_pool = new Parfu_buffer_pool(bucket_size,
+					     run_settings.pipeline_depth);
+      parfu_self_scheduled_Create(plan_message.data()+target_paths->front().size()+1,
+				  plan_message.size()-target_paths->front().size()-1,
+				  target_paths->front(),
+				  file_handle,
+				  my_buffer_pool,
+				  run_settings.pipeline_depth,
+				  my_rank);
+    }
+    else{
+      parfu_broadcast_order(string("N"),
+			    string("individual"));
+      // we're now in individual mode.
+      // all commands must be sent to each rank individually including the shutdown
+      // until we've either sent each of them a shutdown, or sent each of them a command
 
-    // to go back to broadcast mode.
+      // to go back to broadcast mode.
 
-    for(int i=1; i<total_ranks; i++){
-      parfu_send_order_to_rank(i,0,string("P"),target_paths->front());
-    }
+      for(int i=1; i<total_ranks; i++){
+	parfu_send_order_to_rank(i,0,string("P"),target_paths->front());
+      }
     
-    /*
-    for(int i=1; i<total_ranks; i++){
-      parfu_send_order_to_rank(i,0,string("C"),transfer_orders->at(i-1));
-    }
-    */
-    cout << "About to call push_out_all_orders\n";
-    push_out_all_orders(transfer_orders,total_ranks);
-    cout << "push_out_all_orders has returned.\n";
+      /*
+      for(int i=1; i<total_ranks; i++){
+	parfu_send_order_to_rank(i,0,string("C"),transfer_orders->at(i-1));
+      }
+      */
+      if(run_settings.pipeline_depth > 1){
+	// hand each worker enough buckets at a time to fill its pipeline
+	vector <string> *single_orders = transfer_orders;
+	transfer_orders = parfu_bundle_transfer_orders(single_orders,
+						       run_settings.pipeline_depth);
+	delete single_orders;
+	cout << "bundled into " << transfer_orders->size() << " order messages.\n";
+      }
+      if(run_settings.boss_moves_data || total_ranks < 2){
+	my_buffer_pool = new Parfu_buffer_pool(bucket_size,
+					       run_settings.pipeline_depth);
+	boss_pipeline = new Parfu_create_pipeline(my_buffer_pool,
+						  run_settings.pipeline_depth);
+      }
+      cout << "About to call push_out_all_orders\n";
+      push_out_all_orders(transfer_orders,total_ranks,run_settings.queue_depth,
+			  boss_pipeline,target_paths->front(),file_handle,
+			  string("C"));
+      cout << "push_out_all_orders has returned.\n";
+      if(boss_pipeline != nullptr){
+	// waits for our own writes
+	delete boss_pipeline;
+	boss_pipeline=nullptr;
+      }
     
     
-    //    cerr << "\ndump order zero: \n\n";
-    //    cerr << transfer_orders->at(0);
-    //    cerr << "\n\nend order zero\n\n";
+      //    cerr << "\ndump order zero: \n\n";
+      //    cerr << transfer_orders->at(0);
+      //    cerr << "\n\nend order zero\n\n";
     
-    for(int i=1; i<total_ranks; i++){
-      parfu_send_order_to_rank(i,0,string("X"),string("shutdown"));
+      // back to broadcast mode for the shutdown (and the packing of
+      // a compressed archive before it)
+      for(int i=1; i<total_ranks; i++){
+	parfu_send_order_to_rank(i,0,string("B"),string("broadcast"));
+      }
+    
+    } // else (boss dispatch)
+    if(my_buffer_pool != nullptr){
+      delete my_buffer_pool;
+      my_buffer_pool=nullptr;
     }
-    cerr << "sent shutdown orders; now we're done.\n";
+    
+    // collect everybody's slice checksums for the catalog
+    parfu_broadcast_order(string("Q"),
+			  string("checksums"));
+    {
+      vector <parfu_slice_checksum_t> slice_checksums =
+	parfu_gather_slice_checksums(my_rank,total_ranks);
+      unsigned long n_checksums =
+	my_target_collec->set_checksums(&slice_checksums,&n_unreadable);
+      cout << "got " << slice_checksums.size() << " slice checksums for ";
+      cout << n_checksums << " files.\n";
+    }
+    catalog_region = my_target_collec->catalog_region(run_settings.build_index);
+    if(catalog_region.size() != catalog_region_size){
+      cerr << "WARNING! catalog region is " << catalog_region.size();
+      cerr << " bytes but " << catalog_region_size << " were reserved!\n";
+    }
+    if(run_settings.compress){
+      // it gets written when the archive is packed
+      catalog_member.resize(parfu_gzip_bound(catalog_region.size()));
+      catalog_member.resize(parfu_gzip_member(catalog_region.data(),catalog_region.size(),
+					      &(catalog_member[0]),catalog_member.size()));
+    }
+    else if((mpi_return_val=MPI_File_write_at(*file_handle,0,
+					      ((void*)(catalog_region.data())),
+					      catalog_region.size(),MPI_CHAR,
+					      MPI_STATUS_IGNORE))!=MPI_SUCCESS){
+      cerr << "main MPI_File_write_at returned " << mpi_return_val;
+      cerr << " writing the catalog!\n";
+    }
+    if(run_settings.compress){
+      parfu_broadcast_order(string("K"),
+			    archive_file_name);
+      if(parfu_compact_archive(file_handle,data_file_name,archive_file_name,
+			       &catalog_member,catalog_region_size,
+			       my_rank,total_ranks)){
+	cerr << "WARNING!  Packing the compressed archive had errors.\n";
+      }
+    }
+    parfu_broadcast_order(string("X"),
+			  string("bye"));
+    // the workers close it too when they get the shutdown.  (Packing
+    // a compressed archive already closed it.)
+    if(*file_handle != MPI_FILE_NULL){
+      MPI_File_close(file_handle);
+    }
+    cerr << "sent shutdown broadcast; now we're done.\n";
     
     // This is the shutdown, but only if we're in broadcast mode.  
     //    parfu_broadcast_order(string("X"),
@@ -279,6 +491,10 @@ int main(int argc, char *argv[]){
 
   cout << "rank " << my_rank << " done, about to call MPI_Finalize()\n";
   MPI_Finalize();
+  if(n_unreadable){
+    cerr << n_unreadable << " files could not be read in full.\n";
+    return 8;
+  }
   return 0;
 }
 
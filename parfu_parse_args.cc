@@ -29,7 +29,8 @@ vector <string> *parfu_parse_args(unsigned nargs,
 				  unsigned long *bucket_size,
 				  unsigned *max_orders_per_bucket,
 				  string *archive_file_name,
-				  int *archive_file_multiplier){
+				  int *archive_file_multiplier,
+				  parfu_behavior_settings_t *settings){
   vector <string> *target_list;
   bool valid_flag;
   string flag_string;
@@ -66,7 +67,7 @@ vector <string> *parfu_parse_args(unsigned nargs,
       }
       if( flag_string == string("bucketsize") ){
 	valid_flag=true;
-	*bucket_size = stoi(value_string);
+	*bucket_size = stoul(value_string);
 	*bucket_size = parfu_next_block_boundary(*bucket_size);
 	cerr << "setting bucket size to: "
 	     << *bucket_size << "\n";
@@ -79,6 +80,153 @@ vector <string> *parfu_parse_args(unsigned nargs,
 	cerr << "archive file set to: " << *archive_file_name
 	     << "\n";
       }
+      if( flag_string == string("mode") ){
+	valid_flag=true;
+	if(value_string == string("create")){
+	  settings->run_mode = PARFU_RUN_MODE_CREATE;
+	}
+	else if(value_string == string("extract")){
+	  settings->run_mode = PARFU_RUN_MODE_EXTRACT;
+	}
+	else if(value_string == string("verify")){
+	  settings->run_mode = PARFU_RUN_MODE_VERIFY;
+	}
+	else{
+	  cerr << "invalid run mode:" << value_string << "!\n";
+	  cerr << "Aborting.\n";
+	  parfu_usage();
+	  return nullptr;
+	}
+	cerr << "run mode set to: " << value_string << "\n";
+      }
+      if( flag_string == string("spider") ){
+	valid_flag=true;
+	if(value_string == string("serial")){
+	  settings->spider_mode = PARFU_SPIDER_MODE_SERIAL;
+	}
+	else if(value_string == string("distributed")){
+	  settings->spider_mode = PARFU_SPIDER_MODE_DISTRIBUTED;
+	}
+	else if(value_string == string("threads")){
+	  settings->spider_mode = PARFU_SPIDER_MODE_THREADED;
+	}
+	else{
+	  cerr << "invalid spider mode:" << value_string << "!\n";
+	  cerr << "Aborting.\n";
+	  parfu_usage();
+	  return nullptr;
+	}
+	cerr << "spider mode set to: " << value_string << "\n";
+      }
+      if( flag_string == string("dispatch") ){
+	valid_flag=true;
+	if(value_string == string("boss")){
+	  settings->dispatch_mode = PARFU_DISPATCH_MODE_BOSS;
+	}
+	else if(value_string == string("self")){
+	  settings->dispatch_mode = PARFU_DISPATCH_MODE_SELF;
+	}
+	else{
+	  cerr << "invalid dispatch mode:" << value_string << "!\n";
+	  cerr << "Aborting.\n";
+	  parfu_usage();
+	  return nullptr;
+	}
+	cerr << "dispatch mode set to: " << value_string << "\n";
+      }
+      if( flag_string == string("bossdata") ){
+	valid_flag=true;
+	if(value_string == string("on")){
+	  settings->boss_moves_data = true;
+	}
+	else if(value_string == string("off")){
+	  settings->boss_moves_data = false;
+	}
+	else{
+	  cerr << "invalid bossdata setting:" << value_string << "!\n";
+	  cerr << "Aborting.\n";
+	  parfu_usage();
+	  return nullptr;
+	}
+	cerr << "rank 0 moving data set to: " << value_string << "\n";
+      }
+      if( flag_string == string("select") ){
+	valid_flag=true;
+	settings->select_patterns.push_back(value_string);
+	cerr << "extracting only: " << value_string << "\n";
+      }
+      if( flag_string == string("index") ){
+	valid_flag=true;
+	if(value_string == string("on")){
+	  settings->build_index = true;
+	}
+	else if(value_string == string("off")){
+	  settings->build_index = false;
+	}
+	else{
+	  cerr << "invalid index setting:" << value_string << "!\n";
+	  cerr << "Aborting.\n";
+	  parfu_usage();
+	  return nullptr;
+	}
+	cerr << "binary archive index set to: " << value_string << "\n";
+      }
+      if( flag_string == string("compress") ){
+	valid_flag=true;
+	if(value_string == string("on")){
+	  settings->compress = true;
+	}
+	else if(value_string == string("off")){
+	  settings->compress = false;
+	}
+	else{
+	  cerr << "invalid compress setting:" << value_string << "!\n";
+	  cerr << "Aborting.\n";
+	  parfu_usage();
+	  return nullptr;
+	}
+	cerr << "per-bucket gzip compression set to: " << value_string << "\n";
+      }
+      if( flag_string == string("dedup") ){
+	valid_flag=true;
+	if(value_string == string("on")){
+	  settings->dedup = true;
+	}
+	else if(value_string == string("off")){
+	  settings->dedup = false;
+	}
+	else{
+	  cerr << "invalid dedup setting:" << value_string << "!\n";
+	  cerr << "Aborting.\n";
+	  parfu_usage();
+	  return nullptr;
+	}
+	cerr << "storing identical files once set to: " << value_string << "\n";
+      }
+      if( flag_string == string("spiderthreads") ){
+	valid_flag=true;
+	settings->spider_threads = stoi(value_string);
+	cerr << "setting spider threads to: "
+	     << settings->spider_threads << "\n";
+      }
+      if( flag_string == string("pipelinedepth") ){
+	valid_flag=true;
+	settings->pipeline_depth = stoi(value_string);
+	if(settings->pipeline_depth < 1){
+	  settings->pipeline_depth = 1;
+	}
+	cerr << "setting create pipeline depth to: "
+	     << settings->pipeline_depth << "\n";
+      }
+      if( flag_string == string("queuedepth") ){
+	valid_flag=true;
+	settings->queue_depth = stoi(value_string);
+	if(settings->queue_depth < 1){
+	  settings->queue_depth = 1;
+	}
+	cerr << "setting orders in flight per worker to: "
+	     << settings->queue_depth << "\n";
+      }
       if(!valid_flag){
 	cerr << "invalid flag:" << flag_string << "!\n";
 	cerr << "Aborting.\n";
@@ -94,8 +242,21 @@ vector <string> *parfu_parse_args(unsigned nargs,
 
 void parfu_usage(void){
   cerr << "\n\nHow to invoke parfu:\n";
-  cerr << "parfu [bucketsize=<bucket size in bytes>]\n";
+  cerr << "parfu [mode=<create|extract|verify>; default create]\n";
+  cerr << "      [bucketsize=<bucket size in bytes>]\n";
   cerr << "      [maxorders=<max orders per bucket>]\n";
-  cerr << "      archivefile=<path to archive to write>\n";
-  cerr << "      <target_dir>\n\n";
+  cerr << "      [spider=<serial|distributed|threads>]\n";
+  cerr << "      [spiderthreads=<threads for spider=threads; default all cores>]\n";
+  cerr << "      [pipelinedepth=<staging buffers per worker; default " << PARFU_DEFAULT_PIPELINE_DEPTH << ">]\n";
+  cerr << "      [dispatch=<boss|self>]\n";
+  cerr << "      [bossdata=<on|off; whether rank 0 moves data with dispatch=boss>]\n";
+  cerr << "      [select=<path prefix or glob to extract or verify; may be repeated>]\n";
+  cerr << "      [index=<on|off; write the binary path index in create mode>]\n";
+  cerr << "      [compress=<on|off; gzip each bucket in create mode; default off>]\n";
+  cerr << "      [dedup=<on|off; store files with the same contents once in create mode; default off>]\n";
+  cerr << "      [queuedepth=<order messages in flight per worker; default " << PARFU_DEFAULT_QUEUE_DEPTH << ">]\n";
+  cerr << "      archivefile=<path to archive to write (or read, to extract or verify)>\n";
+  cerr << "      <target_dir (or, to extract, destination dir; default .)\n";
+  cerr << "       (or, to verify, the directory the archive was made from;\n";
+  cerr << "        without one only the catalog checksums are checked)>\n\n";
 }
@@ -22,95 +22,222 @@
 
 #include "parfu_main.hh"
 
-Parfu_rank_order_set::Parfu_rank_order_set(string order_buffer){
-  unsigned entry_begin,entry_end;
-  unsigned line_begin,line_end;
+// pack one bucket's worth of orders into the binary wire format
+// described in parfu_rank_move_data.hh
+string parfu_encode_order_set(vector <parfu_move_order_t> &order_list){
+  parfu_wire_order_set_header_t set_header;
+  vector <parfu_wire_order_t> wire_orders(order_list.size());
+  string string_table;
+  // each distinct string goes into the table only once
+  map <string,uint64_t> string_offsets;
+  string out_buffer;
+
+  for(unsigned ndx=0; ndx<order_list.size(); ndx++){
+    parfu_move_order_t *order = &(order_list.at(ndx));
+    parfu_wire_order_t *wire_order = &(wire_orders.at(ndx));
+    string *table_strings[2] = { &(order->rel_filename), &(order->symlink_target) };
+    uint64_t table_offsets[2];
+    for(int i=0; i<2; i++){
+      auto found = string_offsets.find(*(table_strings[i]));
+      if(found != string_offsets.end()){
+	table_offsets[i] = found->second;
+      }
+      else{
+	table_offsets[i] = string_table.size();
+	string_offsets[*(table_strings[i])] = table_offsets[i];
+	string_table.append(*(table_strings[i]));
+      }
+    }
+    wire_order->file_index = order->file_index;
+    wire_order->file_type = order->file_type;
+    wire_order->name_offset = table_offsets[0];
+    wire_order->name_length = order->rel_filename.size();
+    wire_order->target_offset = table_offsets[1];
+    wire_order->target_length = order->symlink_target.size();
+    wire_order->file_size = order->file_size;
+    wire_order->header_size = order->header_size;
+    wire_order->position_in_archive = order->position_in_archive;
+    wire_order->offset_in_file = order->offset_in_file;
+    wire_order->mode = order->mode;
+    wire_order->uid = order->uid;
+    wire_order->gid = order->gid;
+    wire_order->mtime = order->mtime;
+    wire_order->total_file_size = order->total_file_size;
+  }
+
+  set_header.magic = PARFU_WIRE_ORDER_MAGIC;
+  set_header.n_orders = wire_orders.size();
+  set_header.string_table_size = string_table.size();
+  
+  out_buffer.reserve(sizeof(set_header) +
+		     wire_orders.size()*sizeof(parfu_wire_order_t) +
+		     string_table.size());
+  out_buffer.append((const char*)(&set_header),sizeof(set_header));
+  out_buffer.append((const char*)(wire_orders.data()),
+		    wire_orders.size()*sizeof(parfu_wire_order_t));
+  out_buffer.append(string_table);
+  return out_buffer;
+}
+
+size_t parfu_wire_order_set_size(const char *wire_buffer,
+				 size_t wire_buffer_length){
+  parfu_wire_order_set_header_t set_header;
+  size_t set_size;
+  if(wire_buffer_length < sizeof(set_header)){
+    return 0;
+  }
+  memcpy(&set_header,wire_buffer,sizeof(set_header));
+  if(set_header.magic != PARFU_WIRE_ORDER_MAGIC){
+    return 0;
+  }
+  set_size = sizeof(set_header) +
+    set_header.n_orders*sizeof(parfu_wire_order_t) +
+    set_header.string_table_size;
+  if(set_size > wire_buffer_length){
+    return 0;
+  }
+  return set_size;
+}
+
+// Unpack a wire-format buffer, typically right out of the MPI receive
+// buffer.  The buffer may not be aligned (it comes after the
+// instruction letter) so the fixed-size records are memcpy()ed out
+// rather than cast in place.  
+Parfu_rank_order_set::Parfu_rank_order_set(const char *wire_buffer,
+					   size_t wire_buffer_length){
+  parfu_wire_order_set_header_t set_header;
+  parfu_wire_order_t wire_order;
   parfu_move_order_t local_move_order;
-  string type_string;
-  line_begin = 0;
-  line_end = 0;
-  while(line_begin < order_buffer.size()){
-    line_end = order_buffer.find(PARFU_LINE_SEPARATOR_CHARACTER,line_begin);
-    //    cerr << "line: >" << order_buffer.substr(line_begin,line_end) << "<\n"; 
-    if(line_end > order_buffer.length()){
-      cerr << "Parfu_rank_order_set: bad input buffer!\n";
-      throw "Could not find line ending!\n";
-    }
-    entry_begin = line_begin;
-    entry_end = order_buffer.find(PARFU_ENTRY_SEPARATOR_CHARACTER,entry_begin);
-
-    // grab file index
-    local_move_order.file_index = stoi(order_buffer.substr(entry_begin,entry_end-entry_begin));
-    entry_begin = entry_end + 1;
-    entry_end = order_buffer.find(PARFU_ENTRY_SEPARATOR_CHARACTER,entry_begin);
-
-    // grab relative filename
-    local_move_order.rel_filename = order_buffer.substr(entry_begin,entry_end-entry_begin);
-    entry_begin = entry_end + 1;
-    entry_end = order_buffer.find(PARFU_ENTRY_SEPARATOR_CHARACTER,entry_begin);
-    //    cerr << "debug order parse:>" << local_move_order.rel_filename << "<\n";
-    
-    // grab file type
-    type_string = order_buffer.substr(entry_begin,entry_end-entry_begin);
-    local_move_order.file_type = type_string.at(0);
-    entry_begin = entry_end + 1;
-    entry_end = order_buffer.find(PARFU_ENTRY_SEPARATOR_CHARACTER,entry_begin);
-    
-    // grab symlink target
-    local_move_order.symlink_target = order_buffer.substr(entry_begin,entry_end-entry_begin);
-    entry_begin = entry_end + 1;
-    entry_end = order_buffer.find(PARFU_ENTRY_SEPARATOR_CHARACTER,entry_begin);
-    
-    // grab file_size
-    local_move_order.file_size = stoi(order_buffer.substr(entry_begin,entry_end-entry_begin));
-    entry_begin = entry_end + 1;
-    entry_end = order_buffer.find(PARFU_ENTRY_SEPARATOR_CHARACTER,entry_begin);
-    
-    // grab header_size
-    local_move_order.header_size = stoi(order_buffer.substr(entry_begin,entry_end-entry_begin));
-    entry_begin = entry_end + 1;
-    entry_end = order_buffer.find(PARFU_ENTRY_SEPARATOR_CHARACTER,entry_begin);
-    
-    // grab position in archive
-    local_move_order.position_in_archive = stoi(order_buffer.substr(entry_begin,entry_end-entry_begin));
-    entry_begin = entry_end + 1;
-    entry_end = order_buffer.find(PARFU_LINE_SEPARATOR_CHARACTER,entry_begin);
-    
-    //    cerr << "debug read order: " << local_move_order.header_size << "  " << local_move_order.file_size;
-    //    cerr << "  " << local_move_order.position_in_archive << "\n";
-    // grab offset in file
-    local_move_order.offset_in_file = stoi(order_buffer.substr(entry_begin,entry_end-entry_begin));
+  const char *record_ptr;
+  const char *string_table;
 
-    //    if(type_string.size()>0)
+  if(wire_buffer_length < sizeof(set_header)){
+    cerr << "Parfu_rank_order_set: bad input buffer!\n";
+    throw "Order buffer too short!\n";
+  }
+  memcpy(&set_header,wire_buffer,sizeof(set_header));
+  if(set_header.magic != PARFU_WIRE_ORDER_MAGIC ||
+     wire_buffer_length != (sizeof(set_header) +
+			    set_header.n_orders*sizeof(parfu_wire_order_t) +
+			    set_header.string_table_size)){
+    cerr << "Parfu_rank_order_set: bad input buffer!\n";
+    throw "Order buffer is not a wire-format order set!\n";
+  }
+  record_ptr = wire_buffer + sizeof(set_header);
+  string_table = record_ptr + set_header.n_orders*sizeof(parfu_wire_order_t);
+  
+  orders.reserve(set_header.n_orders);
+  for(uint64_t ndx=0; ndx<set_header.n_orders; ndx++){
+    memcpy(&wire_order,record_ptr,sizeof(wire_order));
+    record_ptr += sizeof(wire_order);
     
+    local_move_order.file_index = wire_order.file_index;
+    local_move_order.rel_filename.assign(string_table+wire_order.name_offset,
+					 wire_order.name_length);
+    local_move_order.file_type = wire_order.file_type;
+    local_move_order.symlink_target.assign(string_table+wire_order.target_offset,
+					   wire_order.target_length);
+    local_move_order.file_size = wire_order.file_size;
+    local_move_order.header_size = wire_order.header_size;
+    local_move_order.position_in_archive = wire_order.position_in_archive;
+    local_move_order.offset_in_file = wire_order.offset_in_file;
+    local_move_order.mode = wire_order.mode;
+    local_move_order.uid = wire_order.uid;
+    local_move_order.gid = wire_order.gid;
+    local_move_order.mtime = wire_order.mtime;
+    local_move_order.total_file_size = wire_order.total_file_size;
     orders.push_back(local_move_order);
-    
-    // cleanup for next line
-    line_begin = entry_end + 1;
-    entry_begin = line_begin;
   }
+}
+
+// the old text form of one order (see parfu_2022_catalog_format.txt).
+// Only used for debugging now.  
+string parfu_move_order_text(parfu_move_order_t &order){
+  string out_string;
+  
+  out_string.append(to_string(order.file_index));
+  out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  out_string.append(order.rel_filename);
+  out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  out_string += order.file_type;
+  out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  out_string.append(order.symlink_target);
+  out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  out_string.append(to_string(order.file_size));
+  out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  out_string.append(to_string(order.header_size));
+  out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  out_string.append(to_string(order.position_in_archive));
+  out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  out_string.append(to_string(order.offset_in_file));
+  out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  out_string.append(to_string(order.mode));
+  out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  out_string.append(to_string(order.uid));
+  out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  out_string.append(to_string(order.gid));
+  out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  out_string.append(to_string(order.mtime));
+  out_string += PARFU_ENTRY_SEPARATOR_CHARACTER;
+  out_string.append(to_string(order.total_file_size));
+  out_string += PARFU_LINE_SEPARATOR_CHARACTER;
+  return out_string;
+}
+
+string Parfu_rank_order_set::dump_text(void){
+  string out_string;
+  for(unsigned ndx=0; ndx<orders.size(); ndx++){
+    out_string.append(parfu_move_order_text(orders.at(ndx)));
+  }
+  return out_string;
+}
 
+// Reads length bytes of a target file starting at offset with plain
+// POSIX calls.  Returns 0 on success.
+static int parfu_pread_target(string filename, char *destination,
+			      unsigned long length, unsigned long offset){
+  int target_fd;
+  ssize_t n_read;
+  unsigned long done=0;
 
-  //  orders.push_back(local_move_order);
+  if((target_fd=open(filename.c_str(),O_RDONLY))<0){
+    cerr << "parfu_pread_target: open " << filename << ": " << strerror(errno) << "\n";
+    return -1;
+  }
+  while(done < length){
+    n_read = pread(target_fd,destination+done,length-done,offset+done);
+    if(n_read < 0 && errno == EINTR){
+      continue;
+    }
+    if(n_read <= 0){
+      cerr << "parfu_pread_target: pread " << filename << ": ";
+      cerr << (n_read ? strerror(errno) : "file is shorter than expected") << "\n";
+      close(target_fd);
+      return -1;
+    }
+    done += n_read;
+  }
+  close(target_fd);
+  return 0;
 }
 
-// this is a function that populates a single bucket in an archive
-// file on disk.  This is typically run by a single worker node
-// on one set of orders that it gets
-int Parfu_rank_order_set::move_data_Create(string base_path,
-					   unsigned long bucket_size,
-					   MPI_File *archive_file_handle){
-  // create-mode data movement
-  // all data should fit within a bucket, so we'll use that for the
-  // buffer size
-  void *staging_buffer = nullptr;
-  MPI_File *target_file = nullptr;
-  //  unsigned long file_start_in_target;
-  //  unsigned long file_start_in_archive;
+// this is a function that populates a single bucket of an archive
+// file in memory.  This is typically run by a single worker node
+// on one set of orders that it gets; the create pipeline writes it out.
+unsigned long Parfu_rank_order_set::fill_bucket_Create(string base_path,
+						       unsigned long bucket_size,
+						       void *staging_buffer,
+						       unsigned long *n_unreadable){
+  MPI_File target_file;
+  vector <parfu_uring_read_t> small_reads;
+  // which order each of small_reads is for
+  vector <unsigned> small_read_orders;
+  // PARFU_SLICE_* flags for each order's slice
+  vector <uint32_t> slice_flags(orders.size(),0);
+  int count_read;
+  Parfu_uring_reader *uring_reader;
   unsigned long file_start_in_bucket;
-  tarentry my_tarentry;
   string full_filename;
-  string header_contents;
   unsigned long bucket_location_in_archive;
   unsigned long total_bucket_length;
   unsigned long blocked_bucket_length;
@@ -118,37 +245,19 @@ int Parfu_rank_order_set::move_data_Create(string base_path,
   int return_val;
   MPI_Status my_mpi_status;
 
-  
-  if((staging_buffer=(void*)malloc(bucket_size))==nullptr){
-    cerr << "move_data_Create: could not allocate staging buffer!\n";
-    return -1;
-  }
-
   if(bucket_size != parfu_next_block_boundary(bucket_size)){
-    cerr << "move_data_Create WARNING!  bucket_size is not a multiple\n";
+    cerr << "fill_bucket_Create WARNING!  bucket_size is not a multiple\n";
     cerr << "of the tar block size (512 bytes)!  This is likely fatal in\n";
     cerr << "most cases!\n";
   }
   
-  bucket_location_in_archive =
-    orders.front().position_in_archive;
+  bucket_location_in_archive = bucket_location();
   total_bucket_length =
     (orders.back().position_in_archive +
      orders.back().header_size +
      orders.back().file_size) -
     bucket_location_in_archive;
-  target_file = new MPI_File;
-
-  //  cerr << "bucket: " << orders.front().position_in_archive;
-  //  cerr << "  " << orders.back().position_in_archive;
-  //cerr << "  ";
-  //cerr << (orders.back().position_in_archive +
-  //	   orders.back().header_size +
-  //	   orders.back().file_size);
-  //cerr << "\n";
-    
 
-    
   if(total_bucket_length > bucket_size){
     cerr << "WARNING WARNING!  Bucket won't fit in buffer!\n";
     cerr << "n_norders:" <<orders.size() << "\n";
@@ -177,32 +286,100 @@ int Parfu_rank_order_set::move_data_Create(string base_path,
       orders.at(ndx).position_in_archive - bucket_location_in_archive;
     // first establish the header
     if(orders.at(ndx).header_size){
-      // this does a stat to pull the information
+      // the metadata came with the order, so this doesn't touch
+      // the file system
       parfu_make_tar_header_at(full_filename,
+			       &(orders.at(ndx)),
 			       staging_buffer,
 			       file_start_in_bucket);
     } // if(orders.at(ndx).header_size)
     // move the payload data if it has any
     if(orders.at(ndx).file_size){
       file_start_in_bucket += orders.at(ndx).header_size;
+      if(orders.at(ndx).file_size <= PARFU_POSIX_READ_THRESHOLD){
+	// small pieces: a plain open/pread/close is much cheaper than
+	// standing up an MPI-IO file handle for a few hundred bytes.
+	// They're collected up and all read at the end.
+	parfu_uring_read_t small_read;
+	small_read.filename = full_filename;
+	small_read.destination = ((char*)(staging_buffer))+file_start_in_bucket;
+	small_read.length = orders.at(ndx).file_size;
+	small_read.offset = orders.at(ndx).offset_in_file;
+	small_read.done = false;
+	small_reads.push_back(small_read);
+	small_read_orders.push_back(ndx);
+	continue;
+      }
       if((return_val=MPI_File_open(MPI_COMM_SELF,full_filename.c_str(),
 				   MPI_MODE_RDONLY,MPI_INFO_NULL,
-				   target_file))!=MPI_SUCCESS){
-	cerr << "move_data_Create:MPI_File_open() returned ";
+				   &target_file))!=MPI_SUCCESS){
+	cerr << "fill_bucket_Create:MPI_File_open() returned ";
 	cerr << return_val << " when trying to open for reading, file:" << orders.at(ndx).rel_filename << "\n";
+	slice_flags.at(ndx) |= PARFU_SLICE_SOURCE_UNREADABLE;
+	continue;
       }
-      if((return_val=MPI_File_read_at(*target_file,
+      if((return_val=MPI_File_read_at(target_file,
 				      orders.at(ndx).offset_in_file,
 				      ((void*)(((char*)(staging_buffer)+file_start_in_bucket))),
 				      orders.at(ndx).file_size,
 				      MPI_CHAR,&my_mpi_status))!=MPI_SUCCESS){
-	cerr << "move_data_Create:MPI_File_read_at() returned ";
+	cerr << "fill_bucket_Create:MPI_File_read_at() returned ";
 	cerr << return_val << " when trying to pull data from target file.\n";
-	
+	slice_flags.at(ndx) |= PARFU_SLICE_SOURCE_UNREADABLE;
+      }
+      else if(MPI_Get_count(&my_mpi_status,MPI_CHAR,&count_read) != MPI_SUCCESS ||
+	      ((unsigned long)count_read) != orders.at(ndx).file_size){
+	cerr << "fill_bucket_Create: short read from " << orders.at(ndx).rel_filename << "\n";
+	slice_flags.at(ndx) |= PARFU_SLICE_SOURCE_UNREADABLE;
       }
+      MPI_File_close(&target_file);
     }
   } // for(unsigned ndx=0; ndx<orders.size() ; ndx++)
 
+  // with more than one small file, let io_uring overlap them;
+  // anything it doesn't finish is read the ordinary way, and
+  // whatever can't be read that way either is flagged below
+  if(small_reads.size() > 1 &&
+     (uring_reader=parfu_uring_reader()) != nullptr){
+    uring_reader->read_files(&small_reads);
+  }
+  for(unsigned i=0; i<small_reads.size(); i++){
+    if(small_reads.at(i).done){
+      continue;
+    }
+    if(parfu_pread_target(small_reads.at(i).filename,
+			  small_reads.at(i).destination,
+			  small_reads.at(i).length,
+			  small_reads.at(i).offset)){
+      cerr << "fill_bucket_Create: could not read target file:" << small_reads.at(i).filename << "\n";
+      slice_flags.at(small_read_orders.at(i)) |= PARFU_SLICE_SOURCE_UNREADABLE;
+    }
+  }
+
+  // Checksum each payload while it's still in the buffer.  Whatever
+  // couldn't be read is zeroed, rather than archiving what the
+  // buffer held from its last bucket, and its slice is flagged so
+  // that rank 0 leaves the file's checksum out and says so.
+  *n_unreadable = 0;
+  for(unsigned ndx=0; ndx<orders.size() ; ndx++){
+    if(!orders.at(ndx).file_size){
+      continue;
+    }
+    file_start_in_bucket = orders.at(ndx).position_in_archive +
+      orders.at(ndx).header_size - bucket_location_in_archive;
+    if(slice_flags.at(ndx)){
+      memset(((char*)(staging_buffer))+file_start_in_bucket,0,orders.at(ndx).file_size);
+      (*n_unreadable)++;
+    }
+    parfu_note_slice_checksum(file_start_in_bucket + bucket_location_in_archive -
+			      orders.at(ndx).offset_in_file,
+			      orders.at(ndx).offset_in_file,
+			      orders.at(ndx).file_size,
+			      parfu_crc32c(0,((char*)(staging_buffer))+file_start_in_bucket,
+					   orders.at(ndx).file_size),
+			      slice_flags.at(ndx));
+  }
+
   blocked_bucket_length = parfu_next_block_boundary(total_bucket_length);
   pad_size = blocked_bucket_length - total_bucket_length;
 
@@ -211,29 +388,701 @@ int Parfu_rank_order_set::move_data_Create(string base_path,
     memset(((char*)staging_buffer)+total_bucket_length,0,pad_size);
   }
   
-  // And now we copy the assembled contents of the bucket
-  // into the appropriate place in the bucket in the archive file
-  if((return_val=MPI_File_write_at(*archive_file_handle,
-				   bucket_location_in_archive,
-				   staging_buffer,
-				   blocked_bucket_length,MPI_CHAR,&my_mpi_status))!=MPI_SUCCESS){
-    cerr << "move_data_Create:MPI_File_write_at() returned ";
+  return blocked_bucket_length;
+} // unsigned long Parfu_rank_order_set::fill_bucket_Create
+
+unsigned long Parfu_rank_order_set::bucket_location(void){
+  return orders.front().position_in_archive;
+}
+
+unsigned long Parfu_rank_order_set::bucket_length(void){
+  return (orders.back().position_in_archive +
+	  orders.back().header_size +
+	  orders.back().file_size) - bucket_location();
+}
+
+int Parfu_rank_order_set::scatter_bucket_Extract(string base_path,
+						 void *staging_buffer,
+						 vector <parfu_metadata_t> *metadata_queue){
+  string full_filename;
+  unsigned long data_start_in_bucket;
+  unsigned long bytes_written;
+  ssize_t write_return;
+  int target_fd;
+  int return_val=0;
+  
+  for(unsigned ndx=0; ndx<orders.size() ; ndx++){
+    parfu_move_order_t *order = &(orders.at(ndx));
+    full_filename = base_path;
+    if(order->rel_filename.size()){
+      full_filename += "/";
+      full_filename += order->rel_filename;
+    }
+    switch(order->file_type){
+    case PARFU_FILE_TYPE_DIRECTORY_CHAR:
+      // these were all made in the directory phase, before any data
+      // moved (see parfu_make_directory_levels())
+      break;
+    case PARFU_FILE_TYPE_SYMLINK_CHAR:
+      if(!order->header_size){
+	break;
+      }
+      if(symlink(order->symlink_target.c_str(),full_filename.c_str())){
+	// replace whatever's in the way, like tar does
+	if(errno == EEXIST){
+	  unlink(full_filename.c_str());
+	  if(!symlink(order->symlink_target.c_str(),full_filename.c_str())){
+	    break;
+	  }
+	}
+	cerr << "scatter_bucket_Extract: could not make symlink " << full_filename;
+	cerr << ": " << strerror(errno) << "\n";
+	return_val = -1;
+      }
+      break;
+    case PARFU_FILE_TYPE_HARDLINK_CHAR:
+      // The file this is another name for may be written by some
+      // other rank, maybe not yet, so the link gets made with the
+      // metadata at the end (see parfu_restore_metadata()).
+      if(metadata_queue != nullptr){
+	parfu_metadata_t link_entry;
+	link_entry.path = full_filename;
+	link_entry.file_type = order->file_type;
+	link_entry.depth = count(order->rel_filename.begin(),order->rel_filename.end(),'/');
+	link_entry.link_target = base_path + "/" + order->symlink_target;
+	metadata_queue->push_back(link_entry);
+	continue;
+      }
+      if(parfu_make_hard_link(base_path + "/" + order->symlink_target,full_filename)){
+	return_val = -1;
+      }
+      continue;
+    case PARFU_FILE_TYPE_DUPLICATE_CHAR:
+      // A copy of another file, which like a hard link's may not be
+      // written yet.  Its own metadata comes from its header below.
+      // One with no target stands in for an original that wasn't
+      // selected, and gets that one's data from the original's entry
+      // (see Parfu_target_collection::select_entries()).
+      if(metadata_queue == nullptr && order->symlink_target.size() &&
+	 parfu_copy_file(base_path + "/" + order->symlink_target,full_filename)){
+	return_val = -1;
+      }
+      break;
+    case PARFU_FILE_TYPE_REGULAR_CHAR:
+      // No O_TRUNC: the slices of a big file are written by different
+      // ranks in any order.  Whoever has the first slice sets the
+      // size, which never cuts off data anyone else has written.
+      // Like tar, replace whatever's at the path rather than write
+      // through a link that's there.  A file that's all in this one
+      // order can go now; one split over several buckets was
+      // already replaced when it was preallocated (see
+      // parfu_preallocate_files()), and unlinking it now could lose
+      // slices other ranks have written.
+      if(order->header_size && order->file_size == order->total_file_size &&
+	 unlink(full_filename.c_str()) && errno != ENOENT){
+	cerr << "scatter_bucket_Extract: could not replace " << full_filename;
+	cerr << ": " << strerror(errno) << "\n";
+      }
+      if((target_fd=open(full_filename.c_str(),O_WRONLY|O_CREAT,0666))<0){
+	cerr << "scatter_bucket_Extract: could not open " << full_filename;
+	cerr << " for writing: " << strerror(errno) << "\n";
+	return_val = -1;
+	break;
+      }
+      if(order->header_size){
+	if(ftruncate(target_fd,order->total_file_size)){
+	  cerr << "scatter_bucket_Extract: could not set size of " << full_filename;
+	  cerr << ": " << strerror(errno) << "\n";
+	}
+      }
+      data_start_in_bucket = order->position_in_archive + order->header_size -
+	bucket_location();
+      bytes_written=0UL;
+      while(bytes_written < order->file_size){
+	if((write_return=pwrite(target_fd,
+				((char*)staging_buffer)+data_start_in_bucket+bytes_written,
+				order->file_size-bytes_written,
+				order->offset_in_file+bytes_written))<=0){
+	  if(write_return<0 && errno==EINTR){
+	    continue;
+	  }
+	  cerr << "scatter_bucket_Extract: write to " << full_filename;
+	  cerr << " failed: " << strerror(errno) << "\n";
+	  return_val = -1;
+	  break;
+	}
+	bytes_written += write_return;
+      }
+      close(target_fd);
+      break;
+    default:
+      cerr << "scatter_bucket_Extract: order for " << full_filename;
+      cerr << " has unknown type " << order->file_type << "\n";
+      return_val = -1;
+      continue;
+    }
+    // The entry's own header is the last block before its data (any
+    // pax or GNU long name blocks come before it).  Only the slice
+    // with the header has it.
+    if(metadata_queue != nullptr && order->header_size >= BLOCKSIZE){
+      const ustar_hdr *header = (const ustar_hdr*)
+	(((char*)staging_buffer) + order->position_in_archive +
+	 order->header_size - BLOCKSIZE - bucket_location());
+      parfu_metadata_t metadata;
+      if(tarentry::valid_header_block(*header)){
+	metadata.path = full_filename;
+	metadata.file_type = order->file_type;
+	metadata.depth = count(order->rel_filename.begin(),order->rel_filename.end(),'/');
+	metadata.mode = tarentry::parse_number(header->mode,sizeof(header->mode));
+	metadata.uid = tarentry::parse_number(header->uid,sizeof(header->uid));
+	metadata.gid = tarentry::parse_number(header->gid,sizeof(header->gid));
+	metadata.mtime = tarentry::parse_number(header->mtime,sizeof(header->mtime));
+	if(order->file_type == PARFU_FILE_TYPE_DUPLICATE_CHAR &&
+	   order->symlink_target.size()){
+	  metadata.link_target = base_path + "/" + order->symlink_target;
+	}
+	metadata_queue->push_back(metadata);
+      }
+    }
+  } // for(unsigned ndx=0; ndx<orders.size() ; ndx++)
+  return return_val;
+} // int Parfu_rank_order_set::scatter_bucket_Extract
+
+int Parfu_rank_order_set::verify_bucket(string base_path,
+					void *staging_buffer){
+  string full_filename;
+  string source_data;
+  unsigned long data_start_in_bucket;
+  unsigned long data_location;
+  uint32_t flags;
+  int n_bad=0;
+
+  for(unsigned ndx=0; ndx<orders.size() ; ndx++){
+    parfu_move_order_t *order = &(orders.at(ndx));
+    full_filename = base_path;
+    if(order->rel_filename.size()){
+      full_filename += "/";
+      full_filename += order->rel_filename;
+    }
+    data_start_in_bucket = order->position_in_archive + order->header_size -
+      bucket_location();
+    data_location = order->position_in_archive + order->header_size -
+      order->offset_in_file;
+    // A header that tar wouldn't take gets an empty slice of its own,
+    // so rank 0 can say which member it belongs to.
+    if(order->header_size >= BLOCKSIZE &&
+       !tarentry::valid_header_block(*((const ustar_hdr*)
+				       (((char*)staging_buffer) +
+					data_start_in_bucket - BLOCKSIZE)))){
+      parfu_note_slice_checksum(data_location,0,0,0,PARFU_SLICE_BAD_HEADER);
+      n_bad++;
+    }
+    if(order->file_type == PARFU_FILE_TYPE_HARDLINK_CHAR ||
+       order->file_type == PARFU_FILE_TYPE_DUPLICATE_CHAR){
+      // No data of its own, so its source file gets checked against
+      // the member it refers to, whose size and CRC32C rank 0 has.
+      // One with no target is a stand-in whose data was checked as
+      // a regular file (see Parfu_target_collection::select_entries()).
+      if(base_path.size() && order->symlink_target.size()){
+	uint32_t source_checksum;
+	unsigned long source_size;
+	flags = 0;
+	if(parfu_whole_file_crc32c(full_filename,&source_checksum,&source_size)){
+	  cerr << "verify_bucket: could not read " << full_filename << "\n";
+	  flags |= PARFU_SLICE_SOURCE_UNREADABLE;
+	  source_checksum = 0;
+	  source_size = 0;
+	  n_bad++;
+	}
+	parfu_note_slice_checksum(data_location,0,source_size,source_checksum,flags);
+      }
+      continue;
+    }
+    if(order->file_type != PARFU_FILE_TYPE_REGULAR_CHAR){
+      continue;
+    }
+    flags = 0;
+    // comparing the bytes that are in the archive can't tell that
+    // the source has grown, so the slice with the header checks its
+    // size too (even for an empty file, which has no other slice)
+    if(base_path.size() && order->header_size >= BLOCKSIZE){
+      struct stat source_statbuf;
+      if(stat(full_filename.c_str(),&source_statbuf)){
+	cerr << "verify_bucket: could not stat " << full_filename << ": ";
+	cerr << strerror(errno) << "\n";
+	flags |= PARFU_SLICE_SOURCE_UNREADABLE;
+      }
+      else if(((unsigned long)(source_statbuf.st_size)) != order->total_file_size){
+	flags |= PARFU_SLICE_DIFFERS_FROM_SOURCE;
+      }
+    }
+    if(!order->file_size){
+      if(flags){
+	parfu_note_slice_checksum(data_location,0,0,0,flags);
+	n_bad++;
+      }
+      continue;
+    }
+    if(base_path.size() && !(flags & PARFU_SLICE_SOURCE_UNREADABLE)){
+      source_data.resize(order->file_size);
+      if(parfu_pread_target(full_filename,&(source_data[0]),
+			    order->file_size,order->offset_in_file)){
+	flags |= PARFU_SLICE_SOURCE_UNREADABLE;
+      }
+      else if(memcmp(source_data.data(),
+		     ((char*)staging_buffer)+data_start_in_bucket,
+		     order->file_size)){
+	flags |= PARFU_SLICE_DIFFERS_FROM_SOURCE;
+      }
+    }
+    if(flags){
+      n_bad++;
+    }
+    parfu_note_slice_checksum(data_location,
+			      order->offset_in_file,
+			      order->file_size,
+			      parfu_crc32c(0,((char*)staging_buffer)+data_start_in_bucket,
+					   order->file_size),
+			      flags);
+  }
+  return n_bad;
+} // int Parfu_rank_order_set::verify_bucket
+
+// how much of a file parfu_copy_file() moves at a time
+#define PARFU_COPY_BUFFER_SIZE   (4UL*1024UL*1024UL)
+
+int parfu_copy_file(string source_path, string copy_path){
+  int source_fd,copy_fd;
+  vector <char> buffer(PARFU_COPY_BUFFER_SIZE);
+  ssize_t bytes_read,bytes_written,write_return;
+  int return_val=0;
+
+  if((source_fd=open(source_path.c_str(),O_RDONLY))<0){
+    cerr << "could not open " << source_path << " to copy it to ";
+    cerr << copy_path << ": " << strerror(errno) << "\n";
+    return -1;
+  }
+  // replace whatever's in the way, rather than writing through a
+  // link that's there
+  unlink(copy_path.c_str());
+  if((copy_fd=open(copy_path.c_str(),O_WRONLY|O_CREAT|O_EXCL,0666))<0){
+    cerr << "could not open " << copy_path << " for writing: ";
+    cerr << strerror(errno) << "\n";
+    close(source_fd);
+    return -1;
+  }
+  while((bytes_read=read(source_fd,buffer.data(),buffer.size())) != 0){
+    if(bytes_read < 0){
+      if(errno == EINTR){
+	continue;
+      }
+      cerr << "could not read " << source_path << ": " << strerror(errno) << "\n";
+      return_val = -1;
+      break;
+    }
+    bytes_written=0;
+    while(bytes_written < bytes_read){
+      if((write_return=write(copy_fd,buffer.data()+bytes_written,
+			     bytes_read-bytes_written))<=0){
+	if(write_return<0 && errno==EINTR){
+	  continue;
+	}
+	cerr << "write to " << copy_path << " failed: " << strerror(errno) << "\n";
+	return_val = -1;
+	break;
+      }
+      bytes_written += write_return;
+    }
+    if(return_val){
+      break;
+    }
+  }
+  close(source_fd);
+  if(close(copy_fd)){
+    return_val = -1;
+  }
+  return return_val;
+}
+
+int parfu_make_hard_link(string link_target, string link_path){
+  if(link(link_target.c_str(),link_path.c_str())){
+    // replace whatever's in the way, like tar does
+    if(errno == EEXIST){
+      unlink(link_path.c_str());
+      if(!link(link_target.c_str(),link_path.c_str())){
+	return 0;
+      }
+    }
+    cerr << "could not make hard link " << link_path << " to ";
+    cerr << link_target << ": " << strerror(errno) << "\n";
+    return -1;
+  }
+  return 0;
+}
+
+int parfu_make_directory_path(string directory_path){
+  size_t slash_position=0;
+  string partial_path;
+
+  while(slash_position != string::npos){
+    slash_position = directory_path.find('/',slash_position+1);
+    partial_path = directory_path.substr(0,slash_position);
+    if(partial_path.size() && mkdir(partial_path.c_str(),0777) && errno != EEXIST){
+      cerr << "parfu_make_directory_path: could not make " << partial_path;
+      cerr << ": " << strerror(errno) << "\n";
+      return -1;
+    }
+  }
+  return 0;
+}
+
+Parfu_buffer_pool::Parfu_buffer_pool(unsigned long in_bucket_size,
+				     unsigned initial_buffers){
+  unsigned long page_size = sysconf(_SC_PAGESIZE);
+  void *new_buffer;
+  
+  pool_bucket_size = in_bucket_size;
+  mapped_size = ((pool_bucket_size + page_size - 1) / page_size) * page_size;
+  for(unsigned i=0; i<initial_buffers; i++){
+    if((new_buffer=allocate_buffer())==nullptr){
+      cerr << "Parfu_buffer_pool: could not allocate staging buffer " << i << "!\n";
+      throw "Could not allocate staging buffer!\n";
+    }
+    free_buffers.push_back(new_buffer);
+  }
+}
+
+Parfu_buffer_pool::~Parfu_buffer_pool(){
+  if(free_buffers.size() != all_buffers.size()){
+    cerr << "WARNING! Parfu_buffer_pool destroyed with ";
+    cerr << (all_buffers.size()-free_buffers.size()) << " buffers still borrowed!\n";
+  }
+  for(unsigned i=0; i<all_buffers.size(); i++){
+    munmap(all_buffers.at(i),mapped_size);
+  }
+  all_buffers.clear();
+  free_buffers.clear();
+}
+
+void *Parfu_buffer_pool::allocate_buffer(void){
+  void *new_buffer=MAP_FAILED;
+  unsigned long page_size = sysconf(_SC_PAGESIZE);
+  
+#if defined(PARFU_USE_HUGETLB) && defined(MAP_HUGETLB)
+  new_buffer = mmap(nullptr,mapped_size,PROT_READ|PROT_WRITE,
+		    MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+#endif
+  if(new_buffer == MAP_FAILED){
+    new_buffer = mmap(nullptr,mapped_size,PROT_READ|PROT_WRITE,
+		      MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+    if(new_buffer == MAP_FAILED){
+      cerr << "Parfu_buffer_pool: mmap() of " << mapped_size;
+      cerr << " bytes failed: " << strerror(errno) << "\n";
+      return nullptr;
+    }
+#ifdef MADV_HUGEPAGE
+    // only advice; fine if the kernel ignores it
+    madvise(new_buffer,mapped_size,MADV_HUGEPAGE);
+#endif
+  }
+  // pre-fault every page now
+  for(unsigned long i=0; i<mapped_size; i+=page_size){
+    ((volatile char*)new_buffer)[i] = 0;
+  }
+  all_buffers.push_back(new_buffer);
+  return new_buffer;
+}
+
+void *Parfu_buffer_pool::borrow_buffer(void){
+  void *buffer;
+  if(free_buffers.empty()){
+    return allocate_buffer();
+  }
+  buffer = free_buffers.back();
+  free_buffers.pop_back();
+  return buffer;
+}
+
+void Parfu_buffer_pool::return_buffer(void *buffer){
+  if(buffer != nullptr){
+    free_buffers.push_back(buffer);
+  }
+}
+
+unsigned long Parfu_buffer_pool::bucket_size(void){
+  return pool_bucket_size;
+}
+
+Parfu_create_pipeline::Parfu_create_pipeline(Parfu_buffer_pool *in_pool,
+					     unsigned in_depth){
+  void *staging_buffer;
+  pool = in_pool;
+  bucket_size = pool->bucket_size();
+  if(in_depth < 1){
+    in_depth = 1;
+  }
+  for(unsigned i=0; i<in_depth; i++){
+    if((staging_buffer=pool->borrow_buffer())==nullptr){
+      cerr << "Parfu_create_pipeline: could not get staging buffer " << i << "!\n";
+      throw "Could not get staging buffer!\n";
+    }
+    staging_buffers.push_back(staging_buffer);
+    io_requests.push_back(MPI_REQUEST_NULL);
+  }
+  compressed_buffers.resize(staging_buffers.size());
+  next_slot=0;
+}
+
+Parfu_create_pipeline::~Parfu_create_pipeline(){
+  drain();
+  for(unsigned i=0; i<staging_buffers.size(); i++){
+    pool->return_buffer(staging_buffers.at(i));
+  }
+  staging_buffers.clear();
+}
+
+int Parfu_create_pipeline::submit_bucket(Parfu_rank_order_set *order_set,
+					 string base_path,
+					 MPI_File *archive_file_handle){
+  unsigned slot = next_slot;
+  unsigned long blocked_bucket_length;
+  unsigned long n_unreadable;
+  void *write_buffer;
+  unsigned long write_location;
+  unsigned long write_length;
+  int return_val;
+
+  // the buffer we're about to fill may still be in flight from
+  // the last time around
+  wait_for_slot(slot);
+  blocked_bucket_length =
+    order_set->fill_bucket_Create(base_path,
+				  bucket_size,
+				  staging_buffers.at(slot),
+				  &n_unreadable);
+  write_buffer = staging_buffers.at(slot);
+  write_location = order_set->bucket_location();
+  write_length = blocked_bucket_length;
+  if(parfu_bucket_compression()){
+    // the bucket becomes one gzip member, which goes in the partial
+    // file at twice its uncompressed location (see
+    // parfu_compressed_archive.hh)
+    if(compressed_buffers.at(slot).size() < parfu_gzip_bound(bucket_size)){
+      compressed_buffers.at(slot).resize(parfu_gzip_bound(bucket_size));
+    }
+    write_buffer = &(compressed_buffers.at(slot)[0]);
+    write_length = parfu_gzip_member(staging_buffers.at(slot),blocked_bucket_length,
+				     write_buffer,compressed_buffers.at(slot).size());
+    write_location = 2*order_set->bucket_location();
+    parfu_note_compressed_bucket(order_set->bucket_location(),blocked_bucket_length,
+				 write_length);
+  }
+  if((return_val=MPI_File_iwrite_at(*archive_file_handle,
+				    write_location,
+				    write_buffer,
+				    write_length,MPI_CHAR,
+				    &(io_requests.at(slot))))!=MPI_SUCCESS){
+    cerr << "submit_bucket:MPI_File_iwrite_at() returned ";
     cerr << return_val << " when trying to write complete bucket to archive file.\n";
+    io_requests.at(slot) = MPI_REQUEST_NULL;
+    return -1;
+  }
+  next_slot = (next_slot + 1) % staging_buffers.size();
+  if(n_unreadable){
+    return -1;
   }
+  return 0;
+}
+
+long int Parfu_create_pipeline::submit_order_sets(const char *wire_buffer,
+						 size_t wire_buffer_length,
+						 string base_path,
+						 MPI_File *archive_file_handle){
+  Parfu_rank_order_set *order_set;
+  size_t order_set_size;
+  long int sets_submitted=0;
   
-  free(staging_buffer);
-  staging_buffer=nullptr;
+  while(wire_buffer_length){
+    if(!(order_set_size=parfu_wire_order_set_size(wire_buffer,wire_buffer_length))){
+      return -1;
+    }
+    order_set = new Parfu_rank_order_set(wire_buffer,order_set_size);
+    submit_bucket(order_set,base_path,archive_file_handle);
+    delete order_set;
+    sets_submitted++;
+    wire_buffer += order_set_size;
+    wire_buffer_length -= order_set_size;
+  }
+  return sets_submitted;
+}
+
+long int Parfu_create_pipeline::extract_order_sets(const char *wire_buffer,
+						  size_t wire_buffer_length,
+						  string base_path,
+						  MPI_File *archive_file_handle){
+  return read_order_sets(wire_buffer,wire_buffer_length,base_path,
+			 archive_file_handle,false);
+}
+
+long int Parfu_create_pipeline::verify_order_sets(const char *wire_buffer,
+						 size_t wire_buffer_length,
+						 string base_path,
+						 MPI_File *archive_file_handle){
+  return read_order_sets(wire_buffer,wire_buffer_length,base_path,
+			 archive_file_handle,true);
+}
+
+int Parfu_create_pipeline::finish_read_bucket(Parfu_rank_order_set *order_set,
+					      string base_path,
+					      void *staging_buffer,
+					      bool verify){
+  if(verify){
+    // a mismatch isn't a failure to do the order; rank 0 reports it
+    order_set->verify_bucket(base_path,staging_buffer);
+    return 0;
+  }
+  return order_set->scatter_bucket_Extract(base_path,staging_buffer,
+					   &restore_queue);
+}
+
+long int Parfu_create_pipeline::read_order_sets(const char *wire_buffer,
+						size_t wire_buffer_length,
+						string base_path,
+						MPI_File *archive_file_handle,
+						bool verify){
+  vector <Parfu_rank_order_set*> order_sets;
+  size_t order_set_size;
+  unsigned slot;
+  long int return_val=0;
+  
+  // no create-mode writes may still be using the buffers
+  drain();
+  while(wire_buffer_length){
+    if(!(order_set_size=parfu_wire_order_set_size(wire_buffer,wire_buffer_length))){
+      return_val = -1;
+      break;
+    }
+    order_sets.push_back(new Parfu_rank_order_set(wire_buffer,order_set_size));
+    if(order_sets.back()->bucket_length() > bucket_size){
+      cerr << "read_order_sets: bucket of " << order_sets.back()->bucket_length();
+      cerr << " bytes won't fit in buffer of " << bucket_size << "!\n";
+      delete order_sets.back();
+      order_sets.pop_back();
+      return_val = -1;
+      break;
+    }
+    wire_buffer += order_set_size;
+    wire_buffer_length -= order_set_size;
+  }
+
+  // Keep up to depth() reads going ahead of the set being written
+  // out (or checked).  A slot is free again as soon as its set has
+  // been scattered, because scattering is synchronous.  
+  if(parfu_archive_is_compressed()){
+    // each bucket has to be pieced together from the gzip members
+    // that hold it, so it's done one at a time
+    for(unsigned ndx=0; ndx<order_sets.size(); ndx++){
+      if(parfu_read_compressed_range(archive_file_handle,
+				     order_sets.at(ndx)->bucket_location(),
+				     order_sets.at(ndx)->bucket_length(),
+				     staging_buffers.front()) ||
+	 finish_read_bucket(order_sets.at(ndx),base_path,
+			    staging_buffers.front(),verify)){
+	return_val = -1;
+      }
+      delete order_sets.at(ndx);
+    }
+    if(return_val < 0){
+      return return_val;
+    }
+    return order_sets.size();
+  }
+
+  for(unsigned ndx=0; ndx<order_sets.size() && ndx<depth(); ndx++){
+    MPI_File_iread_at(*archive_file_handle,
+		      order_sets.at(ndx)->bucket_location(),
+		      staging_buffers.at(ndx),
+		      order_sets.at(ndx)->bucket_length(),MPI_CHAR,
+		      &(io_requests.at(ndx)));
+  }
+  for(unsigned ndx=0; ndx<order_sets.size(); ndx++){
+    slot = ndx % depth();
+    wait_for_slot(slot);
+    if(finish_read_bucket(order_sets.at(ndx),base_path,
+			  staging_buffers.at(slot),verify)){
+      return_val = -1;
+    }
+    if(ndx+depth() < order_sets.size()){
+      MPI_File_iread_at(*archive_file_handle,
+			order_sets.at(ndx+depth())->bucket_location(),
+			staging_buffers.at(slot),
+			order_sets.at(ndx+depth())->bucket_length(),MPI_CHAR,
+			&(io_requests.at(slot)));
+    }
+    delete order_sets.at(ndx);
+  }
+  if(return_val < 0){
+    return return_val;
+  }
+  return order_sets.size();
+}
+
+int Parfu_create_pipeline::wait_for_slot(unsigned slot){
+  int return_val;
+  if(io_requests.at(slot) == MPI_REQUEST_NULL){
+    return 0;
+  }
+  if((return_val=MPI_Wait(&(io_requests.at(slot)),MPI_STATUS_IGNORE))!=MPI_SUCCESS){
+    cerr << "Parfu_create_pipeline: MPI_Wait() returned ";
+    cerr << return_val << " waiting on a bucket write!\n";
+    return -1;
+  }
   return 0;
-} // int Parfu_rank_order_set::move_data_Create
+}
+
+int Parfu_create_pipeline::drain(void){
+  int return_val=0;
+  for(unsigned i=0; i<io_requests.size(); i++){
+    return_val += wait_for_slot(i);
+  }
+  return return_val;
+}
+
+unsigned Parfu_create_pipeline::depth(void){
+  return staging_buffers.size();
+}
 
 void parfu_make_tar_header_at(string full_filename,
+			      parfu_move_order_t *order,
 			      void* current_bucket_buffer,
 			      unsigned long location_in_bucket){
   std::vector<char> temp_file_header_C;
   tarentry my_tarentry;
+  struct stat order_statbuf;
+  string link_name = order->symlink_target;
+
+  // rebuild just the parts of the stat buffer the tar header uses
+  // from what the spider captured
+  memset(&order_statbuf,0,sizeof(order_statbuf));
+  order_statbuf.st_mode = order->mode;
+  order_statbuf.st_uid = order->uid;
+  order_statbuf.st_gid = order->gid;
+  order_statbuf.st_mtime = order->mtime;
+  order_statbuf.st_size = order->total_file_size;
+  
+  // a duplicate is a hard link as far as tar is concerned
+  bool is_hardlink = (order->file_type == PARFU_FILE_TYPE_HARDLINK_CHAR ||
+		      order->file_type == PARFU_FILE_TYPE_DUPLICATE_CHAR);
+  
+  if(is_hardlink){
+    // the order has the other name relative to the base path, but
+    // in the archive it's under the base path, like this one
+    link_name = full_filename.substr(0,full_filename.size()-order->rel_filename.size()) +
+      order->symlink_target;
+  }
   
   //  cerr << "creating header at: " << location_in_bucket << "\n";
-  my_tarentry = tarentry(full_filename,0);
+  my_tarentry = tarentry(full_filename,0,order_statbuf,link_name,is_hardlink);
   temp_file_header_C = my_tarentry.make_tar_header();
   std::copy(temp_file_header_C.begin(), temp_file_header_C.end(),
 	    ((((char*)(current_bucket_buffer))+
@@ -262,7 +1111,7 @@ unsigned long Parfu_rank_order_set::total_size(void){
 }
 
 string Parfu_rank_order_set::order_n_filename(int order_index){
-  if(order_index>orders.size()){
+  if(order_index<0 || ((unsigned)order_index)>=orders.size()){
     cerr << "WARNING! ordner_n_filename() called with index=" << order_index << "\n";
     cerr << "which is outside of bounds!\n";
     return string("");
@@ -29,11 +29,6 @@
 //#include "parfu_2021_legacy.hh"
 //#include "parfu_primary.h"
 
-void parfu_make_tar_header_at(string full_filename,
-			      void* current_bucket_buffer,
-			      unsigned long location_in_bucket);
-
-
 // each of this is one move order for either a file or a file slice
 typedef struct{
   int file_index;
@@ -44,29 +39,252 @@ typedef struct{
   unsigned header_size;
   unsigned long position_in_archive;
   unsigned long offset_in_file;
+  // metadata from the spider, for building the tar header
+  // without a stat()
+  mode_t mode;
+  uid_t uid;
+  gid_t gid;
+  time_t mtime;
+  // size of the whole target file (file_size above is just this slice)
+  unsigned long total_file_size;
 }parfu_move_order_t;
 
-#endif
+// What extract mode has to put back on an entry once all the data is
+// written: its mode, owner and mtime, pulled out of the entry's tar
+// header as the bucket goes by.  These queue up on each rank and get
+// applied in one sweep at the end (see parfu_restore_metadata()), so
+// the data phase never does anything but write data.  Hard links and
+// duplicates are made then too, once everything they could point to
+// is there.
+typedef struct{
+  string path;
+  char file_type;
+  // for a hard link, the file it's another name for; for a
+  // duplicate, the file it's a copy of
+  string link_target;
+  // number of '/' in the path within the archive
+  unsigned depth;
+  mode_t mode;
+  uid_t uid;
+  gid_t gid;
+  time_t mtime;
+}parfu_metadata_t;
+
+// mkdir -p: make the directory and any missing parents.  Returns 0
+// if the directory exists afterwards.
+int parfu_make_directory_path(string directory_path);
+// ln: make link_path another name for link_target, replacing
+// whatever is at link_path already.  Returns 0 on success.
+int parfu_make_hard_link(string link_target, string link_path);
+// cp: make copy_path a copy of the contents of source_path,
+// replacing whatever is at copy_path already.  Returns 0 on success.
+int parfu_copy_file(string source_path, string copy_path);
+
+void parfu_make_tar_header_at(string full_filename,
+			      parfu_move_order_t *order,
+			      void* current_bucket_buffer,
+			      unsigned long location_in_bucket);
+
+/////////////////////////////
+//
+// Binary wire format for a set of move orders (one bucket's worth).
+// This is what rank 0 sends a worker in a "C" order.  The text version
+// of the orders (see parfu_2022_catalog_format.txt) is still available
+// from parfu_move_order_text() for debugging, but it's not sent
+// anywhere.  
+//
+// Layout of the buffer:
+//   parfu_wire_order_set_header_t
+//   n_orders x parfu_wire_order_t
+//   string table: all the filenames and symlink targets, back to back,
+//                 each one stored only once per order set
+// Every number is a fixed-width 64 bit field, so offsets and sizes
+// past 2 GiB (or 4 GiB) are no problem, and the receiver pulls each
+// record straight out of the receive buffer without any parsing.
+// The buffer is *not* null terminated and may contain nulls.
+
+#define PARFU_WIRE_ORDER_MAGIC  (0x3630757266726170UL) // "parfu06" 
+
+typedef struct{
+  uint64_t magic;
+  uint64_t n_orders;
+  uint64_t string_table_size;
+}parfu_wire_order_set_header_t;
+
+typedef struct{
+  int64_t file_index;
+  int64_t file_type;
+  // location of strings within the string table
+  uint64_t name_offset;
+  uint64_t name_length;
+  uint64_t target_offset;
+  uint64_t target_length;
+  uint64_t file_size;
+  uint64_t header_size;
+  uint64_t position_in_archive;
+  uint64_t offset_in_file;
+  uint64_t mode;
+  uint64_t uid;
+  uint64_t gid;
+  int64_t mtime;
+  uint64_t total_file_size;
+}parfu_wire_order_t;
+
+string parfu_encode_order_set(vector <parfu_move_order_t> &order_list);
+// total length of the order set at the front of wire_buffer, so that
+// several order sets can be sent back to back in one message.
+// Returns 0 if the buffer doesn't hold a valid order set.
+size_t parfu_wire_order_set_size(const char *wire_buffer,
+				 size_t wire_buffer_length);
+string parfu_move_order_text(parfu_move_order_t &order);
 
 /////////////////////////////
 //
 class Parfu_rank_order_set
 {
 public:
-  // construct an order set from a buffer with
-  // text order instructions
-  Parfu_rank_order_set(string order_buffer);
-  int move_data_Create(string base_path,
-		       unsigned long bucket_size,
-		       MPI_File *my_file_handle);
+  // construct an order set from a buffer in the
+  // binary wire format above
+  Parfu_rank_order_set(const char *wire_buffer,
+		       size_t wire_buffer_length);
+  // assemble the bucket (headers, file data, and padding) in
+  // staging_buffer without writing it anywhere.  Returns the
+  // length of the bucket to write, which is a multiple of BLOCKSIZE.
+  // *n_unreadable is how many slices couldn't be read; those are
+  // zeros in the bucket and flagged in their slice checksums.
+  unsigned long fill_bucket_Create(string base_path,
+				   unsigned long bucket_size,
+				   void *staging_buffer,
+				   unsigned long *n_unreadable);
+  unsigned long bucket_location(void);
+  // length of the bucket's data in the archive, not rounded up
+  unsigned long bucket_length(void);
+  // extract-mode data movement: staging_buffer already holds the
+  // whole bucket as read from the archive in one read.  Write each
+  // payload to its target file at its own offset.  The metadata for each
+  // entry whose header is in the bucket goes on metadata_queue, if
+  // there is one.
+  int scatter_bucket_Extract(string base_path,
+			     void *staging_buffer,
+			     vector <parfu_metadata_t> *metadata_queue=nullptr);
+  // verify mode: staging_buffer holds the bucket as read from the
+  // archive.  Checksum each payload and, if there's a base path,
+  // compare it with the source file under it.  Everything found is
+  // noted with parfu_note_slice_checksum() for rank 0 to sort out.
+  // Returns how many headers or payloads were bad.
+  int verify_bucket(string base_path,
+		    void *staging_buffer);
   int n_orders(void);
   unsigned long total_size(void);
   string order_n_filename(int order_index);
+  string dump_text(void);
 private:
   vector <parfu_move_order_t> orders;
   
 };
 
+// A worker's pool of staging buffers.  The buffers are page aligned
+// and every page is touched when they're allocated, so the page
+// faults (and huge page setup, if any) happen once per job when the
+// bucket size arrives rather than once per bucket.  Buffers are
+// borrowed and returned; they're only given back to the OS when the
+// pool is destroyed.  If all the buffers are out, borrowing makes a
+// new one, which then stays in the pool.
+class Parfu_buffer_pool
+{
+public:
+  Parfu_buffer_pool(unsigned long in_bucket_size,
+		    unsigned initial_buffers);
+  ~Parfu_buffer_pool();
+  void *borrow_buffer(void);
+  void return_buffer(void *buffer);
+  unsigned long bucket_size(void);
+private:
+  void *allocate_buffer(void);
+  unsigned long pool_bucket_size;
+  // bucket size rounded up to whole pages
+  unsigned long mapped_size;
+  vector <void*> all_buffers;
+  vector <void*> free_buffers;
+};
+
+// A worker's create-mode pipeline.  It borrows several staging
+// buffers from the pool, and each bucket submitted is assembled in the next free buffer and
+// then written to the archive with a nonblocking MPI_File_iwrite_at
+// (compressed first, in compressed mode; see parfu_compressed_archive.hh).
+// So while bucket N is being written, the target files for bucket N+1
+// are being read into another buffer.  A buffer is only reused once
+// its previous write has completed.  
+class Parfu_create_pipeline
+{
+public:
+  Parfu_create_pipeline(Parfu_buffer_pool *in_pool,
+			unsigned in_depth);
+  ~Parfu_create_pipeline();
+  // The order set isn't referenced after this returns, so the
+  // caller can delete it right away.  Returns -1 if the write
+  // couldn't be started or some of the bucket's data couldn't be
+  // read (it's still written, with zeros in place of that data).
+  int submit_bucket(Parfu_rank_order_set *order_set,
+		    string base_path,
+		    MPI_File *archive_file_handle);
+  // submit every order set in a buffer of one or more wire-format
+  // order sets back to back.  Returns how many were submitted, or -1
+  // if the buffer holds something that isn't an order set.
+  long int submit_order_sets(const char *wire_buffer,
+			     size_t wire_buffer_length,
+			     string base_path,
+			     MPI_File *archive_file_handle);
+  // Extract mode.  The order sets in the buffer are read from the
+  // archive into the staging buffers with MPI_File_iread_at, each one
+  // started while the one before it is being written out to the
+  // target files.  Returns the number of order sets done or -1.
+  long int extract_order_sets(const char *wire_buffer,
+			      size_t wire_buffer_length,
+			      string base_path,
+			      MPI_File *archive_file_handle);
+  // Verify mode.  The buckets are read the same way as for
+  // extract_order_sets(), but checked (see verify_bucket()) instead
+  // of written out.  base_path is the source tree, or empty to only
+  // checksum.
+  long int verify_order_sets(const char *wire_buffer,
+			     size_t wire_buffer_length,
+			     string base_path,
+			     MPI_File *archive_file_handle);
+  // wait for all outstanding writes.  This must be done before
+  // the archive file is closed.
+  int drain(void);
+  unsigned depth(void);
+  // metadata of everything extract_order_sets() has written out
+  vector <parfu_metadata_t> *metadata_queue(void){
+    return &restore_queue;
+  }
+private:
+  int wait_for_slot(unsigned slot);
+  // the guts of extract_order_sets() and verify_order_sets()
+  long int read_order_sets(const char *wire_buffer,
+			   size_t wire_buffer_length,
+			   string base_path,
+			   MPI_File *archive_file_handle,
+			   bool verify);
+  // scatter or verify one bucket that's been read
+  int finish_read_bucket(Parfu_rank_order_set *order_set,
+			 string base_path,
+			 void *staging_buffer,
+			 bool verify);
+  Parfu_buffer_pool *pool;
+  unsigned long bucket_size;
+  vector <void*> staging_buffers;
+  // the outstanding write (create) or read (extract) on each buffer
+  vector <MPI_Request> io_requests;
+  // in compressed mode, what each slot actually writes
+  vector <string> compressed_buffers;
+  unsigned next_slot;
+  vector <parfu_metadata_t> restore_queue;
+};
+
+#endif
+
 /* 
 
   std::vector<char> temp_file_header_C;
@@ -0,0 +1,304 @@
+////////////////////////////////////////////////////////////////////////////////
+// 
+//  University of Illinois/NCSA Open Source License
+//  http://otm.illinois.edu/disclose-protect/illinois-open-source-license
+//  
+//  Parfu is copyright (c) 2017-2022, 
+//  by The Trustees of the University of Illinois. 
+//  All rights reserved.
+//  
+//  Parfu was developed by:
+//  The University of Illinois
+//  The National Center For Supercomputing Applications (NCSA)
+//  Blue Waters Science and Engineering Applications Support Team (SEAS)
+//  Craig P Steffen <csteffen@ncsa.illinois.edu>
+//  Roland Haas <rhaas@illinois.edu>
+//  
+//  https://github.com/ncsa/parfu_archive_tool
+//  http://www.ncsa.illinois.edu/People/csteffen/parfu/
+//  
+//  For full licnse text see the LICENSE file provided with the source
+//  distribution.
+//  
+////////////////////////////////////////////////////////////////////////////////
+
+#include "parfu_main.hh"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <sys/resource.h>
+
+////////////////
+//
+// Threaded version of Parfu_directory::spider_directory().
+//
+// On a parallel file system most of the time spent spidering is spent
+// waiting on the metadata server, one request at a time.  Here a pool
+// of threads each read directories independently so that many
+// metadata requests are in flight at once.  
+//
+// Each thread has its own deque of directories waiting to be read.  A
+// thread pushes the subdirectories it finds onto the back of its own
+// deque and takes its next directory off the back (so it works
+// depth-first and doesn't keep lots of directories open).  A thread
+// whose deque is empty steals from the *front* of another thread's
+// deque, which is where the biggest untouched subtrees are.
+//
+// Directories are opened with openat() relative to their parent's open
+// file descriptor and entries are stat()ed with fstatat() (see
+// Parfu_directory::scan_open_directory()), so no full path strings
+// are built or walked for the file system calls.  
+//
+// Each directory is only ever read by one thread, and only that thread
+// adds to its subfiles and subdirectories, so the tree itself needs no
+// locking; only the deques do.
+//
+// Every queued subdirectory keeps its parent open, so a wide tree could
+// run us out of file descriptors.  Once too many are held open we stop
+// keeping parents around and queue their subdirectories by full path
+// instead.  
+//
+// A thread with nothing to do sleeps on a condition variable until
+// somebody queues more work or the whole walk is finished.  
+
+// An open directory that its queued subdirectories still need for
+// openat().  It gets closed when the last of them lets go of it.
+class Parfu_open_directory
+{
+public:
+  Parfu_open_directory(DIR *in_dir, atomic <long int> *in_open_count){
+    dir_ptr = in_dir;
+    open_count = in_open_count;
+    (*open_count)++;
+  }
+  ~Parfu_open_directory(void){
+    if(dir_ptr != nullptr){
+      closedir(dir_ptr);
+    }
+    (*open_count)--;
+  }
+  int fd(void){
+    return dirfd(dir_ptr);
+  }
+private:
+  DIR *dir_ptr=nullptr;
+  // how many of these are open right now, across all threads
+  atomic <long int> *open_count;
+};
+
+// one directory waiting to be read
+typedef struct{
+  Parfu_directory *directory;
+  // parent directory to openat() relative to; nullptr means
+  // name is a path relative to the CWD (the top directory)
+  shared_ptr <Parfu_open_directory> parent;
+  string name;
+}parfu_spider_task_t;
+
+class Parfu_spider_deque
+{
+public:
+  void push(parfu_spider_task_t task){
+    lock_guard <mutex> my_lock(deque_mutex);
+    tasks.push_back(task);
+  }
+  // owner end
+  bool pop(parfu_spider_task_t *task){
+    lock_guard <mutex> my_lock(deque_mutex);
+    if(tasks.empty()){
+      return false;
+    }
+    *task = tasks.back();
+    tasks.pop_back();
+    return true;
+  }
+  // thief end
+  bool steal(parfu_spider_task_t *task){
+    lock_guard <mutex> my_lock(deque_mutex);
+    if(tasks.empty()){
+      return false;
+    }
+    *task = tasks.front();
+    tasks.pop_front();
+    return true;
+  }
+private:
+  mutex deque_mutex;
+  deque <parfu_spider_task_t> tasks;
+};
+
+// what all the spider threads share
+typedef struct{
+  vector <Parfu_spider_deque> *deques;
+  // work_mutex guards directories_pending and tasks_queued; idle
+  // threads wait on work_ready for either of them to change.
+  mutex work_mutex;
+  condition_variable work_ready;
+  // directories queued or being read right now.  When this hits
+  // zero there's nothing left to find.
+  long int directories_pending;
+  // directories sitting in a deque that nobody has taken yet
+  long int tasks_queued;
+  atomic <long int> total_entries_found;
+  // directories held open, and how many we allow before we
+  // stop holding parents open for their subdirectories
+  atomic <long int> open_directories;
+  long int max_open_directories;
+}parfu_spider_shared_t;
+
+static void parfu_spider_thread(unsigned int my_index,
+				parfu_spider_shared_t *shared){
+  unsigned int n_deques = shared->deques->size();
+  Parfu_spider_deque *my_deque = &(shared->deques->at(my_index));
+  parfu_spider_task_t task;
+  bool got_task;
+  
+  while(true){
+    got_task = my_deque->pop(&task);
+    for(unsigned int i=1; !got_task && i<n_deques; i++){
+      got_task = shared->deques->at((my_index+i)%n_deques).steal(&task);
+    }
+    if(got_task){
+      lock_guard <mutex> my_lock(shared->work_mutex);
+      shared->tasks_queued--;
+    }
+    else{
+      // somebody is still reading a directory and might find
+      // more, so we sleep until they queue some or we're all done
+      unique_lock <mutex> my_lock(shared->work_mutex);
+      shared->work_ready.wait(my_lock,[shared]{
+	  return shared->tasks_queued > 0 || shared->directories_pending == 0;
+	});
+      if(shared->directories_pending == 0){
+	return;
+      }
+      continue;
+    }
+    
+    int parent_fd = (task.parent == nullptr) ? AT_FDCWD : task.parent->fd();
+    int my_fd;
+    DIR *my_dir;
+    long int entries_found;
+    if((my_fd=openat(parent_fd,task.name.c_str(),
+		     O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC)) < 0){
+      cerr << "Could not open directory >>" << task.name << "<< for scanning: ";
+      cerr << strerror(errno) << "\n";
+      task.directory->stat_unopened_directory(parent_fd,task.name.c_str());
+    }
+    else if((my_dir=fdopendir(my_fd)) == nullptr){
+      cerr << "fdopendir failed for directory >>" << task.name << "<<!\n";
+      close(my_fd);
+      task.directory->stat_unopened_directory(parent_fd,task.name.c_str());
+    }
+    else{
+      shared_ptr <Parfu_open_directory> me =
+	make_shared <Parfu_open_directory> (my_dir,&(shared->open_directories));
+      entries_found = task.directory->scan_open_directory(my_dir);
+      if(entries_found > 0){
+	shared->total_entries_found += entries_found;
+      }
+      if(shared->open_directories.load() > shared->max_open_directories){
+	// too many held open already; our subdirectories get
+	// opened by their whole path instead of relative to us
+	me = nullptr;
+      }
+      // queue up our subdirectories before we count ourselves done
+      // so that directories_pending never drops to zero early
+      unsigned int n_subdirs = task.directory->N_subdirs();
+      if(n_subdirs > 0){
+	lock_guard <mutex> my_lock(shared->work_mutex);
+	shared->directories_pending += n_subdirs;
+      }
+      for(unsigned int i=0; i<n_subdirs; i++){
+	parfu_spider_task_t subdir_task;
+	string subdir_path;
+	subdir_task.directory = task.directory->nth_subdir(i);
+	subdir_task.parent = me;
+	subdir_path = subdir_task.directory->get_relative_path();
+	if(me == nullptr){
+	  subdir_task.name = subdir_task.directory->get_base_path();
+	  subdir_task.name.append("/");
+	  subdir_task.name.append(subdir_path);
+	}
+	else{
+	  subdir_task.name = subdir_path.substr(subdir_path.rfind('/')+1);
+	}
+	my_deque->push(subdir_task);
+	{
+	  lock_guard <mutex> my_lock(shared->work_mutex);
+	  shared->tasks_queued++;
+	}
+	shared->work_ready.notify_one();
+      }
+      task.directory->set_spidered();
+    }
+    // let go of our hold on the parent before we say we're done
+    task.parent = nullptr;
+    bool all_done;
+    {
+      lock_guard <mutex> my_lock(shared->work_mutex);
+      shared->directories_pending--;
+      all_done = (shared->directories_pending == 0);
+    }
+    if(all_done){
+      shared->work_ready.notify_all();
+      return;
+    }
+  }
+}
+
+long int Parfu_directory::spider_directory_threaded(unsigned int n_threads){
+  vector <Parfu_spider_deque> deques;
+  vector <thread> spider_threads;
+  parfu_spider_shared_t shared;
+  parfu_spider_task_t top_task;
+  struct rlimit fd_limit;
+  
+  if(spidered){
+    cerr << "This directory already spidered!  >>" << base_path << "\n";
+    return -1L;
+  }
+  if(n_threads < 1){
+    n_threads = thread::hardware_concurrency();
+    if(n_threads < 1){
+      n_threads = 1;
+    }
+  }
+  cerr << "threaded spider dir: base=>" << base_path ;
+  cerr << "< relative=>" << relative_path << "< threads=" << n_threads << "\n";
+
+  deques = vector <Parfu_spider_deque> (n_threads);
+  shared.deques = &deques;
+  shared.directories_pending = 1;
+  shared.tasks_queued = 1;
+  shared.total_entries_found = 0;
+  shared.open_directories = 0;
+  // leave half of our file descriptors for everything else;
+  // with no limit at all we still don't hold more than 512
+  shared.max_open_directories = 512;
+  if(!getrlimit(RLIMIT_NOFILE,&fd_limit) && fd_limit.rlim_cur != RLIM_INFINITY){
+    shared.max_open_directories = fd_limit.rlim_cur / 2;
+  }
+  
+  top_task.directory = this;
+  top_task.parent = nullptr;
+  top_task.name = base_path;
+  if(relative_path.length() > 0){
+    top_task.name.append("/");
+    top_task.name.append(relative_path);
+  }
+  deques.at(0).push(top_task);
+
+  for(unsigned int i=0; i<n_threads; i++){
+    spider_threads.push_back(thread(parfu_spider_thread,i,&shared));
+  }
+  for(unsigned int i=0; i<n_threads; i++){
+    spider_threads.at(i).join();
+  }
+  
+  return shared.total_entries_found.load();
+}
@@ -0,0 +1,287 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  University of Illinois/NCSA Open Source License
+//  http://otm.illinois.edu/disclose-protect/illinois-open-source-license
+//
+//  Parfu is copyright (c) 2017-2022,
+//  by The Trustees of the University of Illinois.
+//  All rights reserved.
+//
+//  Parfu was developed by:
+//  The University of Illinois
+//  The National Center For Supercomputing Applications (NCSA)
+//  Blue Waters Science and Engineering Applications Support Team (SEAS)
+//  Craig P Steffen <csteffen@ncsa.illinois.edu>
+//  Roland Haas <rhaas@illinois.edu>
+//
+//  https://github.com/ncsa/parfu_archive_tool
+//  http://www.ncsa.illinois.edu/People/csteffen/parfu/
+//
+//  For full licnse text see the LICENSE file provided with the source
+//  distribution.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "parfu_main.hh"
+
+#ifdef PARFU_USE_IO_URING
+#include <sys/syscall.h>
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+#endif
+
+// see parfu_uring_reader.hh
+
+// The reader needs kernel headers new enough to have direct
+// descriptors and linked opens (IORING_FEAT_LINKED_FILE came last,
+// in 5.17).  With older headers, like those on EL7 and EL8, it's
+// built as the stub below and everything goes through pread().
+#if defined(PARFU_USE_IO_URING) && defined(IORING_FEAT_LINKED_FILE) && \
+  defined(__NR_io_uring_setup)
+#define PARFU_HAVE_IO_URING
+#endif
+
+#ifdef PARFU_HAVE_IO_URING
+
+// what each completion was for, kept in the low bits of user_data
+#define PARFU_URING_OP_OPEN   (0)
+#define PARFU_URING_OP_READ   (1)
+#define PARFU_URING_OP_CLOSE  (2)
+
+Parfu_uring_reader::Parfu_uring_reader(void){
+  struct io_uring_params params;
+  int fixed_files[PARFU_URING_BATCH_FILES];
+
+  memset(&params,0,sizeof(params));
+  // three SQEs per file; the CQ ring defaults to twice that
+  ring_fd = syscall(__NR_io_uring_setup,3*PARFU_URING_BATCH_FILES,&params);
+  if(ring_fd < 0){
+    return;
+  }
+  if(!(params.features & IORING_FEAT_LINKED_FILE) ||
+     params.sq_entries < 3*PARFU_URING_BATCH_FILES){
+    shut_down();
+    return;
+  }
+  sq_ring_size = params.sq_off.array + params.sq_entries*sizeof(unsigned);
+  cq_ring_size = params.cq_off.cqes + params.cq_entries*sizeof(struct io_uring_cqe);
+  if(params.features & IORING_FEAT_SINGLE_MMAP){
+    sq_ring_size = max(sq_ring_size,cq_ring_size);
+    cq_ring_size = 0;
+  }
+  sq_ring = mmap(nullptr,sq_ring_size,PROT_READ|PROT_WRITE,
+		 MAP_SHARED|MAP_POPULATE,ring_fd,IORING_OFF_SQ_RING);
+  if(sq_ring == MAP_FAILED){
+    sq_ring = nullptr;
+    shut_down();
+    return;
+  }
+  if(cq_ring_size){
+    cq_ring = mmap(nullptr,cq_ring_size,PROT_READ|PROT_WRITE,
+		   MAP_SHARED|MAP_POPULATE,ring_fd,IORING_OFF_CQ_RING);
+    if(cq_ring == MAP_FAILED){
+      cq_ring = nullptr;
+      shut_down();
+      return;
+    }
+  }
+  sqes_size = params.sq_entries*sizeof(struct io_uring_sqe);
+  sqes = (struct io_uring_sqe*)mmap(nullptr,sqes_size,PROT_READ|PROT_WRITE,
+				    MAP_SHARED|MAP_POPULATE,ring_fd,IORING_OFF_SQES);
+  if(sqes == MAP_FAILED){
+    sqes = nullptr;
+    shut_down();
+    return;
+  }
+  sq_tail = (unsigned*)(((char*)sq_ring)+params.sq_off.tail);
+  sq_mask = (unsigned*)(((char*)sq_ring)+params.sq_off.ring_mask);
+  sq_array = (unsigned*)(((char*)sq_ring)+params.sq_off.array);
+  {
+    char *cq_base = (char*)(cq_ring_size ? cq_ring : sq_ring);
+    cq_head = (unsigned*)(cq_base+params.cq_off.head);
+    cq_tail = (unsigned*)(cq_base+params.cq_off.tail);
+    cq_mask = (unsigned*)(cq_base+params.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe*)(cq_base+params.cq_off.cqes);
+  }
+  // an empty fixed file table for the direct opens to land in
+  for(int i=0; i<PARFU_URING_BATCH_FILES; i++){
+    fixed_files[i] = -1;
+  }
+  if(syscall(__NR_io_uring_register,ring_fd,IORING_REGISTER_FILES,
+	     fixed_files,PARFU_URING_BATCH_FILES) < 0){
+    shut_down();
+    return;
+  }
+}
+
+void Parfu_uring_reader::shut_down(void){
+  if(sqes != nullptr){
+    munmap(sqes,sqes_size);
+    sqes = nullptr;
+  }
+  if(cq_ring != nullptr){
+    munmap(cq_ring,cq_ring_size);
+    cq_ring = nullptr;
+  }
+  if(sq_ring != nullptr){
+    munmap(sq_ring,sq_ring_size);
+    sq_ring = nullptr;
+  }
+  if(ring_fd >= 0){
+    close(ring_fd);
+    ring_fd = -1;
+  }
+}
+
+Parfu_uring_reader::~Parfu_uring_reader(void){
+  shut_down();
+}
+
+// Queues and runs the open/read/close chains for count requests
+// starting at first, and waits for all of them.  Returns -1 if the
+// ring itself failed, in which case none of the batch is marked done.
+int Parfu_uring_reader::submit_batch(vector <parfu_uring_read_t> *requests,
+				     unsigned long first, unsigned long count){
+  unsigned tail = *sq_tail;
+  unsigned to_submit = 3*count;
+  unsigned n_completed = 0;
+  struct io_uring_sqe *sqe;
+  long return_val;
+
+  for(unsigned long i=0; i<count; i++){
+    parfu_uring_read_t *request = &(requests->at(first+i));
+    __u64 tag = ((__u64)(first+i)) << 2;
+    
+    request->done = false;
+    // open straight into fixed file slot i
+    sqe = &(sqes[tail & *sq_mask]);
+    memset(sqe,0,sizeof(*sqe));
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (__u64)(uintptr_t)(request->filename.c_str());
+    sqe->open_flags = O_RDONLY;
+    sqe->file_index = i+1;
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = tag | PARFU_URING_OP_OPEN;
+    sq_array[tail & *sq_mask] = tail & *sq_mask;
+    tail++;
+    // a failed open cancels the rest of the chain.  The read is
+    // hard-linked to the close so the slot is freed even if the
+    // read fails.
+    sqe = &(sqes[tail & *sq_mask]);
+    memset(sqe,0,sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = i;
+    sqe->addr = (__u64)(uintptr_t)(request->destination);
+    sqe->len = request->length;
+    sqe->off = request->offset;
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+    sqe->user_data = tag | PARFU_URING_OP_READ;
+    sq_array[tail & *sq_mask] = tail & *sq_mask;
+    tail++;
+    sqe = &(sqes[tail & *sq_mask]);
+    memset(sqe,0,sizeof(*sqe));
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = i+1;
+    sqe->user_data = tag | PARFU_URING_OP_CLOSE;
+    sq_array[tail & *sq_mask] = tail & *sq_mask;
+    tail++;
+  }
+  __atomic_store_n(sq_tail,tail,__ATOMIC_RELEASE);
+
+  // every SQE gets a completion, including cancelled ones
+  while(n_completed < 3*count){
+    return_val = syscall(__NR_io_uring_enter,ring_fd,to_submit,
+			 3*count-n_completed,IORING_ENTER_GETEVENTS,nullptr,0);
+    if(return_val < 0){
+      if(errno == EINTR){
+	continue;
+      }
+      cerr << "Parfu_uring_reader: io_uring_enter: " << strerror(errno) << "\n";
+      return -1;
+    }
+    to_submit -= return_val;
+    unsigned head = *cq_head;
+    while(head != __atomic_load_n(cq_tail,__ATOMIC_ACQUIRE)){
+      struct io_uring_cqe *cqe = &(cqes[head & *cq_mask]);
+      if((cqe->user_data & 3) == PARFU_URING_OP_READ){
+	parfu_uring_read_t *request = &(requests->at(cqe->user_data >> 2));
+	request->done = (cqe->res >= 0 &&
+			 ((unsigned long)(cqe->res)) == request->length);
+      }
+      head++;
+      n_completed++;
+    }
+    __atomic_store_n(cq_head,head,__ATOMIC_RELEASE);
+  }
+  return 0;
+}
+
+unsigned long Parfu_uring_reader::read_files(vector <parfu_uring_read_t> *requests){
+  unsigned long n_failed=0;
+  
+  for(unsigned long first=0; first<requests->size(); first+=PARFU_URING_BATCH_FILES){
+    unsigned long count = min((unsigned long)PARFU_URING_BATCH_FILES,
+			      requests->size()-first);
+    if(submit_batch(requests,first,count)){
+      // the ring is no good any more; the caller reads the rest
+      for(unsigned long i=first; i<requests->size(); i++){
+	requests->at(i).done = false;
+      }
+      shut_down();
+      break;
+    }
+  }
+  for(unsigned long i=0; i<requests->size(); i++){
+    if(!requests->at(i).done){
+      n_failed++;
+    }
+  }
+  return n_failed;
+}
+
+Parfu_uring_reader *parfu_uring_reader(void){
+  static Parfu_uring_reader *reader=nullptr;
+  static bool tried=false;
+  if(!tried){
+    tried = true;
+    reader = new Parfu_uring_reader();
+    if(!reader->is_valid()){
+      delete reader;
+      reader = nullptr;
+    }
+  }
+  if(reader != nullptr && !reader->is_valid()){
+    return nullptr;
+  }
+  return reader;
+}
+
+#else // #ifdef PARFU_HAVE_IO_URING
+
+Parfu_uring_reader::Parfu_uring_reader(void){
+}
+
+Parfu_uring_reader::~Parfu_uring_reader(void){
+}
+
+void Parfu_uring_reader::shut_down(void){
+}
+
+int Parfu_uring_reader::submit_batch(vector <parfu_uring_read_t> *requests,
+				     unsigned long first, unsigned long count){
+  return -1;
+}
+
+unsigned long Parfu_uring_reader::read_files(vector <parfu_uring_read_t> *requests){
+  return requests->size();
+}
+
+Parfu_uring_reader *parfu_uring_reader(void){
+  return nullptr;
+}
+
+#endif // #ifdef PARFU_HAVE_IO_URING
@@ -0,0 +1,97 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  University of Illinois/NCSA Open Source License
+//  http://otm.illinois.edu/disclose-protect/illinois-open-source-license
+//
+//  Parfu is copyright (c) 2017-2022,
+//  by The Trustees of the University of Illinois.
+//  All rights reserved.
+//
+//  Parfu was developed by:
+//  The University of Illinois
+//  The National Center For Supercomputing Applications (NCSA)
+//  Blue Waters Science and Engineering Applications Support Team (SEAS)
+//  Craig P Steffen <csteffen@ncsa.illinois.edu>
+//  Roland Haas <rhaas@illinois.edu>
+//
+//  https://github.com/ncsa/parfu_archive_tool
+//  http://www.ncsa.illinois.edu/People/csteffen/parfu/
+//
+//  For full licnse text see the LICENSE file provided with the source
+//  distribution.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef PARFU_URING_READER_HH_
+#define PARFU_URING_READER_HH_
+
+#include "parfu_main.hh"
+
+////////////////
+//
+// Batched small-file reads through io_uring.
+//
+// For a bucket full of small files the synchronous path is an
+// open/pread/close round trip per file, one after the other.  This
+// reader instead queues a linked openat -> read -> close chain for
+// every file in a batch and submits the whole batch with one system
+// call, so the kernel can overlap the metadata lookups and reads.
+// The files are opened into the ring's own fixed file table (direct
+// descriptors), so nothing shows up in the process's fd table and
+// the read can be linked to the open that creates its descriptor.
+//
+// It talks to the kernel directly (no liburing).  If the kernel is
+// too old (needs IORING_FEAT_LINKED_FILE, 5.17 or later) or io_uring
+// is disabled, is_valid() is false and callers use pread instead.
+// Any individual read that fails or comes up short is reported back
+// so the caller can retry it synchronously.
+
+// number of files in flight in one submission
+#define PARFU_URING_BATCH_FILES          (64)
+
+typedef struct{
+  string filename;
+  char *destination;
+  unsigned long length;
+  unsigned long offset;
+  // filled in by read_files(): true if all length bytes were read
+  bool done;
+}parfu_uring_read_t;
+
+class Parfu_uring_reader
+{
+public:
+  Parfu_uring_reader(void);
+  ~Parfu_uring_reader(void);
+  bool is_valid(void){
+    return ring_fd >= 0;
+  }
+  // Reads every request in the list, PARFU_URING_BATCH_FILES at a
+  // time.  Returns the number of requests that didn't complete.
+  unsigned long read_files(vector <parfu_uring_read_t> *requests);
+private:
+  void shut_down(void);
+  int submit_batch(vector <parfu_uring_read_t> *requests,
+		   unsigned long first, unsigned long count);
+  int ring_fd=-1;
+  void *sq_ring=nullptr;
+  size_t sq_ring_size=0;
+  void *cq_ring=nullptr;
+  size_t cq_ring_size=0;
+  struct io_uring_sqe *sqes=nullptr;
+  size_t sqes_size=0;
+  unsigned *sq_tail=nullptr;
+  unsigned *sq_mask=nullptr;
+  unsigned *sq_array=nullptr;
+  unsigned *cq_head=nullptr;
+  unsigned *cq_tail=nullptr;
+  unsigned *cq_mask=nullptr;
+  struct io_uring_cqe *cqes=nullptr;
+};
+
+// The rank's reader, set up the first time it's asked for.  nullptr
+// if io_uring isn't usable here (or PARFU_USE_IO_URING isn't defined,
+// or the kernel headers it was built with are too old).
+Parfu_uring_reader *parfu_uring_reader(void);
+
+#endif // #ifndef PARFU_URING_READER_HH_
@@ -40,19 +40,72 @@
 //   "A" instuction: the rest of the message buffer is the name of an archive
 //       file that you are to do a collective open on now, and retain that
 //       parallel file pointer in your state.
+//   "R" the rest of the message buffer is the name of an existing archive
+//       file to do a collective open on, read-only, for extract mode.
+//   "T" the rest of the buffer is the name of a plain tar file (no parfu
+//       catalog).  Scan our share of it for tar headers and send what we
+//       find to rank 0; see parfu_index_foreign_tar().
 //   "U" instruction: the rest of the message buffer is a number that you are
-//       to set your internal bucket size to
+//       to set your internal bucket size to.  This is when the staging buffer
+//       pool gets allocated, so "D" has to come before it.
+//   "D" the rest of the buffer is the create-mode pipeline depth: how many
+//       staging buffers to cycle through so that reading one bucket
+//       overlaps writing the last one
+//   "O" the rest of the buffer is the table of user and group names
+//       for the uids and gids in the archive; load it into the tar header
+//       name cache so we never have to look them up ourselves.
 //   "N" switch out of "B" (broadcast) listening mode to "N" mode
 //       (iNdividual listening mode)
-//   "X" close down and exit
+//   "W" "Work plan" for self-scheduled create mode.  The rest of the
+//       buffer is the base path, a null, and then every order set for
+//       the archive back to back.  Everyone (rank 0 included) claims
+//       order sets off a shared counter until they're gone; see
+//       parfu_self_scheduled_Create().  We stay in "B" mode.
+//   "M" "Make directories" for extract mode.  The rest of the buffer is
+//       the base path, a null, and then the directories to make, level
+//       by level, then a null and the big files to preallocate; see
+//       parfu_make_directory_levels().  We stay in "B" mode.
+//   "H" "Hash" for dedup=on: the rest of the buffer is the files that
+//       might have the same contents as another.  Checksum and compare
+//       our share of them and send rank 0 the ones that do; see
+//       parfu_find_duplicate_files().
+//   "Q" send the checksums of every file slice we've moved to rank 0;
+//       see parfu_gather_slice_checksums()
+//   "G" "Gzip": compress each bucket we write from now on, and write it
+//       to the partial file (see parfu_compressed_archive.hh)
+//   "K" "pacK" the compressed buckets from the partial file into the
+//       archive named in the rest of the buffer; see
+//       parfu_compact_archive().  Everyone (rank 0 too) takes part.
+//   "Z" the archive we're extracting is compressed.  The rest of the
+//       buffer is its bucket table, in binary.
+//   "F" "Finish" extract mode: put back the mode, owner and mtime of
+//       everything we extracted; see parfu_restore_metadata().
+//   "X" close the archive (collectively, with rank 0), then close
+//       down and exit
 //
 //   in "N" mode, worker is listening for one-to-one individual MPI messages
 //      from rank 0.  
 // N mode valid incoming messages:
-//   "C" "create" mode (referenced to tar).  The rest of the buffer is a series
-//       of file transfer orders.  These will be copied from target files to
-//       the archive file.
+//   "C" "create" mode (referenced to tar).  The rest of the buffer is one
+//       or more order sets (buckets) back to back, each a series of file
+//       transfer orders.  These will be copied from target files to
+//       the archive file through the create pipeline.  The reply that
+//       we're done goes back as soon as the last bucket's write has been
+//       started; the writes are only waited on when a buffer is reused
+//       or before we exit.
+//   "E" "extract" mode.  Like "C", the rest of the buffer is one or more
+//       order sets back to back, but the data goes the other way: each
+//       bucket is read from the archive file in one read and the payloads
+//       written out to the target files under the base path.  ("X" was
+//       already taken.)  The reply goes back when it's all written.
+//   "V" "verify" mode.  The order sets are read just as for "E", but
+//       each payload is checksummed and, if the base path isn't empty,
+//       compared with the source file under it, instead of written out.
+//       What we found goes to rank 0 with the slice checksums ("Q").
 //   "P" rest of the buffer is new base path to set in your state
+//   "S" "spider" the rest of the buffer is a list of directories (relative
+//       to the base path), one per line.  Read each of them one level
+//       deep and send the entries back to rank 0 as spider batch lines.
 //   "B" switch out of "N" (iNdividual) broadcast receive mode to "B"
 //       (broadcast) receive mode
 //   "X" close down and exit
@@ -72,6 +125,8 @@ int parfu_worker_node(int my_rank, int total_ranks){
   string my_base_path;
   int mpi_return_val;
   int *my_length=nullptr;
+  // the length of the message we've got, null included
+  unsigned long message_length=0UL;
   char *message_buffer=nullptr;
   string instruction_letter;
   string archive_filename;
@@ -79,13 +134,15 @@ int parfu_worker_node(int my_rank, int total_ranks){
   char receive_mode='B'; // we start in "broadcast" receiving mode
   bool valid_instruction;
   unsigned long rank_bucket_size = 0UL;
+  unsigned rank_pipeline_depth = PARFU_DEFAULT_PIPELINE_DEPTH;
+  Parfu_create_pipeline *create_pipeline=nullptr;
+  Parfu_buffer_pool *buffer_pool=nullptr;
+  long int sets_submitted;
   
   MPI_File *file_handle=nullptr;
   vector <MPI_File*> archive_files;
   MPI_Status *message_status=nullptr;
   
-  Parfu_rank_order_set *my_rank_order;
-  
   if(my_rank==0){
     cerr << "parfu_worker_node got zero rank!!!\n";
     return -1;
@@ -110,7 +167,9 @@ int parfu_worker_node(int my_rank, int total_ranks){
   //
   // If the first letter is "C", the rest of the buffer is a set
   // of marching orders for file transfers from target files
-  // into the archive file in "create" mode.
+  // into the archive file in "create" mode.  These are in the
+  // binary wire format from parfu_encode_order_set(), so
+  // the buffer may contain nulls.
   //
   // If the first letter of the buffer is "X" then the worker
   // function returns.  
@@ -119,16 +178,17 @@ int parfu_worker_node(int my_rank, int total_ranks){
     switch(receive_mode){
     case 'B': // receiving in "broadcast" mode
       
-      // receive length of order buffer
+      // receive length of order buffer (64 bits; see
+      // parfu_broadcast_order())
       if((mpi_return_val =
-	  MPI_Bcast((void*)(my_length),1,MPI_INT,0,MPI_COMM_WORLD))!=MPI_SUCCESS){
+	  MPI_Bcast((void*)(&message_length),1,MPI_UNSIGNED_LONG,0,MPI_COMM_WORLD))!=MPI_SUCCESS){
 	cerr << "parfu_worker: 1 MPI_Bcast returned " << mpi_return_val << "!\n";
       }
       
       // receive the order string itself
-      message_buffer = (char*)malloc(*my_length);
+      message_buffer = (char*)malloc(message_length);
       if((mpi_return_val =
-	  MPI_Bcast(((void*)(message_buffer)),*my_length,MPI_CHAR,0,MPI_COMM_WORLD))!=MPI_SUCCESS){
+	  parfu_broadcast_bytes(message_buffer,message_length))!=MPI_SUCCESS){
 	cerr << "parfu_worker: 2 MPI_Bcast returned " << mpi_return_val << "!\n";
       }
       message_string=string(message_buffer);
@@ -144,6 +204,10 @@ int parfu_worker_node(int my_rank, int total_ranks){
 	// the rest of the buffer is the name of the archive file we need to open
 	// in a collective open.  
 	archive_filename = message_string.substr(1);
+	// don't switch archives with writes still outstanding
+	if(create_pipeline != nullptr){
+	  create_pipeline->drain();
+	}
 	if(file_handle==nullptr)
 	  file_handle = new MPI_File;
 	//	MPI_Barrier(MPI_COMM_WORLD);
@@ -153,12 +217,120 @@ int parfu_worker_node(int my_rank, int total_ranks){
 			  MPI_INFO_NULL,file_handle))!=MPI_SUCCESS){
 	  cerr << "parfu_worker rank:" << my_rank << " : 3 MPI_File_open returned " << mpi_return_val << "!\n";
 	}
-	archive_files.push_back(file_handle);
+	else{
+	  archive_files.push_back(file_handle);
+	}
       } // if(instruction_letter == "A"){
+      if(instruction_letter == "R"){
+	valid_instruction=true;
+	archive_filename = message_string.substr(1);
+	if(create_pipeline != nullptr){
+	  create_pipeline->drain();
+	}
+	if(file_handle==nullptr)
+	  file_handle = new MPI_File;
+	if((mpi_return_val =
+	    MPI_File_open(MPI_COMM_WORLD,archive_filename.c_str(),
+			  MPI_MODE_RDONLY,
+			  MPI_INFO_NULL,file_handle))!=MPI_SUCCESS){
+	  cerr << "parfu_worker rank:" << my_rank << " : MPI_File_open for reading returned " << mpi_return_val << "!\n";
+	}
+	else{
+	  archive_files.push_back(file_handle);
+	}
+      } // if(instruction_letter == "R"){
+      if(instruction_letter == "T"){
+	valid_instruction=true;
+	parfu_index_foreign_tar(message_string.substr(1),my_rank,total_ranks);
+      } // if(instruction_letter == "T"){
       if(instruction_letter == "U"){
 	valid_instruction=true;
 	// set bucket size
-	rank_bucket_size = stoi(message_string.substr(1));
+	rank_bucket_size = stoul(message_string.substr(1));
+	// the staging buffers are sized by the bucket size, so
+	// any we already have are the wrong size now.  Allocate
+	// (and fault in) the whole set right here, once.  
+	if(create_pipeline != nullptr){
+	  delete create_pipeline;
+	  create_pipeline=nullptr;
+	}
+	if(buffer_pool != nullptr){
+	  delete buffer_pool;
+	}
+	buffer_pool = new Parfu_buffer_pool(rank_bucket_size,
+					    rank_pipeline_depth);
+      }
+      if(instruction_letter == "D"){
+	valid_instruction=true;
+	rank_pipeline_depth = stoul(message_string.substr(1));
+	if(create_pipeline != nullptr){
+	  delete create_pipeline;
+	  create_pipeline=nullptr;
+	}
+      }
+      if(instruction_letter == "O"){
+	valid_instruction=true;
+	parfu_load_owner_name_table(message_string.substr(1));
+      }
+      if(instruction_letter == "H"){
+	valid_instruction=true;
+	parfu_find_duplicate_files(message_buffer+1,message_length-2,
+				   my_rank,total_ranks);
+      }
+      if(instruction_letter == "Q"){
+	valid_instruction=true;
+	parfu_gather_slice_checksums(my_rank,total_ranks);
+      }
+      if(instruction_letter == "G"){
+	valid_instruction=true;
+	parfu_set_bucket_compression(true);
+      }
+      if(instruction_letter == "K"){
+	valid_instruction=true;
+	// every bucket has to be in the partial file before it's packed
+	if(create_pipeline != nullptr){
+	  create_pipeline->drain();
+	}
+	parfu_compact_archive(file_handle,archive_filename,message_string.substr(1),
+			      nullptr,0,my_rank,total_ranks);
+      }
+      if(instruction_letter == "Z"){
+	valid_instruction=true;
+	parfu_load_bucket_table(message_buffer+1,message_length-2);
+      }
+      if(instruction_letter == "F"){
+	valid_instruction=true;
+	if(create_pipeline != nullptr){
+	  parfu_restore_metadata(create_pipeline->metadata_queue(),my_rank);
+	}
+	else{
+	  vector <parfu_metadata_t> empty_queue;
+	  parfu_restore_metadata(&empty_queue,my_rank);
+	}
+      } // if(instruction_letter == "F"){
+      if(instruction_letter == "M"){
+	valid_instruction=true;
+	my_base_path = string(message_buffer+1);
+	parfu_make_directory_levels(message_buffer+1+my_base_path.size()+1,
+				    message_length-my_base_path.size()-3,
+				    my_base_path,
+				    my_rank,
+				    total_ranks);
+      } // if(instruction_letter == "M"){
+      if(instruction_letter == "W"){
+	valid_instruction=true;
+	if(!rank_bucket_size){
+	  cerr << "rank " << my_rank << " never got bucket size!  Exiting.\n";
+	  return 7;
+	}
+	my_base_path = string(message_buffer+1);
+	parfu_self_scheduled_Create(message_buffer+1+my_base_path.size()+1,
+				    message_length-my_base_path.size()-3,
+				    my_base_path,
+				    file_handle,
+				    buffer_pool,
+				    rank_pipeline_depth,
+				    my_rank);
       }
       if(instruction_letter == "N"){
 	valid_instruction=true;
@@ -172,6 +344,22 @@ int parfu_worker_node(int my_rank, int total_ranks){
 	valid_instruction=true;
 	// we're done.  exit gracefully.
 	free(message_buffer);
+	if(create_pipeline != nullptr){
+	  delete create_pipeline;
+	  create_pipeline=nullptr;
+	}
+	if(buffer_pool != nullptr){
+	  delete buffer_pool;
+	  buffer_pool=nullptr;
+	}
+	// rank 0 closes the archive along with us, once it's sent this.
+	// A compressed archive's partial file was closed when it was
+	// packed.
+	for(unsigned ndx=0; ndx<archive_files.size(); ndx++){
+	  if(*(archive_files.at(ndx)) != MPI_FILE_NULL){
+	    MPI_File_close(archive_files.at(ndx));
+	  }
+	}
 	if(file_handle != nullptr){
 	  free(file_handle);
 	  file_handle=nullptr;
@@ -194,7 +382,8 @@ int parfu_worker_node(int my_rank, int total_ranks){
 	cerr << "parfu_worker: 4 MPI_Recv returned " << mpi_return_val << "!\n";
       }
       //      cerr << "individual receive; got length=" << *my_length << "\n";
-      message_buffer = (char*)malloc(*my_length);
+      message_length = *my_length;
+      message_buffer = (char*)malloc(message_length);
       if((mpi_return_val = MPI_Recv((void*)(message_buffer),*my_length,MPI_CHAR,
 				    0,MPI_ANY_TAG,MPI_COMM_WORLD,message_status))!=MPI_SUCCESS){
 	cerr << "parfu_worker: 5 MPI_Recv returned " << mpi_return_val << "!\n";
@@ -215,17 +404,22 @@ int parfu_worker_node(int my_rank, int total_ranks){
 	  return 7;
 	}
 	
-	// the rest of a message is a buffer with transfer orders
-	// this creates the order set for this rank
-	my_rank_order = new Parfu_rank_order_set(message_string.substr(1));
-	cerr << "r:" << my_rank << " Cmode w/ orders:";
-	cerr << my_rank_order->n_orders() << ", totsz:";
-	cerr << my_rank_order->total_size();
-	//<< "\n";
-	cerr << " 1st file:" << my_rank_order->order_n_filename(0) << "\n";
-	my_rank_order->move_data_Create(my_base_path,
-					rank_bucket_size,
-					file_handle);
+	if(create_pipeline==nullptr){
+	  create_pipeline = new Parfu_create_pipeline(buffer_pool,
+						      rank_pipeline_depth);
+	}
+	
+	// the rest of a message is a binary buffer with one or more
+	// order sets (less the instruction letter and the trailing
+	// null); each order set is decoded in place.  
+	sets_submitted = create_pipeline->submit_order_sets(message_buffer+1,
+							    message_length-2,
+							    my_base_path,
+							    file_handle);
+	cerr << "r:" << my_rank << " Cmode w/ order sets:" << sets_submitted << "\n";
+	if(sets_submitted < 0){
+	  cerr << "rank " << my_rank << " got a bad order set in a C order!\n";
+	}
 	// Now return to say that I'm done
 	message_string = to_string(my_rank);
 	if((mpi_return_val = MPI_Send(message_string.c_str(),message_string.size()+1,MPI_CHAR,
@@ -234,10 +428,73 @@ int parfu_worker_node(int my_rank, int total_ranks){
 	}
 	
       } //  if(instruction_letter == "C"){
+      if(instruction_letter == "E"){
+	valid_instruction=true;
+	if(!rank_bucket_size){
+	  cerr << "rank " << my_rank << " never got bucket size!  Exiting.\n";
+	  return 7;
+	}
+	if(create_pipeline==nullptr){
+	  create_pipeline = new Parfu_create_pipeline(buffer_pool,
+						      rank_pipeline_depth);
+	}
+	sets_submitted = create_pipeline->extract_order_sets(message_buffer+1,
+							     message_length-2,
+							     my_base_path,
+							     file_handle);
+	cerr << "r:" << my_rank << " Emode w/ order sets:" << sets_submitted << "\n";
+	if(sets_submitted < 0){
+	  cerr << "rank " << my_rank << " had trouble with an E order!\n";
+	}
+	message_string = to_string(my_rank);
+	if((mpi_return_val = MPI_Send(message_string.c_str(),message_string.size()+1,MPI_CHAR,
+				      0,0,MPI_COMM_WORLD))!=MPI_SUCCESS){
+	  cerr << "rank " << my_rank << "sending done didn't work!\n";
+	}
+      } // if(instruction_letter == "E"){
+      if(instruction_letter == "V"){
+	valid_instruction=true;
+	if(!rank_bucket_size){
+	  cerr << "rank " << my_rank << " never got bucket size!  Exiting.\n";
+	  return 7;
+	}
+	if(create_pipeline==nullptr){
+	  create_pipeline = new Parfu_create_pipeline(buffer_pool,
+						      rank_pipeline_depth);
+	}
+	sets_submitted = create_pipeline->verify_order_sets(message_buffer+1,
+							    message_length-2,
+							    my_base_path,
+							    file_handle);
+	if(sets_submitted < 0){
+	  cerr << "rank " << my_rank << " had trouble with a V order!\n";
+	}
+	message_string = to_string(my_rank);
+	if((mpi_return_val = MPI_Send(message_string.c_str(),message_string.size()+1,MPI_CHAR,
+				      0,0,MPI_COMM_WORLD))!=MPI_SUCCESS){
+	  cerr << "rank " << my_rank << "sending done didn't work!\n";
+	}
+      } // if(instruction_letter == "V"){
       if(instruction_letter == "P"){
 	valid_instruction=true;
 	my_base_path = message_string.substr(1);
       }
+      if(instruction_letter == "S"){
+	valid_instruction=true;
+	string directory_list = message_string.substr(1);
+	string batch_string;
+	size_t line_begin=0,line_end;
+	while((line_end=directory_list.find(PARFU_LINE_SEPARATOR_CHARACTER,line_begin))
+	      != string::npos){
+	  Parfu_directory scan_dir(my_base_path,
+				   directory_list.substr(line_begin,line_end-line_begin));
+	  scan_dir.scan_directory_level();
+	  batch_string.append(scan_dir.spider_batch_lines());
+	  scan_dir.release_entries();
+	  line_begin = line_end + 1;
+	}
+	parfu_send_reply_to_boss(0,batch_string);
+      } // if(instruction_letter == "S"){
       if(instruction_letter == "B"){
 	valid_instruction=true;
 	// swap back to broadcast receive mode
@@ -247,6 +504,15 @@ int parfu_worker_node(int my_rank, int total_ranks){
 	valid_instruction=true;
 	// we're done.  exit gracefully.
 	free(message_buffer);
+	if(create_pipeline != nullptr){
+	  // this waits for any bucket writes still in flight
+	  delete create_pipeline;
+	  create_pipeline=nullptr;
+	}
+	if(buffer_pool != nullptr){
+	  delete buffer_pool;
+	  buffer_pool=nullptr;
+	}
 	cerr << "rank " << my_rank << " got individual shutdown.  returning.\n";
 	return 0;
       }	
@@ -270,3 +536,383 @@ int parfu_worker_node(int my_rank, int total_ranks){
   }
 
 
+
+// worker rank sending a variable-length reply back to rank 0.  Like
+// the orders coming the other way, the length goes first, then the
+// buffer (with its null terminator).  Rank 0 picks these up with
+// parfu_receive_reply_from_worker().
+int parfu_send_reply_to_boss(int tag,
+			     string message){
+  int message_length;
+  int mpi_return_val;
+
+  message_length = message.size()+1;
+  mpi_return_val = MPI_Send(&message_length,1,MPI_INT,0,tag,MPI_COMM_WORLD);
+  mpi_return_val += MPI_Send(((void*)(message.data())),
+			     message.size()+1,
+			     MPI_CHAR,0,tag,MPI_COMM_WORLD);
+  return mpi_return_val;
+}
+
+// Self-scheduled create mode.  Every rank has the whole plan (all the
+// order sets for the archive, back to back), and order sets are
+// claimed by bumping a counter that lives on rank 0 with an RMA
+// MPI_Fetch_and_op().  So nobody waits on rank 0 to be handed work,
+// and rank 0 moves data like everyone else.  This is collective over
+// MPI_COMM_WORLD; it returns (with all of this rank's writes done)
+// once the plan is used up.  Returns the number of order sets this
+// rank did, or -1 on error.
+long int parfu_self_scheduled_Create(const char *plan_buffer,
+				     size_t plan_length,
+				     string base_path,
+				     MPI_File *archive_file_handle,
+				     Parfu_buffer_pool *buffer_pool,
+				     unsigned pipeline_depth,
+				     int my_rank){
+  vector <size_t> set_offsets;
+  vector <size_t> set_sizes;
+  size_t plan_position=0;
+  size_t set_size;
+  // only rank 0's copy of this is ever touched, through the window
+  int64_t next_set_counter=0;
+  int64_t claimed_set;
+  const int64_t one=1;
+  MPI_Win counter_window;
+  Parfu_create_pipeline *create_pipeline;
+  Parfu_rank_order_set *my_rank_order;
+  long int sets_done=0;
+  int mpi_return_val;
+  int total_ranks;
+  // with only one rank there's nobody to share the counter with, and
+  // some MPI builds won't make a window on a single process anyway
+  bool use_window;
+  
+  MPI_Comm_size(MPI_COMM_WORLD,&total_ranks);
+  use_window = (total_ranks > 1);
+  
+  // find where each order set starts
+  while(plan_position < plan_length){
+    if(!(set_size=parfu_wire_order_set_size(plan_buffer+plan_position,
+					    plan_length-plan_position))){
+      cerr << "rank " << my_rank << " got a bad plan at byte " << plan_position << "!\n";
+      // we still have to take part in the collective calls below,
+      // but we won't claim anything
+      set_offsets.clear();
+      set_sizes.clear();
+      sets_done=-1;
+      break;
+    }
+    set_offsets.push_back(plan_position);
+    set_sizes.push_back(set_size);
+    plan_position += set_size;
+  }
+  
+  if(use_window &&
+     (mpi_return_val=MPI_Win_create(&next_set_counter,
+				    (my_rank==0)?sizeof(next_set_counter):0,
+				    sizeof(next_set_counter),
+				    MPI_INFO_NULL,MPI_COMM_WORLD,
+				    &counter_window))!=MPI_SUCCESS){
+    cerr << "rank " << my_rank << " MPI_Win_create returned " << mpi_return_val << "!\n";
+    return -1;
+  }
+  create_pipeline = new Parfu_create_pipeline(buffer_pool,pipeline_depth);
+  
+  if(use_window){
+    MPI_Win_lock_all(0,counter_window);
+  }
+  while(sets_done >= 0){
+    if(use_window){
+      MPI_Fetch_and_op(&one,&claimed_set,MPI_INT64_T,
+		       0,0,MPI_SUM,counter_window);
+      MPI_Win_flush(0,counter_window);
+    }
+    else{
+      claimed_set = next_set_counter++;
+    }
+    if(claimed_set >= ((int64_t)(set_offsets.size()))){
+      break;
+    }
+    my_rank_order =
+      new Parfu_rank_order_set(plan_buffer+set_offsets.at(claimed_set),
+			       set_sizes.at(claimed_set));
+    create_pipeline->submit_bucket(my_rank_order,
+				   base_path,
+				   archive_file_handle);
+    delete my_rank_order;
+    sets_done++;
+  }
+  if(use_window){
+    MPI_Win_unlock_all(counter_window);
+  }
+  
+  // wait for our own writes, then MPI_Win_free() doubles as the
+  // barrier that tells rank 0 that everyone is finished
+  delete create_pipeline;
+  if(use_window){
+    MPI_Win_free(&counter_window);
+  }
+  cerr << "r:" << my_rank << " self-scheduled " << sets_done << " order sets.\n";
+  return sets_done;
+}
+
+// Files big enough to be split over several buckets get written by
+// several ranks at once, each allocating its own extents as it goes,
+// which contends on the file's allocation and leaves it in lots of
+// small extents.  So these are created at their full size before
+// any data moves, a round-robin share per rank.  The plan is one
+// "<size>\t<relative path>\n" line per file.  This is collective
+// over MPI_COMM_WORLD.  Returns the number of files this rank
+// preallocated, or -1 if any of them failed.
+long int parfu_preallocate_files(const char *plan_buffer,
+				 size_t plan_length,
+				 string base_path,
+				 int my_rank,
+				 int total_ranks){
+  size_t line_begin=0,line_end,tab_position;
+  unsigned long file_index=0;
+  long int files_done=0;
+  bool failed=false;
+  string plan_line,file_path;
+  off_t file_size;
+  int target_fd;
+
+  while(line_begin < plan_length){
+    line_end = line_begin;
+    while(line_end < plan_length &&
+	  plan_buffer[line_end] != PARFU_LINE_SEPARATOR_CHARACTER){
+      line_end++;
+    }
+    plan_line = string(plan_buffer+line_begin,line_end-line_begin);
+    line_begin = line_end+1;
+    if((tab_position=plan_line.find(PARFU_ENTRY_SEPARATOR_CHARACTER)) == string::npos ||
+       (file_index++ % total_ranks) != ((unsigned)my_rank)){
+      continue;
+    }
+    file_size = stol(plan_line.substr(0,tab_position));
+    file_path = base_path + "/" + plan_line.substr(tab_position+1);
+    // replace whatever's there, as scatter_bucket_Extract() does for
+    // files that aren't split
+    if(unlink(file_path.c_str()) && errno != ENOENT){
+      cerr << "parfu_preallocate_files: could not replace " << file_path;
+      cerr << ": " << strerror(errno) << "\n";
+    }
+    if((target_fd=open(file_path.c_str(),O_WRONLY|O_CREAT,0666))<0){
+      cerr << "parfu_preallocate_files: could not create " << file_path;
+      cerr << ": " << strerror(errno) << "\n";
+      failed=true;
+      continue;
+    }
+    // not every file system can fallocate(); then at least the size
+    // is set once, up front
+    if(fallocate(target_fd,0,0,file_size) && ftruncate(target_fd,file_size)){
+      cerr << "parfu_preallocate_files: could not set size of " << file_path;
+      cerr << ": " << strerror(errno) << "\n";
+      failed=true;
+    }
+    else{
+      files_done++;
+    }
+    close(target_fd);
+  }
+  MPI_Barrier(MPI_COMM_WORLD);
+  return failed ? -1 : files_done;
+}
+
+// The directory phase of extract mode.  The plan is the relative
+// paths of every directory to make, one per line, shallowest level
+// first, with an empty line after each level.  Each rank makes its
+// share of a level, and nobody starts the next level until everyone
+// is done with this one, so every mkdir() finds its parent already
+// there and the data phase never has to make a directory at all.
+// If the plan goes on past a null, the rest is files to preallocate
+// (see parfu_preallocate_files()), which is done before returning.
+// This is collective over MPI_COMM_WORLD.  Returns the number of
+// directories this rank made, or -1 if any of them (or any
+// preallocation) failed.
+long int parfu_make_directory_levels(const char *plan_buffer,
+				     size_t plan_length,
+				     string base_path,
+				     int my_rank,
+				     int total_ranks){
+  size_t line_begin=0,line_end;
+  unsigned long index_in_level=0;
+  long int directories_made=0;
+  bool failed=false;
+  string directory_path;
+
+  while(line_begin < plan_length){
+    if(plan_buffer[line_begin] == '\0'){
+      if(parfu_preallocate_files(plan_buffer+line_begin+1,
+				 plan_length-line_begin-1,
+				 base_path,my_rank,total_ranks) < 0){
+	failed=true;
+      }
+      break;
+    }
+    line_end = line_begin;
+    while(line_end < plan_length &&
+	  plan_buffer[line_end] != PARFU_LINE_SEPARATOR_CHARACTER){
+      line_end++;
+    }
+    if(line_end == line_begin){
+      // end of a level
+      MPI_Barrier(MPI_COMM_WORLD);
+      index_in_level=0;
+      line_begin = line_end+1;
+      continue;
+    }
+    if((index_in_level++ % total_ranks) == ((unsigned)my_rank)){
+      directory_path = base_path + "/" +
+	string(plan_buffer+line_begin,line_end-line_begin);
+      if(mkdir(directory_path.c_str(),0777)){
+	if(errno != EEXIST){
+	  cerr << "parfu_make_directory_levels: could not make " << directory_path;
+	  cerr << ": " << strerror(errno) << "\n";
+	  failed=true;
+	}
+      }
+      else{
+	directories_made++;
+      }
+    }
+    line_begin = line_end+1;
+  }
+  return failed ? -1 : directories_made;
+}
+
+// put back one entry's mode, owner and mtime.  Returns 0 on success.
+static int parfu_apply_metadata(const parfu_metadata_t &metadata,
+				bool restore_owner,
+				mode_t mode_mask){
+  struct timespec times[2];
+  int return_val=0;
+
+  // atime is "now", as tar does
+  times[0].tv_sec = 0;
+  times[0].tv_nsec = UTIME_NOW;
+  times[1].tv_sec = metadata.mtime;
+  times[1].tv_nsec = 0;
+  if(metadata.file_type == PARFU_FILE_TYPE_SYMLINK_CHAR){
+    if(restore_owner &&
+       lchown(metadata.path.c_str(),metadata.uid,metadata.gid)){
+      return_val = -1;
+    }
+    if(utimensat(AT_FDCWD,metadata.path.c_str(),times,AT_SYMLINK_NOFOLLOW)){
+      return_val = -1;
+    }
+    return return_val;
+  }
+  // chown() first, since it can clear the setuid/setgid bits
+  if(restore_owner &&
+     chown(metadata.path.c_str(),metadata.uid,metadata.gid)){
+    return_val = -1;
+  }
+  if(chmod(metadata.path.c_str(),metadata.mode & mode_mask)){
+    return_val = -1;
+  }
+  if(utimensat(AT_FDCWD,metadata.path.c_str(),times,0)){
+    return_val = -1;
+  }
+  return return_val;
+}
+
+// The last phase of extract mode: every rank puts back the metadata
+// it queued up while writing data, and makes the hard links and
+// duplicates it queued up.  Duplicates are copied before anything
+// else, since a hard link can be another name for one and putting
+// back a file's mode could stop it being read.  Then files, symlinks
+// and hard links; then duplicates' own metadata, which goes on after
+// the files' since a duplicate standing in for an unselected
+// original was also written as that original, metadata and all; and
+// then directories, deepest level first across all ranks, so that
+// creating or changing anything inside a directory can't change its
+// mtime afterwards, and a directory that ends up without write or
+// search permission doesn't lock anyone out of what's under it.
+// Ownership is only restored when running as root, and otherwise
+// the umask applies to the modes, as with tar.  This is collective
+// over MPI_COMM_WORLD.  Returns the number of entries that couldn't
+// be restored (or, for hard links and duplicates, made at all) on
+// this rank; rank 0 gets the total over all ranks.
+long int parfu_restore_metadata(vector <parfu_metadata_t> *metadata_queue,
+				int my_rank){
+  vector <parfu_metadata_t*> directories;
+  vector <parfu_metadata_t*> duplicates;
+  bool restore_owner = (geteuid() == 0);
+  mode_t mode_mask = MODE_MASK;
+  unsigned long my_max_depth=0,max_depth;
+  long int failures=0;
+
+  if(!restore_owner){
+    mode_t my_umask = umask(0);
+    umask(my_umask);
+    mode_mask &= ~my_umask;
+  }
+  for(unsigned long ndx=0; ndx<metadata_queue->size(); ndx++){
+    parfu_metadata_t *metadata = &(metadata_queue->at(ndx));
+    if(metadata->file_type == PARFU_FILE_TYPE_DUPLICATE_CHAR &&
+       metadata->link_target.size() &&
+       parfu_copy_file(metadata->link_target,metadata->path)){
+      failures++;
+    }
+  }
+  MPI_Barrier(MPI_COMM_WORLD);
+  for(unsigned long ndx=0; ndx<metadata_queue->size(); ndx++){
+    parfu_metadata_t *metadata = &(metadata_queue->at(ndx));
+    if(metadata->file_type == PARFU_FILE_TYPE_HARDLINK_CHAR){
+      // shares the other name's inode, so its metadata too
+      if(parfu_make_hard_link(metadata->link_target,metadata->path)){
+	failures++;
+      }
+      continue;
+    }
+    if(metadata->file_type == PARFU_FILE_TYPE_DUPLICATE_CHAR){
+      duplicates.push_back(metadata);
+      continue;
+    }
+    if(metadata->file_type == PARFU_FILE_TYPE_DIRECTORY_CHAR){
+      directories.push_back(metadata);
+      my_max_depth = max(my_max_depth,(unsigned long)(metadata->depth));
+      continue;
+    }
+    if(parfu_apply_metadata(*metadata,restore_owner,mode_mask)){
+      failures++;
+    }
+  }
+  MPI_Barrier(MPI_COMM_WORLD);
+  for(unsigned long ndx=0; ndx<duplicates.size(); ndx++){
+    if(parfu_apply_metadata(*(duplicates.at(ndx)),restore_owner,mode_mask)){
+      failures++;
+    }
+  }
+  sort(directories.begin(),directories.end(),
+       [](parfu_metadata_t *a, parfu_metadata_t *b){
+	 return a->depth > b->depth;
+       });
+  MPI_Allreduce(&my_max_depth,&max_depth,1,MPI_UNSIGNED_LONG,MPI_MAX,MPI_COMM_WORLD);
+  // nobody touches a directory until everyone's done with files
+  MPI_Barrier(MPI_COMM_WORLD);
+  unsigned long next_directory=0;
+  for(long int depth=max_depth; depth>=0; depth--){
+    while(next_directory < directories.size() &&
+	  directories.at(next_directory)->depth == depth){
+      if(parfu_apply_metadata(*(directories.at(next_directory)),
+			      restore_owner,mode_mask)){
+	failures++;
+      }
+      next_directory++;
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+  }
+  if(failures){
+    cerr << "rank " << my_rank << " could not restore metadata on ";
+    cerr << failures << " entries.\n";
+  }
+  metadata_queue->clear();
+  long int total_failures=0;
+  MPI_Reduce(&failures,&total_failures,1,MPI_LONG,MPI_SUM,0,MPI_COMM_WORLD);
+  if(my_rank == 0){
+    return total_failures;
+  }
+  return failures;
+}
@@ -27,4 +27,29 @@
 
 int parfu_worker_node(int my_rank, int total_ranks);
 
+int parfu_send_reply_to_boss(int tag,
+			     string message);
+
+long int parfu_self_scheduled_Create(const char *plan_buffer,
+				     size_t plan_length,
+				     string base_path,
+				     MPI_File *archive_file_handle,
+				     Parfu_buffer_pool *buffer_pool,
+				     unsigned pipeline_depth,
+				     int my_rank);
+
+long int parfu_preallocate_files(const char *plan_buffer,
+				 size_t plan_length,
+				 string base_path,
+				 int my_rank,
+				 int total_ranks);
+long int parfu_make_directory_levels(const char *plan_buffer,
+				     size_t plan_length,
+				     string base_path,
+				     int my_rank,
+				     int total_ranks);
+
+long int parfu_restore_metadata(vector <parfu_metadata_t> *metadata_queue,
+				int my_rank);
+
 #endif
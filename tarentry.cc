@@ -36,8 +36,11 @@
 
 #include <cassert>
 #include <cstring>
+#include <cstddef>
 #include <cerrno>
 #include <algorithm>
+#include <map>
+#include <mutex>
 
 #include <libgen.h>
 #include <limits.h>
@@ -45,6 +48,11 @@
 #include <grp.h>
 #include <pwd.h>
 
+// name caches behind user_name() and group_name()
+static std::map<uid_t, std::string> user_name_cache;
+static std::map<gid_t, std::string> group_name_cache;
+static std::mutex name_cache_mutex;
+
 tarentry::tarentry(const std::string fn, const size_t off) : offset(off),
                    filename(fn)
 {
@@ -83,6 +91,20 @@ tarentry::tarentry(const std::string fn, const size_t off) : offset(off),
   }
 }
 
+tarentry::tarentry(const std::string fn, const size_t off,
+                   const struct stat &in_statbuf, const std::string ln,
+                   const bool is_hardlink) :
+                   offset(off), statbuf(in_statbuf), filename(fn),
+                   linkname(ln), hardlink(is_hardlink)
+{
+  // same as above, but the caller already stat()ed the file (or has
+  // the metadata from somebody who did) so we don't go back to the
+  // file system for it
+  if(S_ISDIR(statbuf.st_mode) && *filename.rbegin() != '/') {
+    filename += "/";
+  }
+}
+
 size_t tarentry::deserialize(const char *buf)
 {
   size_t sz;
@@ -162,7 +184,7 @@ std::vector<char> tarentry::make_tar_header() const
       p += snprintf(p, q-p, "%d linkpath=%s\n", sz, linkname.c_str());
     }
     assert(p < q);
-    if(S_ISREG(statbuf.st_mode) && statbuf.st_size > MAX_FILE_SIZE) {
+    if(S_ISREG(statbuf.st_mode) && !hardlink && statbuf.st_size > MAX_FILE_SIZE) {
       char buf[128];
       sprintf(buf, "%zu", size_t(statbuf.st_size));
       int sz = record_length("size", buf);
@@ -170,7 +192,8 @@ std::vector<char> tarentry::make_tar_header() const
     }
     assert(p < q);
   }
-  make_ustar_header_block(hdr, 0, statbuf, filename.c_str(), linkname.c_str());
+  make_ustar_header_block(hdr, 0, statbuf, filename.c_str(), linkname.c_str(),
+                          hardlink);
 
   return full_hdr;
 }
@@ -202,7 +225,7 @@ size_t tarentry::get_paxsize() const
   if(linkname.size() > sizeof(((ustar_hdr*)0)->linkname)) {
     pax_sz += record_length("linkpath", linkname.c_str());
   }
-  if(S_ISREG(statbuf.st_mode) && statbuf.st_size > MAX_FILE_SIZE) {
+  if(S_ISREG(statbuf.st_mode) && !hardlink && statbuf.st_size > MAX_FILE_SIZE) {
     char buf[128];
     sprintf(buf, "%zu", size_t(statbuf.st_size));
     pax_sz += record_length("size", buf);
@@ -213,10 +236,10 @@ size_t tarentry::get_paxsize() const
 
 void tarentry::make_ustar_header_block(ustar_hdr &hdr, const int xtype,
                                        const struct stat &statbuf,
-                                       const char *filename, const char *ln)
+                                       const char *filename, const char *ln,
+                                       const bool is_hardlink)
 {
-  struct group *grp;
-  struct passwd *pwd;
+  std::string uname, gname;
 
   if(!(S_ISLNK(statbuf.st_mode) || S_ISREG(statbuf.st_mode) ||
        S_ISDIR(statbuf.st_mode))) {
@@ -225,23 +248,11 @@ void tarentry::make_ustar_header_block(ustar_hdr &hdr, const int xtype,
     exit(1);
   }
 
-  errno = 0;
-  grp = getgrgid(statbuf.st_gid);
-  if(!grp) {
-    fprintf(stderr, "Could not get group name for group '%d': %s\n",
-            int(statbuf.st_gid), strerror(errno));
-    exit(1);
-  }
-  errno = 0;
-  pwd = getpwuid(statbuf.st_uid);
-  if(!pwd) {
-    fprintf(stderr, "Could not get user name for user '%d': %s\n",
-            int(statbuf.st_gid), strerror(errno));
-    exit(1);
-  }
+  gname = group_name(statbuf.st_gid);
+  uname = user_name(statbuf.st_uid);
 
   memset(&hdr, 0, BLOCKSIZE);
-  if(S_ISLNK(statbuf.st_mode))
+  if(S_ISLNK(statbuf.st_mode) || is_hardlink)
   {
     // this is functionally identical to what strncpy alreday does but avoids
     // warnings from over-eager compilers about possible string truncation (given
@@ -265,7 +276,7 @@ void tarentry::make_ustar_header_block(ustar_hdr &hdr, const int xtype,
   snprintf(hdr.gid, sizeof(hdr.gid), "%0*o",
            (int)sizeof(hdr.gid)-1, xtype ? 0 : statbuf.st_gid);
   // tar requires zero size for links and allows it for dirs
-  off_t size = S_ISREG(statbuf.st_mode) ? statbuf.st_size : 0;
+  off_t size = (S_ISREG(statbuf.st_mode) && !is_hardlink) ? statbuf.st_size : 0;
   snprintf(hdr.size, sizeof(hdr.size), "%0*lo",
            (int)sizeof(hdr.size)-1, size < MAX_FILE_SIZE ? size : 0);
   snprintf(hdr.mtime, sizeof(hdr.mtime), "%0*lo",
@@ -273,6 +284,8 @@ void tarentry::make_ustar_header_block(ustar_hdr &hdr, const int xtype,
   memset(hdr.chksum, ' ', sizeof(hdr.chksum));
   if(xtype)
     hdr.typeflag = char(xtype);
+  else if(is_hardlink)
+    hdr.typeflag = LNKTYPE;
   else if(S_ISLNK(statbuf.st_mode))
     hdr.typeflag = SYMTYPE;
   else if(S_ISDIR(statbuf.st_mode))
@@ -286,8 +299,8 @@ void tarentry::make_ustar_header_block(ustar_hdr &hdr, const int xtype,
   memcpy(hdr.magic, TMAGIC, sizeof(hdr.magic));
   memcpy(hdr.version, TVERSION, sizeof(hdr.version));
   if(!xtype) {
-    snprintf(hdr.uname, sizeof(hdr.uname), "%s", pwd->pw_name);
-    snprintf(hdr.gname, sizeof(hdr.gname), "%s", grp->gr_name);
+    snprintf(hdr.uname, sizeof(hdr.uname), "%s", uname.c_str());
+    snprintf(hdr.gname, sizeof(hdr.gname), "%s", gname.c_str());
     snprintf(hdr.devmajor, sizeof(hdr.devmajor), "%0*o",
              (int)sizeof(hdr.devmajor)-1, 0);
     snprintf(hdr.devminor, sizeof(hdr.devminor), "%0*o",
@@ -308,6 +321,54 @@ void tarentry::make_ustar_header_block(ustar_hdr &hdr, const int xtype,
   snprintf(hdr.chksum, sizeof(hdr.chksum), "0%-lo", checksum);
 }
 
+std::string tarentry::user_name(const uid_t uid)
+{
+  std::lock_guard<std::mutex> lock(name_cache_mutex);
+  std::map<uid_t, std::string>::const_iterator it = user_name_cache.find(uid);
+  if(it != user_name_cache.end())
+    return it->second;
+
+  errno = 0;
+  struct passwd *pwd = getpwuid(uid);
+  if(!pwd) {
+    fprintf(stderr, "Could not get user name for user '%d': %s\n",
+            int(uid), strerror(errno));
+    exit(1);
+  }
+  user_name_cache[uid] = pwd->pw_name;
+  return user_name_cache[uid];
+}
+
+std::string tarentry::group_name(const gid_t gid)
+{
+  std::lock_guard<std::mutex> lock(name_cache_mutex);
+  std::map<gid_t, std::string>::const_iterator it = group_name_cache.find(gid);
+  if(it != group_name_cache.end())
+    return it->second;
+
+  errno = 0;
+  struct group *grp = getgrgid(gid);
+  if(!grp) {
+    fprintf(stderr, "Could not get group name for group '%d': %s\n",
+            int(gid), strerror(errno));
+    exit(1);
+  }
+  group_name_cache[gid] = grp->gr_name;
+  return group_name_cache[gid];
+}
+
+void tarentry::add_user_name(const uid_t uid, const std::string name)
+{
+  std::lock_guard<std::mutex> lock(name_cache_mutex);
+  user_name_cache[uid] = name;
+}
+
+void tarentry::add_group_name(const gid_t gid, const std::string name)
+{
+  std::lock_guard<std::mutex> lock(name_cache_mutex);
+  group_name_cache[gid] = name;
+}
+
 size_t tarentry::record_length(const char *keyword, const char *value)
 {
   int oldlen = 0, newlen = strlen(keyword)+strlen(value)+5; // would be 2 digits
@@ -331,3 +392,68 @@ size_t tarentry::compute_hdr_size(const char *name, const char *linkname,
   dummy.statbuf.st_mode = S_IFREG;
   return dummy.hdr_size();
 }
+
+bool tarentry::valid_header_block(const ustar_hdr &hdr)
+{
+  // POSIX is "ustar\0" "00", GNU is "ustar " " \0"
+  if(memcmp(hdr.magic, "ustar", 5))
+    return false;
+
+  unsigned long int checksum = 0;
+  for(size_t j = 0 ; j < sizeof(hdr) ; j++) {
+    if(j >= offsetof(ustar_hdr, chksum) &&
+       j < offsetof(ustar_hdr, chksum) + sizeof(hdr.chksum))
+      checksum += ' ';
+    else
+      checksum += ((const unsigned char*)&hdr)[j];
+  }
+  return checksum == parse_number(hdr.chksum, sizeof(hdr.chksum));
+}
+
+unsigned long tarentry::parse_number(const char *field, const size_t len)
+{
+  unsigned long value = 0;
+  if((unsigned char)field[0] & 0x80) {
+    // base-256, big endian, with the top bit of the first byte as a flag
+    value = (unsigned char)field[0] & 0x7f;
+    for(size_t i = 1 ; i < len ; i++)
+      value = (value << 8) | (unsigned char)field[i];
+    return value;
+  }
+  for(size_t i = 0 ; i < len ; i++) {
+    if(field[i] == ' ' && value == 0)
+      continue;
+    if(field[i] < '0' || field[i] > '7')
+      break;
+    value = value*8 + (field[i]-'0');
+  }
+  return value;
+}
+
+void tarentry::parse_pax_records(const char *buf, const size_t len,
+                                 std::string &path, std::string &linkpath,
+                                 long int &size)
+{
+  // each record is "<length> <keyword>=<value>\n", length counting
+  // the whole record
+  size_t pos = 0;
+  while(pos < len) {
+    char *endp;
+    unsigned long reclen = strtoul(buf+pos, &endp, 10);
+    if(endp == buf+pos || *endp != ' ' || reclen < 4 || pos+reclen > len)
+      break;
+    const char *kw = endp+1;
+    const char *eq = (const char*)memchr(kw, '=', buf+pos+reclen-kw);
+    if(eq != NULL) {
+      std::string keyword(kw, eq-kw);
+      std::string value(eq+1, buf+pos+reclen-1-(eq+1));
+      if(keyword == "path")
+        path = value;
+      else if(keyword == "linkpath")
+        linkpath = value;
+      else if(keyword == "size")
+        size = strtol(value.c_str(), NULL, 10);
+    }
+    pos += reclen;
+  }
+}
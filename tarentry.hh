@@ -64,9 +64,16 @@ struct ustar_hdr {
 #define BLOCKSIZE 512
 namespace { typedef int ustar_hdr_size_assert[(sizeof(ustar_hdr) == BLOCKSIZE) ? 1 : -1]; }
 #define REGTYPE '0'
+#define AREGTYPE '\0'
+#define LNKTYPE '1'
 #define SYMTYPE '2'
 #define DIRTYPE '5'
+#define CONTTYPE '7'
 #define XHDTYPE 'x'
+#define XGLTYPE 'g'
+// GNU tar's long name and long link name members
+#define GNU_LONGNAME_TYPE 'L'
+#define GNU_LONGLINK_TYPE 'K'
 #define TVERSION "00"
 #define TMAGIC "ustar\0"
 #define MODE_MASK 07777
@@ -77,6 +84,12 @@ class tarentry
 {
   public:
   tarentry(const std::string fn, const size_t off);
+  // construct from metadata we already have, without touching the file.
+  // With is_hardlink, statbuf is that of a regular file and ln is the
+  // name of the member this is a hard link to.
+  tarentry(const std::string fn, const size_t off,
+           const struct stat &in_statbuf, const std::string ln,
+           const bool is_hardlink = false);
   tarentry() {};
   ~tarentry() {};
 
@@ -96,28 +109,47 @@ class tarentry
   bool is_reg() const { return S_ISREG(statbuf.st_mode); }
   size_t get_offset() const { return offset; }
 
+  // uid/gid to user/group name lookups, cached for the life of the
+  // process so that each distinct id costs one NSS (LDAP, SSSD, ...)
+  // lookup at most.  add_*_name() pre-loads the cache with names
+  // that were looked up elsewhere (e.g. on another rank).
+  static std::string user_name(const uid_t uid);
+  static std::string group_name(const gid_t gid);
+  static void add_user_name(const uid_t uid, const std::string name);
+  static void add_group_name(const gid_t gid, const std::string name);
+
   // non-stat()-ing version to compute header length
   static size_t compute_hdr_size(const char *name, const char *linkname,
                                  const long int size);
 
+  // for reading existing archives:
+  // whether a block is a ustar (POSIX or GNU) header with a good checksum
+  static bool valid_header_block(const ustar_hdr &hdr);
+  // value of a numeric header field, octal or GNU base-256
+  static unsigned long parse_number(const char *field, const size_t len);
+  // pick path, linkpath and size out of pax extended header records,
+  // leaving any that aren't there alone
+  static void parse_pax_records(const char *buf, const size_t len,
+                                std::string &path, std::string &linkpath,
+                                long int &size);
+
   private:
   size_t offset;
   struct stat statbuf;
   std::string filename;
   std::string linkname;
+  bool hardlink = false;
 
   // size of pax extended header
   size_t get_paxsize() const;
   static void make_ustar_header_block(ustar_hdr &hdr, const int xtype,
                                       const struct stat &statbuf,
-                                      const char *fn, const char *ln);
+                                      const char *fn, const char *ln,
+                                      const bool is_hardlink = false);
   static size_t round_to_block(size_t sz) {
     return (sz + BLOCKSIZE-1) & ~(BLOCKSIZE-1);
   }
   static size_t record_length(const char *keyword, const char *value);
 };
 
-// TODO: put functions in here to put out file size and stuff
-// That way we can genuinely minimize the calls to stat.  
-
 #endif // TAR_ENTRY_HH_